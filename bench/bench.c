@@ -0,0 +1,271 @@
+#include "bench.h"
+#include "buddy.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_N 64
+struct bench {
+	char *name;
+	void (*f)(const bench_args_t *args);
+};
+
+static size_t bench_i;
+static struct bench BENCHES[BENCH_N] = { 0 };
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t threads] [-d duration_ms] [-f frames] "
+	       "[-i file] [filter]\n",
+	       prog);
+	printf("benchmarks:\n");
+	for (size_t i = 0; i < bench_i; i++)
+		printf("\t%s\n", BENCHES[i].name);
+}
+
+int main(int argc, char **argv)
+{
+	bench_args_t args = {
+		.threads = bench_cpus(),
+		.duration_ms = 1000,
+		.frames = 1ul << 22,
+	};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:d:f:i:h")) != -1) {
+		switch (opt) {
+		case 't':
+			args.threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			args.duration_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			args.frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			args.file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	const char *filter = optind < argc ? argv[optind] : NULL;
+
+	if (args.threads == 0 || args.frames < LLFREE_TREE_SIZE) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("# threads=%zu duration=%zums frames=%zu tree_children=%u\n",
+	       args.threads, args.duration_ms, args.frames,
+	       LLFREE_TREE_CHILDREN);
+
+	for (size_t i = 0; i < bench_i; i++) {
+		if (filter != NULL && strstr(BENCHES[i].name, filter) == NULL)
+			continue;
+		printf("\x1b[92mRunning bench '%s'\x1b[0m\n", BENCHES[i].name);
+		BENCHES[i].f(&args);
+	}
+	return 0;
+}
+
+void add_bench(char *name, void (*f)(const bench_args_t *args))
+{
+	assert(bench_i < BENCH_N);
+	BENCHES[bench_i].name = name;
+	BENCHES[bench_i].f = f;
+	bench_i++;
+}
+
+uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+void bench_sleep_ms(size_t ms)
+{
+	struct timespec ts = { .tv_sec = (time_t)(ms / 1000),
+			       .tv_nsec = (long)(ms % 1000) * 1000000l };
+	while (nanosleep(&ts, &ts) != 0) {
+	}
+}
+
+size_t bench_cpus(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (size_t)cpus : 1;
+}
+
+void bench_pin(size_t cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % bench_cpus(), &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		llfree_warn("pinning to cpu %zu failed", cpu);
+}
+
+size_t bench_next_threads(size_t threads, size_t max)
+{
+	if (threads >= max)
+		return 0;
+	return LL_MIN(threads * 2, max);
+}
+
+struct parallel {
+	pthread_barrier_t barrier;
+	void (*f)(size_t tid, void *ctx);
+	void *ctx;
+};
+
+struct parallel_arg {
+	struct parallel *shared;
+	size_t tid;
+};
+
+static void *parallel_run(void *input)
+{
+	struct parallel_arg *arg = input;
+	bench_pin(arg->tid);
+	pthread_barrier_wait(&arg->shared->barrier);
+	arg->shared->f(arg->tid, arg->shared->ctx);
+	return NULL;
+}
+
+void bench_parallel(size_t threads, void (*f)(size_t tid, void *ctx),
+		    void *ctx)
+{
+	struct parallel shared = { .f = f, .ctx = ctx };
+	pthread_barrier_init(&shared.barrier, NULL, (unsigned)threads);
+
+	pthread_t *handles = malloc(sizeof(pthread_t) * threads);
+	struct parallel_arg *thread_args =
+		malloc(sizeof(struct parallel_arg) * threads);
+	assert(handles != NULL && thread_args != NULL);
+
+	for (size_t i = 0; i < threads; i++) {
+		thread_args[i] = (struct parallel_arg){ &shared, i };
+		int ll_unused ret = pthread_create(&handles[i], NULL,
+						   parallel_run, &thread_args[i]);
+		assert(ret == 0);
+	}
+	for (size_t i = 0; i < threads; i++)
+		pthread_join(handles[i], NULL);
+
+	pthread_barrier_destroy(&shared.barrier);
+	free(thread_args);
+	free(handles);
+}
+
+llfree_t *bench_llfree_new(const llfree_classing_t *classing, size_t frames,
+			   uint8_t init)
+{
+	llfree_meta_size_t m = llfree_metadata_size(classing, frames);
+	llfree_t *self = aligned_alloc(LLFREE_CACHE_SIZE,
+				       align_up(m.llfree, LLFREE_CACHE_SIZE));
+	llfree_meta_t meta = {
+		.local = aligned_alloc(LLFREE_CACHE_SIZE,
+				       align_up(m.local, LLFREE_CACHE_SIZE)),
+		.trees = aligned_alloc(LLFREE_CACHE_SIZE,
+				       align_up(m.trees, LLFREE_CACHE_SIZE)),
+		.lower = aligned_alloc(LLFREE_CACHE_SIZE,
+				       align_up(m.lower, LLFREE_CACHE_SIZE)),
+	};
+	assert(self != NULL && meta.local != NULL && meta.trees != NULL &&
+	       meta.lower != NULL);
+
+	llfree_result_t ll_unused ret =
+		llfree_init(self, frames, init, meta, classing);
+	assert(llfree_is_ok(ret));
+	return self;
+}
+
+void bench_llfree_drop(llfree_t *self)
+{
+	llfree_meta_t m = llfree_metadata(self);
+	free(m.local);
+	free(m.trees);
+	free(m.lower);
+	free(self);
+}
+
+bench_alloc_t bench_alloc_new(bench_alloc_kind_t kind, size_t cores,
+			      size_t frames)
+{
+	bench_alloc_t self = { .kind = kind, .cores = cores };
+	switch (kind) {
+	case BENCH_LLFREE: {
+		llfree_classing_t classing = llfree_classing_movable(cores);
+		self.self = bench_llfree_new(&classing, frames,
+					     LLFREE_INIT_FREE);
+		break;
+	}
+	case BENCH_BUDDY:
+	case BENCH_BUDDY_PCP:
+		self.self = buddy_new(frames, cores, kind == BENCH_BUDDY_PCP);
+		break;
+	default:
+		assert(false);
+	}
+	return self;
+}
+
+void bench_alloc_drop(bench_alloc_t *self)
+{
+	if (self->kind == BENCH_LLFREE)
+		bench_llfree_drop(self->self);
+	else
+		buddy_drop(self->self);
+	self->self = NULL;
+}
+
+llfree_result_t bench_alloc_get(const bench_alloc_t *self, size_t core,
+				uint8_t order, bool movable)
+{
+	if (self->kind == BENCH_LLFREE) {
+		return llfree_get(self->self, frame_id_none(),
+				  llfree_movable_request(self->cores, order,
+							 core, movable));
+	}
+	return buddy_get(self->self, core, order);
+}
+
+llfree_result_t bench_alloc_put(const bench_alloc_t *self, size_t core,
+				frame_id_t frame, uint8_t order, bool movable)
+{
+	if (self->kind == BENCH_LLFREE) {
+		return llfree_put(self->self, frame,
+				  llfree_movable_request(self->cores, order,
+							 core, movable));
+	}
+	return buddy_put(self->self, core, frame, order);
+}
+
+ll_stats_t bench_alloc_stats(const bench_alloc_t *self)
+{
+	if (self->kind == BENCH_LLFREE)
+		return llfree_stats(self->self);
+	return buddy_stats(self->self);
+}
+
+double bench_fairness(const uint64_t *ops, size_t threads)
+{
+	double sum = 0;
+	double sum_sq = 0;
+	for (size_t i = 0; i < threads; i++) {
+		sum += (double)ops[i];
+		sum_sq += (double)ops[i] * (double)ops[i];
+	}
+	if (sum_sq == 0)
+		return 1;
+	return (sum * sum) / ((double)threads * sum_sq);
+}
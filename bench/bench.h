@@ -0,0 +1,122 @@
+#pragma once
+
+#include "llfree.h"
+#include "llfree_platform.h"
+
+#include <stdio.h>
+
+/// Parameters shared by all benchmarks, set on the command line
+typedef struct bench_args {
+	/// Maximum number of threads
+	size_t threads;
+	/// Duration of a single measurement in milliseconds
+	size_t duration_ms;
+	/// Number of frames managed by the allocator
+	size_t frames;
+	/// Input file, e.g. a trace to replay (optional)
+	const char *file;
+} bench_args_t;
+
+void add_bench(char *name, void (*f)(const bench_args_t *args));
+
+#define declare_bench(name)                                          \
+	static void _bench_##name(const bench_args_t *args);         \
+	__attribute__((constructor)) static void _init_##name(void) \
+	{                                                            \
+		add_bench(#name, _bench_##name);                     \
+	}                                                            \
+	static void _bench_##name(const bench_args_t *args)
+
+/// Monotonic time in nanoseconds
+uint64_t bench_now_ns(void);
+/// Sleep for the given number of milliseconds
+void bench_sleep_ms(size_t ms);
+/// Number of online cpus
+size_t bench_cpus(void);
+/// Pin the calling thread to the given cpu (modulo the online cpus)
+void bench_pin(size_t cpu);
+
+/// Thread counts to measure: 1, 2, 4, ... up to and including `max`.
+/// Returns the next thread count after `threads` or 0 if `max` was reached.
+size_t bench_next_threads(size_t threads, size_t max);
+
+/// Run `f(tid, ctx)` on `threads` pinned threads that start simultaneously
+void bench_parallel(size_t threads, void (*f)(size_t tid, void *ctx),
+		    void *ctx);
+
+/// Classings that are used by the benchmarks
+typedef enum bench_classing {
+	BENCH_SIMPLE = 0,
+	BENCH_MOVABLE = 1,
+	BENCH_CLASSING_N = 2,
+} bench_classing_t;
+
+static inline ll_unused const char *bench_classing_name(bench_classing_t c)
+{
+	return c == BENCH_SIMPLE ? "simple" : "movable";
+}
+
+static inline ll_unused llfree_classing_t
+bench_classing(bench_classing_t c, size_t cores)
+{
+	if (c == BENCH_SIMPLE)
+		return llfree_classing_simple(cores);
+	return llfree_classing_movable(cores);
+}
+
+/// Build a request for the given classing, small frames of odd cores
+/// are allocated as movable
+static inline ll_unused llfree_request_t
+bench_request(bench_classing_t c, size_t cores, uint8_t order, size_t core)
+{
+	if (c == BENCH_SIMPLE)
+		return llfree_simple_request(cores, order, core);
+	return llfree_movable_request(cores, order, core, core % 2 == 1);
+}
+
+/// Allocate and initialize a new allocator with the given classing
+llfree_t *bench_llfree_new(const llfree_classing_t *classing, size_t frames,
+			   uint8_t init);
+/// Free an allocator and its metadata
+void bench_llfree_drop(llfree_t *self);
+
+/// Allocators that are compared by the benchmarks
+typedef enum bench_alloc_kind {
+	/// LLFree with the movable classing
+	BENCH_LLFREE = 0,
+	/// Buddy allocator with a global lock (see buddy.h)
+	BENCH_BUDDY = 1,
+	/// Buddy allocator with per-cpu lists
+	BENCH_BUDDY_PCP = 2,
+	BENCH_ALLOC_N = 3,
+} bench_alloc_kind_t;
+
+/// An allocator under test
+typedef struct bench_alloc {
+	bench_alloc_kind_t kind;
+	size_t cores;
+	/// llfree_t or buddy_t
+	void *self;
+} bench_alloc_t;
+
+static inline ll_unused const char *bench_alloc_name(bench_alloc_kind_t kind)
+{
+	static const char *const NAMES[] = { "llfree", "buddy", "buddy-pcp" };
+	return kind < BENCH_ALLOC_N ? NAMES[kind] : "invalid";
+}
+
+/// Create an allocator with all `frames` free for `cores` cores
+bench_alloc_t bench_alloc_new(bench_alloc_kind_t kind, size_t cores,
+			      size_t frames);
+void bench_alloc_drop(bench_alloc_t *self);
+/// Allocate a frame of the given order on `core`, movable frames are mapped
+/// to the classes with llfree_movable_request
+llfree_result_t bench_alloc_get(const bench_alloc_t *self, size_t core,
+				uint8_t order, bool movable);
+/// Free a frame with the same order and mobility as it was allocated with
+llfree_result_t bench_alloc_put(const bench_alloc_t *self, size_t core,
+				frame_id_t frame, uint8_t order, bool movable);
+ll_stats_t bench_alloc_stats(const bench_alloc_t *self);
+
+/// Jain's fairness index of the per-thread operation counts (1 = fair)
+double bench_fairness(const uint64_t *ops, size_t threads);
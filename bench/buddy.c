@@ -0,0 +1,448 @@
+#include "buddy.h"
+#include "bench.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/// Marks the end of a free list
+#define BUDDY_NIL UINT32_MAX
+/// State of frames that do not start a free block in the zone
+#define BUDDY_USED UINT8_MAX
+
+/// Number of per-cpu lists: orders 0-3 and huge frames
+#define BUDDY_PCP_LISTS 5
+/// Frames cached in a per-cpu list before a batch is returned to the zone
+#define BUDDY_PCP_HIGH 512u
+/// Frames moved between the zone and a per-cpu list at once
+#define BUDDY_PCP_BATCH 64u
+
+struct __attribute__((aligned(LLFREE_CACHE_SIZE))) buddy_pcp {
+	pthread_mutex_t lock;
+	size_t len[BUDDY_PCP_LISTS];
+	/// Cached blocks (stack)
+	uint32_t *blocks[BUDDY_PCP_LISTS];
+};
+
+struct buddy {
+	size_t frames;
+	size_t cores;
+	/// Per-cpu lists, NULL for the global lock variant
+	struct buddy_pcp *pcp;
+
+	/// Protects the free lists and the frame state
+	pthread_mutex_t lock;
+	uint32_t heads[BUDDY_MAX_ORDER + 1];
+	size_t counts[BUDDY_MAX_ORDER + 1];
+	/// Free list links of the frames that start a free block
+	uint32_t *next;
+	uint32_t *prev;
+	/// Order of the free block starting at the frame or BUDDY_USED
+	uint8_t *state;
+};
+
+static inline int pcp_list(uint8_t order)
+{
+	if (order <= 3)
+		return order;
+	if (order == LLFREE_HUGE_ORDER)
+		return 4;
+	return -1;
+}
+
+static inline uint8_t pcp_order(size_t list)
+{
+	return list < 4 ? (uint8_t)list : LLFREE_HUGE_ORDER;
+}
+
+static inline size_t pcp_high(size_t list)
+{
+	return LL_MAX(BUDDY_PCP_HIGH >> pcp_order(list), 1u);
+}
+
+static inline size_t pcp_batch(size_t list)
+{
+	return LL_MAX(BUDDY_PCP_BATCH >> pcp_order(list), 1u);
+}
+
+static void list_push(buddy_t *self, uint32_t frame, uint8_t order)
+{
+	uint32_t head = self->heads[order];
+	self->next[frame] = head;
+	self->prev[frame] = BUDDY_NIL;
+	if (head != BUDDY_NIL)
+		self->prev[head] = frame;
+	self->heads[order] = frame;
+	self->state[frame] = order;
+	self->counts[order]++;
+}
+
+static void list_remove(buddy_t *self, uint32_t frame, uint8_t order)
+{
+	assert(self->state[frame] == order);
+	uint32_t next = self->next[frame];
+	uint32_t prev = self->prev[frame];
+	if (prev != BUDDY_NIL)
+		self->next[prev] = next;
+	else
+		self->heads[order] = next;
+	if (next != BUDDY_NIL)
+		self->prev[next] = prev;
+	self->state[frame] = BUDDY_USED;
+	self->counts[order]--;
+}
+
+/// Allocate a block from the free lists, splitting larger blocks
+static bool zone_get(buddy_t *self, uint8_t order, uint32_t *frame)
+{
+	uint8_t o = order;
+	while (o <= BUDDY_MAX_ORDER && self->heads[o] == BUDDY_NIL)
+		o++;
+	if (o > BUDDY_MAX_ORDER)
+		return false;
+
+	uint32_t block = self->heads[o];
+	list_remove(self, block, o);
+	while (o > order) {
+		o--;
+		list_push(self, block + (1u << o), o);
+	}
+	*frame = block;
+	return true;
+}
+
+/// Free a block to the free lists, merging it with its free buddies
+static void zone_put(buddy_t *self, uint32_t frame, uint8_t order)
+{
+	while (order < BUDDY_MAX_ORDER) {
+		uint32_t buddy = frame ^ (1u << order);
+		if (buddy >= self->frames || self->state[buddy] != order)
+			break;
+		list_remove(self, buddy, order);
+		frame = LL_MIN(frame, buddy);
+		order++;
+	}
+	list_push(self, frame, order);
+}
+
+/// Return the cached blocks of all cores to the zone
+static void pcp_drain_all(buddy_t *self)
+{
+	for (size_t c = 0; c < self->cores; c++) {
+		struct buddy_pcp *pcp = &self->pcp[c];
+		pthread_mutex_lock(&pcp->lock);
+		pthread_mutex_lock(&self->lock);
+		for (size_t l = 0; l < BUDDY_PCP_LISTS; l++) {
+			for (size_t i = 0; i < pcp->len[l]; i++)
+				zone_put(self, pcp->blocks[l][i], pcp_order(l));
+			pcp->len[l] = 0;
+		}
+		pthread_mutex_unlock(&self->lock);
+		pthread_mutex_unlock(&pcp->lock);
+	}
+}
+
+static bool pcp_get(buddy_t *self, size_t core, size_t list, uint32_t *frame)
+{
+	struct buddy_pcp *pcp = &self->pcp[core % self->cores];
+	uint8_t order = pcp_order(list);
+	pthread_mutex_lock(&pcp->lock);
+	if (pcp->len[list] == 0) {
+		// Refill a batch from the zone
+		pthread_mutex_lock(&self->lock);
+		size_t batch = pcp_batch(list);
+		while (pcp->len[list] < batch &&
+		       zone_get(self, order,
+				&pcp->blocks[list][pcp->len[list]]))
+			pcp->len[list]++;
+		pthread_mutex_unlock(&self->lock);
+	}
+	bool ok = pcp->len[list] > 0;
+	if (ok)
+		*frame = pcp->blocks[list][--pcp->len[list]];
+	pthread_mutex_unlock(&pcp->lock);
+	return ok;
+}
+
+static void pcp_put(buddy_t *self, size_t core, size_t list, uint32_t frame)
+{
+	struct buddy_pcp *pcp = &self->pcp[core % self->cores];
+	pthread_mutex_lock(&pcp->lock);
+	pcp->blocks[list][pcp->len[list]++] = frame;
+	if (pcp->len[list] > pcp_high(list)) {
+		// Return a batch of the least recently freed blocks
+		size_t batch = pcp_batch(list);
+		pthread_mutex_lock(&self->lock);
+		for (size_t i = 0; i < batch; i++)
+			zone_put(self, pcp->blocks[list][i], pcp_order(list));
+		pthread_mutex_unlock(&self->lock);
+		pcp->len[list] -= batch;
+		for (size_t i = 0; i < pcp->len[list]; i++)
+			pcp->blocks[list][i] = pcp->blocks[list][i + batch];
+	}
+	pthread_mutex_unlock(&pcp->lock);
+}
+
+buddy_t *buddy_new(size_t frames, size_t cores, bool percpu)
+{
+	assert(frames > 0 && frames < BUDDY_NIL && cores > 0);
+	buddy_t *self = malloc(sizeof(buddy_t));
+	assert(self != NULL);
+	*self = (buddy_t){
+		.frames = frames,
+		.cores = cores,
+		.next = malloc(sizeof(uint32_t) * frames),
+		.prev = malloc(sizeof(uint32_t) * frames),
+		.state = malloc(frames),
+	};
+	assert(self->next != NULL && self->prev != NULL &&
+	       self->state != NULL);
+	pthread_mutex_init(&self->lock, NULL);
+	for (size_t o = 0; o <= BUDDY_MAX_ORDER; o++)
+		self->heads[o] = BUDDY_NIL;
+	for (size_t i = 0; i < frames; i++)
+		self->state[i] = BUDDY_USED;
+
+	// Insert the largest aligned blocks that fit
+	for (size_t frame = 0; frame < frames;) {
+		uint8_t order = BUDDY_MAX_ORDER;
+		while (frame % (1ul << order) != 0 ||
+		       frame + (1ul << order) > frames)
+			order--;
+		list_push(self, (uint32_t)frame, order);
+		frame += 1ul << order;
+	}
+
+	if (percpu) {
+		self->pcp = aligned_alloc(LLFREE_CACHE_SIZE,
+					  sizeof(struct buddy_pcp) * cores);
+		assert(self->pcp != NULL);
+		for (size_t c = 0; c < cores; c++) {
+			struct buddy_pcp *pcp = &self->pcp[c];
+			pthread_mutex_init(&pcp->lock, NULL);
+			for (size_t l = 0; l < BUDDY_PCP_LISTS; l++) {
+				pcp->len[l] = 0;
+				pcp->blocks[l] = malloc(sizeof(uint32_t) *
+							(pcp_high(l) + 1));
+				assert(pcp->blocks[l] != NULL);
+			}
+		}
+	}
+	return self;
+}
+
+void buddy_drop(buddy_t *self)
+{
+	if (self->pcp != NULL) {
+		for (size_t c = 0; c < self->cores; c++) {
+			for (size_t l = 0; l < BUDDY_PCP_LISTS; l++)
+				free(self->pcp[c].blocks[l]);
+			pthread_mutex_destroy(&self->pcp[c].lock);
+		}
+		free(self->pcp);
+	}
+	pthread_mutex_destroy(&self->lock);
+	free(self->next);
+	free(self->prev);
+	free(self->state);
+	free(self);
+}
+
+llfree_result_t buddy_get(buddy_t *self, size_t core, uint8_t order)
+{
+	if (order > BUDDY_MAX_ORDER)
+		return llfree_err(LLFREE_ERR_MEMORY);
+
+	uint32_t frame;
+	int list = pcp_list(order);
+	if (self->pcp != NULL && list >= 0) {
+		if (pcp_get(self, core, (size_t)list, &frame))
+			return llfree_ok(frame_id(frame), 0);
+	}
+
+	pthread_mutex_lock(&self->lock);
+	bool ok = zone_get(self, order, &frame);
+	pthread_mutex_unlock(&self->lock);
+
+	if (!ok && self->pcp != NULL) {
+		// Retry after returning all cached blocks, like Linux does
+		// before reclaim
+		pcp_drain_all(self);
+		pthread_mutex_lock(&self->lock);
+		ok = zone_get(self, order, &frame);
+		pthread_mutex_unlock(&self->lock);
+	}
+	if (!ok)
+		return llfree_err(LLFREE_ERR_MEMORY);
+	return llfree_ok(frame_id(frame), 0);
+}
+
+llfree_result_t buddy_put(buddy_t *self, size_t core, frame_id_t frame,
+			  uint8_t order)
+{
+	if (order > BUDDY_MAX_ORDER || frame.value >= self->frames ||
+	    frame.value % (1ul << order) != 0)
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+
+	int list = pcp_list(order);
+	if (self->pcp != NULL && list >= 0) {
+		pcp_put(self, core, (size_t)list, (uint32_t)frame.value);
+		return llfree_ok(frame_id(0), 0);
+	}
+
+	pthread_mutex_lock(&self->lock);
+	bool used = self->state[frame.value] == BUDDY_USED;
+	if (used)
+		zone_put(self, (uint32_t)frame.value, order);
+	pthread_mutex_unlock(&self->lock);
+	if (!used)
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+	return llfree_ok(frame_id(0), 0);
+}
+
+ll_stats_t buddy_stats(buddy_t *self)
+{
+	ll_stats_t stats = { 0 };
+	pthread_mutex_lock(&self->lock);
+	for (size_t o = 0; o <= BUDDY_MAX_ORDER; o++) {
+		stats.free_frames += self->counts[o] << o;
+		if (o >= LLFREE_HUGE_ORDER)
+			stats.free_huge += self->counts[o]
+					   << (o - LLFREE_HUGE_ORDER);
+		if (o >= LLFREE_TREE_ORDER)
+			stats.free_trees += self->counts[o]
+					    << (o - LLFREE_TREE_ORDER);
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	for (size_t c = 0; self->pcp != NULL && c < self->cores; c++) {
+		struct buddy_pcp *pcp = &self->pcp[c];
+		pthread_mutex_lock(&pcp->lock);
+		for (size_t l = 0; l < BUDDY_PCP_LISTS; l++) {
+			stats.free_frames += pcp->len[l] << pcp_order(l);
+			if (pcp_order(l) == LLFREE_HUGE_ORDER)
+				stats.free_huge += pcp->len[l];
+		}
+		pthread_mutex_unlock(&pcp->lock);
+	}
+	return stats;
+}
+
+/// Maximum number of frames a thread holds before freeing them again
+#define BASELINE_BATCH 32
+
+struct baseline {
+	const bench_alloc_t *alloc;
+	uint8_t order;
+	size_t batch;
+	uint64_t duration_ns;
+	/// Per-thread results
+	uint64_t *ops;
+	uint64_t *failed;
+	uint64_t *elapsed_ns;
+};
+
+static void baseline_run(size_t tid, void *ctx)
+{
+	struct baseline *b = ctx;
+	bool movable = tid % 2 == 1;
+	frame_id_t frames[BASELINE_BATCH];
+
+	uint64_t ops = 0;
+	uint64_t failed = 0;
+	uint64_t start = bench_now_ns();
+	uint64_t now = start;
+	while (now - start < b->duration_ns) {
+		size_t n = 0;
+		for (; n < b->batch; n++) {
+			llfree_result_t res = bench_alloc_get(b->alloc, tid,
+							      b->order, movable);
+			if (!llfree_is_ok(res)) {
+				failed++;
+				break;
+			}
+			frames[n] = res.frame;
+		}
+		for (size_t i = 0; i < n; i++) {
+			llfree_result_t ll_unused res = bench_alloc_put(
+				b->alloc, tid, frames[i], b->order, movable);
+			assert(llfree_is_ok(res));
+		}
+		ops += 2 * n;
+		now = bench_now_ns();
+	}
+	b->ops[tid] = ops;
+	b->failed[tid] = failed;
+	b->elapsed_ns[tid] = now - start;
+}
+
+/// Allocate and free batches of frames on 1..N threads with llfree and the
+/// buddy baselines and report the throughput and the speedup over the
+/// buddy allocator with a global lock
+declare_bench(baseline)
+{
+	static const uint8_t ORDERS[] = { 0, 3, LLFREE_HUGE_ORDER };
+
+	uint64_t *ops = malloc(sizeof(uint64_t) * args->threads);
+	uint64_t *failed = malloc(sizeof(uint64_t) * args->threads);
+	uint64_t *elapsed = malloc(sizeof(uint64_t) * args->threads);
+	assert(ops != NULL && failed != NULL && elapsed != NULL);
+
+	printf("%5s %7s %-10s %14s %8s %10s %8s\n", "order", "threads",
+	       "alloc", "ops/s", "jain", "failed", "speedup");
+
+	for (size_t o = 0; o < sizeof(ORDERS) / sizeof(*ORDERS); o++) {
+		uint8_t order = ORDERS[o];
+		if ((1ul << order) > args->frames)
+			continue;
+
+		for (size_t t = 1; t != 0;
+		     t = bench_next_threads(t, args->threads)) {
+			double buddy = 0;
+			// Start with the global buddy allocator as reference
+			for (size_t a = 1; a <= BENCH_ALLOC_N; a++) {
+				bench_alloc_kind_t kind =
+					(bench_alloc_kind_t)(a % BENCH_ALLOC_N);
+				bench_alloc_t alloc =
+					bench_alloc_new(kind, t, args->frames);
+				size_t batch = args->frames /
+					       (t * (1ul << order) * 2);
+				struct baseline b = {
+					.alloc = &alloc,
+					.order = order,
+					.batch = LL_MAX(LL_MIN(batch,
+							       BASELINE_BATCH),
+							1),
+					.duration_ns = args->duration_ms *
+						       1000000ull,
+					.ops = ops,
+					.failed = failed,
+					.elapsed_ns = elapsed,
+				};
+				bench_parallel(t, baseline_run, &b);
+
+				uint64_t total = 0, fails = 0, time = 0;
+				for (size_t i = 0; i < t; i++) {
+					total += ops[i];
+					fails += failed[i];
+					time = LL_MAX(time, elapsed[i]);
+				}
+				double throughput =
+					(double)total * 1e9 / (double)time;
+				if (kind == BENCH_BUDDY)
+					buddy = throughput;
+
+				printf("%5u %7zu %-10s %14.0f %8.3f %10" PRIu64
+				       " %8.3f\n",
+				       order, t, bench_alloc_name(kind),
+				       throughput, bench_fairness(ops, t), fails,
+				       buddy > 0 ? throughput / buddy : 0.0);
+
+				bench_alloc_drop(&alloc);
+			}
+		}
+	}
+	free(ops);
+	free(failed);
+	free(elapsed);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "llfree.h"
+
+/// Reference buddy allocator, used as baseline by the benchmarks.
+///
+/// Free blocks of each order are kept in doubly linked lists, freed blocks
+/// are merged with their buddies. All lists are protected by a single
+/// (zone) lock. The per-cpu variant additionally caches blocks of order 0-3
+/// and huge frames in per-cpu lists that are refilled and drained in
+/// batches, similar to the per-cpu pages of Linux.
+typedef struct buddy buddy_t;
+
+/// Largest order of a free block
+#define BUDDY_MAX_ORDER LLFREE_MAX_ORDER
+
+/// Create a buddy allocator for `frames` free frames and `cores` cores,
+/// with per-cpu lists if `percpu` is set
+buddy_t *buddy_new(size_t frames, size_t cores, bool percpu);
+void buddy_drop(buddy_t *self);
+
+/// Allocate a naturally aligned block of 2^order frames
+llfree_result_t buddy_get(buddy_t *self, size_t core, uint8_t order);
+/// Free a block that was allocated with the same order
+llfree_result_t buddy_put(buddy_t *self, size_t core, frame_id_t frame,
+			  uint8_t order);
+
+/// Free frames, including the ones in the per-cpu lists
+ll_stats_t buddy_stats(buddy_t *self);
@@ -0,0 +1,141 @@
+#include "bench.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/// Number of reported trees
+#define CONTENTION_TOP 8
+/// Width of the heatmap in characters
+#define CONTENTION_WIDTH 64
+/// Frames held per thread before freeing them again
+#define CONTENTION_BATCH 32
+
+/// Measured scenarios
+static const struct contention_scenario {
+	uint8_t order;
+	/// Use global requests without a local index
+	bool global;
+} SCENARIOS[] = {
+	{ 0, false },
+	{ 0, true },
+	// Claims of multiple children
+	{ LLFREE_HUGE_ORDER + 1, false },
+	{ LLFREE_TREE_ORDER, false },
+};
+
+struct contention {
+	llfree_t *llfree;
+	const struct contention_scenario *scenario;
+	size_t cores;
+	uint64_t duration_ns;
+	/// Successful allocations of all threads
+	_Atomic(uint64_t) gets;
+};
+
+static void contention_run(size_t tid, void *ctx)
+{
+	struct contention *c = ctx;
+	llfree_request_t req =
+		llfree_simple_request(c->cores, c->scenario->order, tid);
+	if (c->scenario->global)
+		req.local = ll_none();
+	frame_id_t frames[CONTENTION_BATCH];
+	uint64_t gets = 0;
+
+	uint64_t start = bench_now_ns();
+	while (bench_now_ns() - start < c->duration_ns) {
+		size_t n = 0;
+		for (; n < CONTENTION_BATCH; n++) {
+			llfree_result_t res =
+				llfree_get(c->llfree, frame_id_none(), req);
+			if (!llfree_is_ok(res))
+				break;
+			frames[n] = res.frame;
+		}
+		for (size_t i = 0; i < n; i++) {
+			llfree_result_t ll_unused res =
+				llfree_put(c->llfree, frames[i], req);
+			assert(llfree_is_ok(res));
+		}
+		gets += n;
+	}
+	atomic_fetch_add(&c->gets, gets);
+}
+
+/// Print the failed CAS attempts of all trees, aggregated into a single line
+static void contention_heatmap(const llfree_tree_contention_t *all, size_t n,
+			       size_t trees)
+{
+	static const char SHADES[] = " .:-=+*#%@";
+	uint64_t buckets[CONTENTION_WIDTH] = { 0 };
+	size_t width = LL_MIN((size_t)CONTENTION_WIDTH, trees);
+	uint64_t max = 0;
+	for (size_t i = 0; i < n; i++) {
+		size_t b = all[i].tree.value * width / trees;
+		buckets[b] += all[i].tree_cas + all[i].child_cas;
+		max = LL_MAX(max, buckets[b]);
+	}
+	printf("heat |");
+	for (size_t b = 0; b < width; b++) {
+		size_t shade = max == 0 ? 0 :
+					  (size_t)(buckets[b] *
+						   (sizeof(SHADES) - 2) / max);
+		putchar(SHADES[shade]);
+	}
+	printf("| trees 0..%zu\n", trees - 1);
+}
+
+/// Small allocations on all threads, with local reservations and with
+/// global requests, and huge allocations that claim multiple children,
+/// reporting the trees with the most failed CAS attempts.
+declare_bench(contention)
+{
+	if (!LLFREE_ENABLE_CONTENTION) {
+		printf("skipped: build with LLFREE_ENABLE_CONTENTION=1\n");
+		return;
+	}
+
+	size_t trees = div_ceil(args->frames, LLFREE_TREE_SIZE);
+	llfree_tree_contention_t *all =
+		malloc(sizeof(llfree_tree_contention_t) * trees);
+	assert(all != NULL);
+
+	for (size_t sc = 0; sc < sizeof(SCENARIOS) / sizeof(*SCENARIOS);
+	     sc++) {
+		const struct contention_scenario *s = &SCENARIOS[sc];
+		llfree_classing_t classing =
+			llfree_classing_simple(args->threads);
+		struct contention c = {
+			.llfree = bench_llfree_new(&classing, args->frames,
+						   LLFREE_INIT_FREE),
+			.scenario = s,
+			.cores = args->threads,
+			.duration_ns = args->duration_ms * 1000000ull,
+		};
+		bench_parallel(args->threads, contention_run, &c);
+
+		size_t n = llfree_contention(c.llfree, all, trees);
+		uint64_t tree_cas = 0;
+		uint64_t child_cas = 0;
+		for (size_t i = 0; i < n; i++) {
+			tree_cas += all[i].tree_cas;
+			child_cas += all[i].child_cas;
+		}
+
+		printf("# %s order=%u threads=%zu trees=%zu contended=%zu "
+		       "gets=%" PRIu64 " tree_cas=%" PRIu64
+		       " child_cas=%" PRIu64 "\n",
+		       s->global ? "global" : "local", s->order, args->threads,
+		       trees, n, atomic_load(&c.gets), tree_cas, child_cas);
+		printf("%8s %12s %12s\n", "tree", "tree_cas", "child_cas");
+		for (size_t i = 0; i < LL_MIN(n, (size_t)CONTENTION_TOP); i++) {
+			printf("%8zu %12" PRIu64 " %12" PRIu64 "\n",
+			       all[i].tree.value, all[i].tree_cas,
+			       all[i].child_cas);
+		}
+		contention_heatmap(all, n, trees);
+
+		bench_llfree_drop(c.llfree);
+	}
+	free(all);
+}
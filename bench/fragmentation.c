@@ -0,0 +1,315 @@
+#include "bench.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/// Number of samples taken over the duration of a run
+#define FRAG_SAMPLES 20
+/// Fraction of the memory (in percent) the threads keep allocated
+#define FRAG_FILL 85
+
+/// Kinds of allocations with different orders and lifetimes
+typedef enum frag_kind {
+	/// Long-lived, immovable kernel allocations of order 0-3
+	FRAG_KERNEL = 0,
+	/// Short-lived, movable user allocations of order 0
+	FRAG_USER = 1,
+	/// Medium-lived, movable huge allocations (THP)
+	FRAG_HUGE = 2,
+} frag_kind_t;
+
+/// Best-fit variant of the movable policy that prefers the fullest trees
+/// of the same class, keeping the emptier ones available for huge frames
+static llfree_policy_t frag_bestfit_policy(uint8_t requested, uint8_t target,
+					   size_t free)
+{
+	if (requested > target)
+		return (llfree_policy_t){ LLFREE_POLICY_STEAL, 0 };
+	if (requested < target)
+		return (llfree_policy_t){ LLFREE_POLICY_DEMOTE, 0 };
+	// UINT8_MAX is reserved for immediate matches
+	size_t prio = (UINT8_MAX - 1) -
+		      (LL_MIN(free, LLFREE_TREE_SIZE) * (UINT8_MAX - 1) /
+		       LLFREE_TREE_SIZE);
+	return (llfree_policy_t){ LLFREE_POLICY_MATCH, (uint8_t)prio };
+}
+
+static llfree_classing_t frag_classing_bestfit(size_t cores)
+{
+	llfree_classing_t classing = llfree_classing_movable(cores);
+	classing.policy = frag_bestfit_policy;
+	return classing;
+}
+
+/// Policies that are compared
+static const struct frag_policy {
+	const char *name;
+	llfree_classing_t (*classing)(size_t cores);
+	/// Uses the movable request mapping
+	bool movable;
+} POLICIES[] = {
+	{ "simple", llfree_classing_simple, false },
+	{ "movable", llfree_classing_movable, true },
+	{ "bestfit", frag_classing_bestfit, true },
+};
+
+struct frag_sample {
+	uint64_t time_ms;
+	ll_stats_t stats;
+	ll_tree_stats_t trees;
+	uint64_t huge_tries;
+	uint64_t huge_hits;
+	uint64_t failed;
+};
+
+struct frag {
+	llfree_t *llfree;
+	const struct frag_policy *policy;
+	size_t cores;
+	/// Frames each thread keeps allocated
+	size_t budget;
+	uint64_t duration_ns;
+	/// Huge allocation attempts and successes, failed small allocations
+	_Atomic(uint64_t) huge_tries;
+	_Atomic(uint64_t) huge_hits;
+	_Atomic(uint64_t) failed;
+	struct frag_sample samples[FRAG_SAMPLES + 1];
+	size_t sample_count;
+};
+
+struct frag_alloc {
+	frame_id_t frame;
+	uint64_t expires;
+	uint8_t order;
+	uint8_t kind;
+};
+
+static uint64_t frag_rand(uint64_t *rng)
+{
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 7;
+	*rng ^= *rng << 17;
+	return *rng;
+}
+
+static llfree_request_t frag_request(const struct frag *f, uint8_t order,
+				     frag_kind_t kind, size_t tid)
+{
+	if (f->policy->movable) {
+		return llfree_movable_request(f->cores, order, tid,
+					      kind != FRAG_KERNEL);
+	}
+	return llfree_simple_request(f->cores, order, tid);
+}
+
+static void frag_sample(struct frag *f, uint64_t start)
+{
+	assert(f->sample_count <= FRAG_SAMPLES);
+	struct frag_sample *s = &f->samples[f->sample_count++];
+	s->time_ms = (bench_now_ns() - start) / 1000000ull;
+	s->stats = llfree_stats(f->llfree);
+	s->trees = llfree_tree_stats(f->llfree);
+	s->huge_tries = atomic_load(&f->huge_tries);
+	s->huge_hits = atomic_load(&f->huge_hits);
+	s->failed = atomic_load(&f->failed);
+}
+
+/// Worker: keeps up to `budget` frames allocated, replacing random
+/// allocations once they expired or the budget is exhausted
+static void frag_worker(size_t tid, struct frag *f)
+{
+	size_t capacity = f->budget;
+	struct frag_alloc *held = malloc(sizeof(struct frag_alloc) * capacity);
+	assert(held != NULL);
+	size_t count = 0;
+	size_t held_frames = 0;
+	uint64_t rng = 0x9e3779b97f4a7c15ull * (tid + 1);
+
+	uint64_t start = bench_now_ns();
+	for (uint64_t tick = 0;; tick++) {
+		if (tick % 64 == 0 && bench_now_ns() - start >= f->duration_ns)
+			break;
+
+		// Free a random allocation if it expired or we are at the limit
+		if (count > 0) {
+			size_t i = frag_rand(&rng) % count;
+			if (held[i].expires <= tick ||
+			    held_frames >= f->budget) {
+				llfree_result_t ll_unused res = llfree_put(
+					f->llfree, held[i].frame,
+					frag_request(f, held[i].order,
+						     held[i].kind, tid));
+				assert(llfree_is_ok(res));
+				held_frames -= 1u << held[i].order;
+				held[i] = held[--count];
+			}
+		}
+
+		// Allocate: mostly short-lived user frames, huge frames make
+		// up about a third of the memory
+		uint64_t r = frag_rand(&rng);
+		frag_kind_t kind = r % 1000 < 200 ? FRAG_KERNEL :
+				   r % 1000 < 999 ? FRAG_USER :
+						    FRAG_HUGE;
+		uint8_t order = 0;
+		uint64_t lifetime = 0;
+		switch (kind) {
+		case FRAG_KERNEL:
+			order = (r >> 8) % 4 == 0 ? (uint8_t)((r >> 10) % 4) :
+						    0;
+			lifetime = 1ull << 20;
+			break;
+		case FRAG_USER:
+			lifetime = 1ull << 12;
+			break;
+		case FRAG_HUGE:
+			order = LLFREE_HUGE_ORDER;
+			lifetime = 1ull << 16;
+			break;
+		}
+		if (held_frames >= f->budget || count >= capacity)
+			continue;
+
+		llfree_result_t res =
+			llfree_get(f->llfree, frame_id_none(),
+				   frag_request(f, order, kind, tid));
+		if (kind == FRAG_HUGE) {
+			atomic_fetch_add_explicit(&f->huge_tries, 1,
+						  memory_order_relaxed);
+		}
+		if (!llfree_is_ok(res)) {
+			if (kind != FRAG_HUGE) {
+				atomic_fetch_add_explicit(
+					&f->failed, 1, memory_order_relaxed);
+			}
+			continue;
+		}
+		if (kind == FRAG_HUGE) {
+			atomic_fetch_add_explicit(&f->huge_hits, 1,
+						  memory_order_relaxed);
+		}
+		held[count++] = (struct frag_alloc){
+			.frame = res.frame,
+			.expires = tick + (frag_rand(&rng) % (2 * lifetime)),
+			.order = order,
+			.kind = (uint8_t)kind,
+		};
+		held_frames += 1u << order;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		llfree_result_t ll_unused res =
+			llfree_put(f->llfree, held[i].frame,
+				   frag_request(f, held[i].order, held[i].kind,
+						tid));
+		assert(llfree_is_ok(res));
+	}
+	free(held);
+}
+
+static void frag_run(size_t tid, void *ctx)
+{
+	struct frag *f = ctx;
+	if (tid < f->cores) {
+		frag_worker(tid, f);
+		return;
+	}
+
+	// The last thread samples the stats while the workers are running
+	uint64_t start = bench_now_ns();
+	size_t interval = LL_MAX(f->duration_ns / 1000000ull /
+					 (FRAG_SAMPLES + 1),
+				 (uint64_t)1);
+	frag_sample(f, start);
+	for (size_t i = 0; i < FRAG_SAMPLES; i++) {
+		bench_sleep_ms(interval);
+		if (bench_now_ns() - start >= f->duration_ns)
+			break;
+		frag_sample(f, start);
+	}
+}
+
+/// Percentage of `part` in `total`
+static double frag_percent(uint64_t part, uint64_t total)
+{
+	return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+static void frag_print(const struct frag *f, size_t classes)
+{
+	printf("%8s %10s %9s %10s %7s %7s %8s", "t[ms]", "free", "free_huge",
+	       "free_trees", "huge%", "thp%", "failed");
+	for (size_t c = 0; c < classes; c++)
+		printf("  c%zu_free c%zu_alloc", c, c);
+	printf("\n");
+
+	double huge_sum = 0;
+	double huge_min = 100;
+	for (size_t i = 0; i < f->sample_count; i++) {
+		const struct frag_sample *s = &f->samples[i];
+		const struct frag_sample *p = i > 0 ? &f->samples[i - 1] : s;
+		// Fraction of the free memory that is available as huge frames
+		double huge = frag_percent(s->stats.free_huge
+						   << LLFREE_HUGE_ORDER,
+					   s->stats.free_frames);
+		// Huge allocation hit rate since the last sample
+		double thp = s->huge_tries == p->huge_tries ?
+				     100.0 :
+				     frag_percent(s->huge_hits - p->huge_hits,
+						  s->huge_tries - p->huge_tries);
+		printf("%8" PRIu64 " %10zu %9zu %10zu %7.2f %7.2f %8" PRIu64,
+		       s->time_ms, s->stats.free_frames, s->stats.free_huge,
+		       s->stats.free_trees, huge, thp, s->failed - p->failed);
+		for (size_t c = 0; c < classes; c++) {
+			printf(" %8zu %9zu", s->trees.classes[c].free_frames,
+			       s->trees.classes[c].alloc_frames);
+		}
+		printf("\n");
+		if (i > 0) {
+			huge_sum += huge;
+			huge_min = LL_MIN(huge_min, huge);
+		}
+	}
+
+	const struct frag_sample *last = &f->samples[f->sample_count - 1];
+	size_t n = LL_MAX(f->sample_count - 1, (size_t)1);
+	printf("# %s: huge%% avg=%.2f min=%.2f, thp hit rate=%.2f%% (%" PRIu64
+	       "/%" PRIu64 "), failed=%" PRIu64 "\n",
+	       f->policy->name, huge_sum / (double)n, huge_min,
+	       frag_percent(last->huge_hits, last->huge_tries), last->huge_hits,
+	       last->huge_tries, last->failed);
+}
+
+/// Long-running mixed-order, mixed-lifetime workload that samples the
+/// availability of huge frames over time for different policies.
+/// Use a long duration (e.g. `-d 300000`) to observe aging effects.
+declare_bench(fragmentation)
+{
+	struct frag *f = malloc(sizeof(struct frag));
+	assert(f != NULL);
+
+	for (size_t p = 0; p < sizeof(POLICIES) / sizeof(*POLICIES); p++) {
+		llfree_classing_t classing = POLICIES[p].classing(args->threads);
+		llfree_t *llfree = bench_llfree_new(&classing, args->frames,
+						    LLFREE_INIT_FREE);
+
+		*f = (struct frag){
+			.llfree = llfree,
+			.policy = &POLICIES[p],
+			.cores = args->threads,
+			.budget = args->frames * FRAG_FILL / 100 /
+				  args->threads,
+			.duration_ns = args->duration_ms * 1000000ull,
+		};
+		// One additional thread for sampling
+		bench_parallel(args->threads + 1, frag_run, f);
+
+		printf("# %s frames=%zu threads=%zu fill=%u%%\n",
+		       POLICIES[p].name, args->frames, args->threads,
+		       FRAG_FILL);
+		frag_print(f, classing.num_classes);
+
+		bench_llfree_drop(llfree);
+	}
+	free(f);
+}
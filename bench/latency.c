@@ -0,0 +1,154 @@
+#include "bench.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/// Frames held per thread during the churn phase
+#define LATENCY_HELD 256
+
+static const char *PATH_NAMES[LLFREE_PATH_MAX] = {
+	"local", "reserve", "global", "steal", "demote", "failed",
+};
+
+struct latency {
+	llfree_t *llfree;
+	bench_classing_t classing;
+	size_t cores;
+	uint64_t duration_ns;
+};
+
+static void latency_run(size_t tid, void *ctx)
+{
+	struct latency *l = ctx;
+	struct {
+		frame_id_t frame;
+		uint8_t order;
+	} held[LATENCY_HELD] = { 0 };
+	uint64_t rng = 0x9e3779b97f4a7c15ull * (tid + 1);
+
+	uint64_t start = bench_now_ns();
+	for (size_t i = 0; bench_now_ns() - start < l->duration_ns; i++) {
+		size_t slot = i % LATENCY_HELD;
+		if (i >= LATENCY_HELD && held[slot].order != UINT8_MAX) {
+			llfree_result_t ll_unused res = llfree_put(
+				l->llfree, held[slot].frame,
+				bench_request(l->classing, l->cores,
+					      held[slot].order, tid));
+			assert(llfree_is_ok(res));
+		}
+		// xorshift: mostly order 0, some order 3 and 9
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		uint8_t order = rng % 64 == 0 ? LLFREE_HUGE_ORDER :
+				rng % 8 == 0  ? 3 :
+						0;
+		llfree_result_t res =
+			llfree_get(l->llfree, frame_id_none(),
+				   bench_request(l->classing, l->cores, order,
+						 tid));
+		held[slot].frame = res.frame;
+		held[slot].order = llfree_is_ok(res) ? order : UINT8_MAX;
+	}
+	for (size_t i = 0; i < LATENCY_HELD; i++) {
+		if (held[i].order == UINT8_MAX)
+			continue;
+		llfree_result_t ll_unused res =
+			llfree_put(l->llfree, held[i].frame,
+				   bench_request(l->classing, l->cores,
+						 held[i].order, tid));
+	}
+}
+
+static void latency_counters(void)
+{
+	llfree_counters_t c = llfree_counters();
+	printf("# counters: cas_retries=%" PRIu64 " search_visits=%" PRIu64
+	       " sync_global=%" PRIu64 " swap_reserved=%" PRIu64
+	       " steal_local=%" PRIu64 " demote_local=%" PRIu64
+	       " split_huge_waits=%" PRIu64 " huge_rollbacks=%" PRIu64
+	       " field_rollbacks=%" PRIu64 "\n",
+	       c.cas_retries, c.search_visits, c.sync_global, c.swap_reserved,
+	       c.steal_local, c.demote_local, c.split_huge_waits,
+	       c.huge_rollbacks, c.field_rollbacks);
+}
+
+static void latency_print(const char *op, const char *kind, const char *name,
+			  const llfree_hist_t *hist)
+{
+	uint64_t count = llfree_hist_count(hist);
+	if (count == 0)
+		return;
+	printf("%-4s %-6s %-8s %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+	       " %10" PRIu64 " %10" PRIu64 "\n",
+	       op, kind, name, count, llfree_hist_quantile(hist, 500),
+	       llfree_hist_quantile(hist, 990), llfree_hist_quantile(hist, 999),
+	       llfree_hist_quantile(hist, 1000));
+}
+
+/// Mixed-order churn on a small memory that forces the slow paths,
+/// reporting the latency histograms by path and order and the event counters.
+declare_bench(latency)
+{
+	if (!LLFREE_ENABLE_HISTOGRAMS && !LLFREE_ENABLE_COUNTERS) {
+		printf("skipped: build with LLFREE_ENABLE_HISTOGRAMS=1 or "
+		       "LLFREE_ENABLE_COUNTERS=1\n");
+		return;
+	}
+
+	llfree_histograms_t *hists = malloc(sizeof(llfree_histograms_t));
+	assert(hists != NULL);
+
+	// Small enough that the threads compete for the trees
+	size_t frames = LL_MAX(args->threads * LATENCY_HELD * 16,
+			       (size_t)4 * LLFREE_TREE_SIZE);
+	frames = LL_MIN(frames, args->frames);
+
+	for (size_t c = 0; c < BENCH_CLASSING_N; c++) {
+		llfree_classing_t classing =
+			bench_classing((bench_classing_t)c, args->threads);
+		llfree_t *llfree =
+			bench_llfree_new(&classing, frames, LLFREE_INIT_FREE);
+
+		struct latency l = {
+			.llfree = llfree,
+			.classing = (bench_classing_t)c,
+			.cores = args->threads,
+			.duration_ns = args->duration_ms * 1000000ull,
+		};
+		llfree_histograms_reset();
+		llfree_counters_reset();
+		bench_parallel(args->threads, latency_run, &l);
+		llfree_histograms(hists, ll_none());
+
+		printf("# %s frames=%zu threads=%zu\n",
+		       bench_classing_name((bench_classing_t)c), frames,
+		       args->threads);
+		if (LLFREE_ENABLE_HISTOGRAMS) {
+			printf("%-4s %-6s %-8s %10s %10s %10s %10s %10s\n",
+			       "op", "kind", "name", "count", "p50[ns]",
+			       "p99[ns]", "p99.9[ns]", "max[ns]");
+		}
+		for (size_t p = 0; p < LLFREE_PATH_MAX; p++) {
+			latency_print("get", "path", PATH_NAMES[p],
+				      &hists->get_path[p]);
+		}
+		for (size_t p = 0; p < LLFREE_PATH_MAX; p++) {
+			latency_print("put", "path", PATH_NAMES[p],
+				      &hists->put_path[p]);
+		}
+		for (size_t o = 0; o <= LLFREE_MAX_ORDER; o++) {
+			char name[8];
+			snprintf(name, sizeof(name), "%zu", o);
+			latency_print("get", "order", name,
+				      &hists->get_order[o]);
+			latency_print("put", "order", name,
+				      &hists->put_order[o]);
+		}
+		if (LLFREE_ENABLE_COUNTERS)
+			latency_counters();
+
+		bench_llfree_drop(llfree);
+	}
+	free(hists);
+}
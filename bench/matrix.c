@@ -0,0 +1,256 @@
+#include "bench.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/// Maximum number of frames a thread holds in the churn workloads
+#define MATRIX_BATCH 32
+/// Fraction of the memory (in percent) the threads keep allocated in the
+/// mixed workload
+#define MATRIX_FILL 85
+
+/// Workloads that are run for every build configuration
+typedef enum matrix_workload {
+	/// Batches of order 0 allocations and frees
+	MATRIX_SMALL = 0,
+	/// Batches of huge allocations and frees
+	MATRIX_HUGE = 1,
+	/// Random orders 0-3 and huge frames with random lifetimes
+	MATRIX_MIXED = 2,
+	MATRIX_WORKLOAD_N = 3,
+} matrix_workload_t;
+
+static const char *const WORKLOADS[] = { "small", "huge", "mixed" };
+
+struct matrix_alloc {
+	frame_id_t frame;
+	uint8_t order;
+	bool movable;
+};
+
+struct matrix {
+	llfree_t *llfree;
+	matrix_workload_t workload;
+	size_t cores;
+	/// Frames each thread keeps allocated (mixed)
+	size_t budget;
+	uint64_t duration_ns;
+	/// Per-thread results
+	uint64_t *ops;
+	uint64_t *failed;
+	uint64_t *elapsed_ns;
+	/// Per-thread allocations that are left in place (mixed)
+	struct matrix_alloc **held;
+	size_t *held_count;
+};
+
+static uint64_t matrix_rand(uint64_t *rng)
+{
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 7;
+	*rng ^= *rng << 17;
+	return *rng;
+}
+
+static void matrix_churn(struct matrix *m, size_t tid, uint8_t order)
+{
+	llfree_request_t req =
+		llfree_movable_request(m->cores, order, tid, true);
+	size_t batch = m->budget >> order;
+	batch = LL_MAX(LL_MIN(batch, (size_t)MATRIX_BATCH), (size_t)1);
+	frame_id_t frames[MATRIX_BATCH];
+
+	uint64_t ops = 0;
+	uint64_t failed = 0;
+	uint64_t start = bench_now_ns();
+	uint64_t now = start;
+	while (now - start < m->duration_ns) {
+		size_t n = 0;
+		for (; n < batch; n++) {
+			llfree_result_t res =
+				llfree_get(m->llfree, frame_id_none(), req);
+			if (!llfree_is_ok(res)) {
+				failed++;
+				break;
+			}
+			frames[n] = res.frame;
+		}
+		for (size_t i = 0; i < n; i++) {
+			llfree_result_t ll_unused res =
+				llfree_put(m->llfree, frames[i], req);
+			assert(llfree_is_ok(res));
+		}
+		ops += 2 * n;
+		now = bench_now_ns();
+	}
+	m->ops[tid] = ops;
+	m->failed[tid] = failed;
+	m->elapsed_ns[tid] = now - start;
+}
+
+/// Keep the memory filled with allocations of random orders, replacing a
+/// random one on every step. Leaves the allocations in place, so that the
+/// fragmentation can be measured afterwards.
+static void matrix_mixed(struct matrix *m, size_t tid)
+{
+	struct matrix_alloc *held = m->held[tid];
+	uint64_t rng = 0x9e3779b97f4a7c15ull * (tid + 1);
+	size_t count = 0;
+	size_t held_frames = 0;
+
+	uint64_t ops = 0;
+	uint64_t failed = 0;
+	uint64_t start = bench_now_ns();
+	uint64_t now = start;
+	for (uint64_t tick = 0;; tick++) {
+		if (tick % 64 == 0) {
+			now = bench_now_ns();
+			if (now - start >= m->duration_ns)
+				break;
+		}
+		uint64_t r = matrix_rand(&rng);
+
+		if (count > 0 && (held_frames >= m->budget || r % 2 == 0)) {
+			size_t i = (r >> 1) % count;
+			llfree_result_t ll_unused res = llfree_put(
+				m->llfree, held[i].frame,
+				llfree_movable_request(m->cores, held[i].order,
+						       tid, held[i].movable));
+			assert(llfree_is_ok(res));
+			held_frames -= 1u << held[i].order;
+			held[i] = held[--count];
+			ops++;
+		}
+
+		// Mostly movable order 0, some immovable orders 0-3, rare THP
+		uint64_t kind = (r >> 8) % 1000;
+		uint8_t order = kind < 200 ? (uint8_t)((r >> 20) % 4) :
+				kind < 998 ? 0 :
+					     LLFREE_HUGE_ORDER;
+		bool movable = kind >= 200;
+		if (held_frames + (1u << order) > m->budget)
+			continue;
+
+		llfree_result_t res = llfree_get(
+			m->llfree, frame_id_none(),
+			llfree_movable_request(m->cores, order, tid, movable));
+		ops++;
+		if (!llfree_is_ok(res)) {
+			failed++;
+			continue;
+		}
+		held[count++] = (struct matrix_alloc){ res.frame, order,
+						       movable };
+		held_frames += 1u << order;
+	}
+	m->held_count[tid] = count;
+	m->ops[tid] = ops;
+	m->failed[tid] = failed;
+	m->elapsed_ns[tid] = now - start;
+}
+
+static void matrix_run(size_t tid, void *ctx)
+{
+	struct matrix *m = ctx;
+	switch (m->workload) {
+	case MATRIX_SMALL:
+		matrix_churn(m, tid, 0);
+		break;
+	case MATRIX_HUGE:
+		matrix_churn(m, tid, LLFREE_HUGE_ORDER);
+		break;
+	case MATRIX_MIXED:
+		matrix_mixed(m, tid);
+		break;
+	default:
+		assert(false);
+	}
+}
+
+/// Run the same workloads on the current build configuration and print one
+/// table row per workload. `make bench_matrix` builds the library in
+/// several configurations and collects the rows into a single table.
+declare_bench(matrix)
+{
+	uint64_t *ops = malloc(sizeof(uint64_t) * args->threads);
+	uint64_t *failed = malloc(sizeof(uint64_t) * args->threads);
+	uint64_t *elapsed = malloc(sizeof(uint64_t) * args->threads);
+	size_t *held_count = malloc(sizeof(size_t) * args->threads);
+	struct matrix_alloc **held =
+		malloc(sizeof(struct matrix_alloc *) * args->threads);
+	assert(ops != NULL && failed != NULL && elapsed != NULL &&
+	       held_count != NULL && held != NULL);
+	size_t budget = args->frames * MATRIX_FILL / 100 / args->threads;
+	for (size_t i = 0; i < args->threads; i++) {
+		held[i] = malloc(sizeof(struct matrix_alloc) *
+				 LL_MAX(budget, (size_t)1));
+		assert(held[i] != NULL);
+	}
+
+	printf("%8s %12s %8s %7s %14s %8s %8s %10s\n", "children",
+	       "free_reserve", "workload", "threads", "ops/s", "jain", "huge%",
+	       "failed");
+
+	for (size_t w = 0; w < MATRIX_WORKLOAD_N; w++) {
+		llfree_classing_t classing =
+			llfree_classing_movable(args->threads);
+		struct matrix m = {
+			.llfree = bench_llfree_new(&classing, args->frames,
+						   LLFREE_INIT_FREE),
+			.workload = (matrix_workload_t)w,
+			.cores = args->threads,
+			.budget = budget,
+			.duration_ns = args->duration_ms * 1000000ull,
+			.ops = ops,
+			.failed = failed,
+			.elapsed_ns = elapsed,
+			.held = held,
+			.held_count = held_count,
+		};
+		bench_parallel(args->threads, matrix_run, &m);
+		// Includes the allocations left by the mixed workload
+		ll_stats_t stats = llfree_stats(m.llfree);
+
+		uint64_t total = 0, fails = 0, time = 0;
+		for (size_t i = 0; i < args->threads; i++) {
+			total += ops[i];
+			fails += failed[i];
+			time = LL_MAX(time, elapsed[i]);
+		}
+		// Fraction of the free memory that is available as huge frames
+		double huge = stats.free_frames == 0 ?
+				      0.0 :
+				      100.0 *
+					      (double)(stats.free_huge
+						       << LLFREE_HUGE_ORDER) /
+					      (double)stats.free_frames;
+
+		printf("%8u %12u %8s %7zu %14.0f %8.3f %8.2f %10" PRIu64 "\n",
+		       LLFREE_TREE_CHILDREN, (unsigned)LLFREE_ENABLE_FREE_RESERVE,
+		       WORKLOADS[w], args->threads,
+		       time ? (double)total * 1e9 / (double)time : 0.0,
+		       bench_fairness(ops, args->threads), huge, fails);
+
+		if (m.workload == MATRIX_MIXED) {
+			for (size_t t = 0; t < args->threads; t++) {
+				for (size_t i = 0; i < held_count[t]; i++) {
+					struct matrix_alloc *a = &held[t][i];
+					llfree_result_t ll_unused res = llfree_put(
+						m.llfree, a->frame,
+						llfree_movable_request(
+							m.cores, a->order, t,
+							a->movable));
+					assert(llfree_is_ok(res));
+				}
+			}
+		}
+		bench_llfree_drop(m.llfree);
+	}
+	for (size_t i = 0; i < args->threads; i++)
+		free(held[i]);
+	free(held);
+	free(held_count);
+	free(ops);
+	free(failed);
+	free(elapsed);
+}
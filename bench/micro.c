@@ -0,0 +1,451 @@
+#include "bench.h"
+#include "bitfield.h"
+#include "local.h"
+#include "lower.h"
+#include "trees.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+// Internal functions that are not part of the headers
+bool first_zeros_aligned(uint64_t *v, size_t order, size_t *pos);
+bool try_update_huge_n(lower_t *self, size_t base_idx, size_t h_num,
+		       child_t expected, child_t desired);
+
+/// Operations between two time checks
+#define MICRO_BATCH 256
+/// Number of random words for first_zeros_aligned
+#define MICRO_WORDS 1024
+
+/// A single measurement of a component
+struct micro {
+	/// Execute `batch` operations, returns the successful ones
+	uint64_t (*op)(struct micro *m, size_t tid, uint64_t iter);
+	/// Operations per call of `op`, between two time checks
+	size_t batch;
+	/// Component specific state
+	void *data;
+	size_t order;
+	/// All threads operate on the same data
+	bool shared;
+	uint64_t duration_ns;
+	_Atomic(uint64_t) ops;
+	_Atomic(uint64_t) hits;
+};
+
+static void micro_run(size_t tid, void *ctx)
+{
+	struct micro *m = ctx;
+	uint64_t ops = 0;
+	uint64_t hits = 0;
+	uint64_t start = bench_now_ns();
+	while (bench_now_ns() - start < m->duration_ns) {
+		hits += m->op(m, tid, ops);
+		ops += m->batch;
+	}
+	atomic_fetch_add(&m->ops, ops);
+	atomic_fetch_add(&m->hits, hits);
+}
+
+/// Measure `m` on `threads` threads and print a line of the table
+static void micro_measure(struct micro *m, const char *component,
+			  const char *variant, size_t threads)
+{
+	atomic_store(&m->ops, 0);
+	atomic_store(&m->hits, 0);
+	bench_parallel(threads, micro_run, m);
+
+	uint64_t ops = atomic_load(&m->ops);
+	uint64_t hits = atomic_load(&m->hits);
+	double per_thread = (double)ops / (double)threads;
+	double ns = per_thread > 0 ? (double)m->duration_ns / per_thread : 0;
+	printf("%-19s %-10s %5zu %7zu %12.0f %10.2f %6.1f\n", component,
+	       variant, m->order, threads,
+	       (double)ops * 1e9 / (double)m->duration_ns, ns,
+	       ops > 0 ? 100.0 * (double)hits / (double)ops : 0);
+}
+
+/// Measure `m` with a single thread and with all threads sharing the data
+static void micro_measure_both(struct micro *m, const char *component,
+			       size_t threads)
+{
+	m->shared = false;
+	micro_measure(m, component, "single", 1);
+	if (threads > 1) {
+		m->shared = true;
+		micro_measure(m, component, "shared", threads);
+	}
+}
+
+static uint64_t micro_random(uint64_t *seed)
+{
+	// xorshift64
+	uint64_t x = *seed;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *seed = x;
+}
+
+// first_zeros_aligned: a pure function on a single row
+
+static uint64_t micro_first_zeros(struct micro *m, size_t tid, uint64_t iter)
+{
+	(void)tid;
+	const uint64_t *words = m->data;
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		uint64_t v = words[(iter + i) % MICRO_WORDS];
+		size_t pos = 0;
+		hits += first_zeros_aligned(&v, m->order, &pos);
+	}
+	return hits;
+}
+
+static void micro_bitops(const bench_args_t *args)
+{
+	// Rows with a quarter of the bits set, so that small orders mostly
+	// succeed and larger ones search the whole row
+	uint64_t *words = malloc(sizeof(uint64_t) * MICRO_WORDS);
+	assert(words != NULL);
+	uint64_t seed = 0x9e3779b97f4a7c15ull;
+	for (size_t i = 0; i < MICRO_WORDS; i++)
+		words[i] = micro_random(&seed) & micro_random(&seed);
+
+	struct micro m = { .op = micro_first_zeros,
+			   .data = words,
+			   .batch = MICRO_BATCH,
+			   .duration_ns = args->duration_ms * 1000000ull };
+	for (m.order = 0; m.order <= LLFREE_ATOMIC_ORDER; m.order++)
+		micro_measure(&m, "first_zeros_aligned", "single", 1);
+	free(words);
+}
+
+// field_set_next and field_toggle: a private or a shared bitfield
+
+static bitfield_t *micro_field(struct micro *m, size_t tid)
+{
+	return &((bitfield_t *)m->data)[m->shared ? 0 : tid];
+}
+
+static uint64_t micro_set_next(struct micro *m, size_t tid, uint64_t iter)
+{
+	(void)iter;
+	bitfield_t *field = micro_field(m, tid);
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		llfree_result_t res =
+			field_set_next(field, frame_id(0), m->order);
+		if (llfree_is_ok(res)) {
+			res = field_toggle(field, res.frame.value, m->order,
+					   true);
+			assert(llfree_is_ok(res));
+			hits++;
+		}
+	}
+	return hits;
+}
+
+static uint64_t micro_toggle(struct micro *m, size_t tid, uint64_t iter)
+{
+	(void)iter;
+	bitfield_t *field = micro_field(m, tid);
+	// Threads toggle different frames of the free rows at the end, or the
+	// same ones for orders above a row
+	size_t free_frames =
+		LL_MAX((size_t)LLFREE_ATOMIC_SIZE, (size_t)1 << m->order);
+	size_t index = LLFREE_CHILD_SIZE - free_frames +
+		       ((tid << m->order) % free_frames);
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		llfree_result_t res =
+			field_toggle(field, index, m->order, false);
+		if (llfree_is_ok(res)) {
+			res = field_toggle(field, index, m->order, true);
+			assert(llfree_is_ok(res));
+			hits++;
+		}
+	}
+	return hits;
+}
+
+static void micro_bitfield(const bench_args_t *args)
+{
+	bitfield_t *fields = aligned_alloc(LLFREE_CACHE_SIZE,
+					   sizeof(bitfield_t) * args->threads);
+	assert(fields != NULL);
+	struct micro m = { .data = fields,
+			   .batch = MICRO_BATCH,
+			   .duration_ns = args->duration_ms * 1000000ull };
+
+	static const size_t ORDERS[] = { 0, 3, 6, 7, 8 };
+	for (size_t o = 0; o < sizeof(ORDERS) / sizeof(*ORDERS); o++) {
+		// A nearly full child, where only the last rows are free
+		size_t free_rows = LL_MAX((size_t)1, (1u << ORDERS[o]) /
+							    LLFREE_ATOMIC_SIZE);
+		for (size_t t = 0; t < args->threads; t++) {
+			field_init(&fields[t]);
+			for (size_t r = 0; r < FIELD_N - free_rows; r++)
+				fields[t].rows[r] = UINT64_MAX;
+		}
+		m.order = ORDERS[o];
+		m.op = micro_set_next;
+		micro_measure_both(&m, "field_set_next", args->threads);
+		m.op = micro_toggle;
+		micro_measure_both(&m, "field_toggle", args->threads);
+	}
+	free(fields);
+}
+
+// try_update_huge_n: the children of a private or a shared tree
+
+static uint64_t micro_huge_n(struct micro *m, size_t tid, uint64_t iter)
+{
+	(void)iter;
+	lower_t *lower = m->data;
+	size_t base = (m->shared ? 0 : tid) * LLFREE_TREE_CHILDREN;
+	size_t h_num = 1u << (m->order - LLFREE_HUGE_ORDER);
+	child_t free = child_new(LLFREE_CHILD_SIZE, false);
+	child_t allocated = child_new(0, true);
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		if (try_update_huge_n(lower, base, h_num, free, allocated)) {
+			bool ll_unused ok = try_update_huge_n(
+				lower, base, h_num, allocated, free);
+			assert(ok);
+			hits++;
+		}
+	}
+	return hits;
+}
+
+static void micro_lower(const bench_args_t *args)
+{
+	size_t frames = LLFREE_TREE_SIZE * args->threads;
+	uint8_t *buffer =
+		aligned_alloc(LLFREE_CACHE_SIZE,
+			      align_up(lower_metadata_size(frames),
+				       LLFREE_CACHE_SIZE));
+	assert(buffer != NULL);
+	lower_t lower;
+	llfree_result_t ll_unused res =
+		lower_init(&lower, frames, LLFREE_INIT_FREE, buffer);
+	assert(llfree_is_ok(res));
+
+	struct micro m = { .op = micro_huge_n,
+			   .data = &lower,
+			   .batch = MICRO_BATCH,
+			   .duration_ns = args->duration_ms * 1000000ull };
+	for (m.order = LLFREE_HUGE_ORDER; m.order <= LLFREE_TREE_ORDER;
+	     m.order++)
+		micro_measure_both(&m, "try_update_huge_n", args->threads);
+	free(buffer);
+}
+
+// trees_search_best: a full scan over the tree array
+
+struct micro_trees {
+	trees_t trees;
+	llfree_policy_fn policy;
+	/// Reserve and unreserve the first candidate instead of rejecting all
+	bool reserve;
+};
+
+static treeF_t micro_trees_init(frame_id_t start, void *ctx)
+{
+	(void)ctx;
+	// Deterministic, mostly partially free trees
+	uint64_t seed = start.value | 1;
+	micro_random(&seed);
+	return (treeF_t)(micro_random(&seed) % LLFREE_TREE_SIZE);
+}
+
+static llfree_policy_t micro_trees_rate(uint8_t class, treeF_t free,
+					void *args)
+{
+	(void)class;
+	(void)args;
+	if (free == 0)
+		return (llfree_policy_t){ LLFREE_POLICY_INVALID, 0 };
+	// Best fit, never a perfect match
+	return (llfree_policy_t){
+		LLFREE_POLICY_MATCH,
+		(uint8_t)(UINT8_MAX - 1 -
+			  (uint64_t)free * (UINT8_MAX - 1) / LLFREE_TREE_SIZE),
+	};
+}
+
+static llfree_result_t micro_trees_access(tree_id_t idx, void *ctx)
+{
+	struct micro_trees *t = ctx;
+	if (!t->reserve)
+		return llfree_err(LLFREE_ERR_MEMORY);
+
+	bool reserved;
+	treeF_t free;
+	uint8_t class;
+	if (!trees_reserve_or_steal(&t->trees, idx, 1, t->policy,
+				    t->trees.default_class, &reserved, &free,
+				    &class))
+		return llfree_err(LLFREE_ERR_MEMORY);
+	if (reserved)
+		trees_unreserve(&t->trees, idx, free, class, t->policy);
+	else
+		trees_put(&t->trees, idx, 1, t->policy);
+	return llfree_ok(frame_from_tree(idx), 0);
+}
+
+static uint64_t micro_search(struct micro *m, size_t tid, uint64_t iter)
+{
+	struct micro_trees *t = m->data;
+	uint64_t seed = ((uint64_t)tid << 32) + iter + 1;
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		tree_id_t start = tree_id(micro_random(&seed) % t->trees.len);
+		llfree_result_t res = trees_search_best(
+			&t->trees, start, 0, t->trees.len, micro_trees_rate,
+			NULL, micro_trees_access, t);
+		hits += llfree_is_ok(res);
+	}
+	return hits;
+}
+
+static void micro_trees(const bench_args_t *args)
+{
+	static const size_t LENS[] = { 1u << 8, 1u << 12, 1u << 16 };
+	static const char *const VARIANTS[] = { "scan", "reserve" };
+	llfree_classing_t classing = llfree_classing_simple(args->threads);
+
+	for (size_t l = 0; l < sizeof(LENS) / sizeof(*LENS); l++) {
+		size_t frames = LENS[l] * LLFREE_TREE_SIZE;
+		uint8_t *buffer = aligned_alloc(LLFREE_CACHE_SIZE,
+						trees_metadata_size(frames));
+		assert(buffer != NULL);
+		struct micro_trees t = { .policy = classing.policy };
+		trees_init(&t.trees, frames, buffer, micro_trees_init, NULL,
+			   classing.default_class);
+
+		char name[32];
+		snprintf(name, sizeof(name), "trees_search_%zu", LENS[l]);
+		for (size_t v = 0; v < 2; v++) {
+			t.reserve = v == 1;
+			// A full scan takes long enough for a time check
+			struct micro m = { .op = micro_search,
+					   .batch = 1,
+					   .data = &t,
+					   .duration_ns = args->duration_ms *
+							  1000000ull };
+			micro_measure(&m, name, VARIANTS[v], 1);
+			if (args->threads > 1)
+				micro_measure(&m, name, VARIANTS[v],
+					      args->threads);
+		}
+		free(buffer);
+	}
+}
+
+// ll_local_*: private or shared local slots
+
+struct micro_local {
+	local_t *local;
+	llfree_policy_fn policy;
+};
+
+static size_t micro_slot(struct micro *m, size_t tid)
+{
+	return m->shared ? 0 : tid;
+}
+
+static uint64_t micro_local_get_put(struct micro *m, size_t tid,
+				    uint64_t iter)
+{
+	(void)iter;
+	struct micro_local *l = m->data;
+	size_t slot = micro_slot(m, tid);
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		local_result_t res =
+			ll_local_get(l->local, 0, slot, tree_id_none(), 1);
+		if (res.success) {
+			bool ll_unused ok = ll_local_put(l->local, 0, slot,
+							 tree_id(slot), 1);
+			assert(ok);
+			hits++;
+		}
+	}
+	return hits;
+}
+
+static uint64_t micro_local_swap(struct micro *m, size_t tid, uint64_t iter)
+{
+	(void)iter;
+	struct micro_local *l = m->data;
+	size_t slot = micro_slot(m, tid);
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		local_result_t res = ll_local_swap(l->local, 0, slot,
+						   tree_id(slot),
+						   LLFREE_TREE_SIZE);
+		hits += res.present;
+	}
+	return hits;
+}
+
+static uint64_t micro_local_steal(struct micro *m, size_t tid, uint64_t iter)
+{
+	(void)iter;
+	struct micro_local *l = m->data;
+	size_t slot = micro_slot(m, tid);
+	uint64_t hits = 0;
+	for (size_t i = 0; i < m->batch; i++) {
+		local_result_t res = ll_local_steal(
+			l->local, 0, slot, tree_id_none(), 1, l->policy);
+		if (res.success) {
+			// The stolen frame is returned to its slot
+			hits++;
+			ll_local_put(l->local, res.class, slot, tree_id(slot),
+				     1);
+		}
+	}
+	return hits;
+}
+
+static void micro_local(const bench_args_t *args)
+{
+	llfree_classing_t classing = llfree_classing_simple(args->threads);
+	struct micro_local l = {
+		.local = aligned_alloc(LLFREE_CACHE_SIZE,
+				       align_up(ll_local_size(&classing),
+						LLFREE_CACHE_SIZE)),
+		.policy = classing.policy,
+	};
+	assert(l.local != NULL);
+	ll_local_init(l.local, &classing);
+	for (size_t t = 0; t < args->threads; t++)
+		ll_local_swap(l.local, 0, t, tree_id(t), LLFREE_TREE_SIZE);
+
+	struct micro m = { .data = &l,
+			   .batch = MICRO_BATCH,
+			   .duration_ns = args->duration_ms * 1000000ull };
+	m.op = micro_local_get_put;
+	micro_measure_both(&m, "ll_local_get_put", args->threads);
+	m.op = micro_local_steal;
+	micro_measure_both(&m, "ll_local_steal", args->threads);
+	m.op = micro_local_swap;
+	micro_measure_both(&m, "ll_local_swap", args->threads);
+	free(l.local);
+}
+
+/// Throughput of the individual components of the allocator, each measured
+/// on a single thread and with all threads contending on the same data.
+/// `hit%` is the share of successful operations.
+declare_bench(micro)
+{
+	printf("%-19s %-10s %5s %7s %12s %10s %6s\n", "component", "variant",
+	       "order", "threads", "ops/s", "ns/op", "hit%");
+	micro_bitops(args);
+	micro_bitfield(args);
+	micro_lower(args);
+	micro_trees(args);
+	micro_local(args);
+}
@@ -0,0 +1,277 @@
+#include "perf.h"
+#include "bench.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Environment variable with the raw event for PERF_C2C
+#define PERF_C2C_ENV "BENCH_PERF_C2C"
+
+static _Atomic(bool) perf_warned = false;
+
+static int perf_event_open(uint32_t type, uint64_t config, int group)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	// The members follow the leader
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool perf_open(perf_t *self)
+{
+	static const struct {
+		uint32_t type;
+		uint64_t config;
+	} EVENTS[PERF_COUNTER_N - 1] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE,
+		  PERF_COUNT_HW_CACHE_L1D |
+			  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	};
+
+	*self = (perf_t){ .leader = -1 };
+	for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+		self->fds[i] = -1;
+		self->index[i] = -1;
+	}
+
+	for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+		uint32_t type;
+		uint64_t config;
+		if (i == PERF_C2C) {
+			const char *raw = getenv(PERF_C2C_ENV);
+			if (raw == NULL)
+				continue;
+			type = PERF_TYPE_RAW;
+			config = strtoull(raw, NULL, 0);
+		} else {
+			type = EVENTS[i].type;
+			config = EVENTS[i].config;
+		}
+
+		int fd = perf_event_open(type, config, self->leader);
+		if (fd < 0) {
+			if (i == PERF_CYCLES) {
+				if (!atomic_exchange(&perf_warned, true)) {
+					printf("# perf_event_open failed: %s\n",
+					       strerror(errno));
+				}
+				return false;
+			}
+			continue;
+		}
+		if (i == PERF_CYCLES)
+			self->leader = fd;
+		self->fds[i] = fd;
+		self->index[i] = (int)self->len++;
+	}
+	return true;
+}
+
+void perf_close(perf_t *self)
+{
+	for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+		if (self->fds[i] >= 0)
+			close(self->fds[i]);
+		self->fds[i] = -1;
+	}
+	self->leader = -1;
+}
+
+void perf_enable(perf_t *self)
+{
+	if (self->leader >= 0)
+		ioctl(self->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_disable(perf_t *self)
+{
+	if (self->leader >= 0)
+		ioctl(self->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_read(perf_t *self, perf_values_t *sum)
+{
+	if (self->leader < 0)
+		return;
+	// nr, time_enabled, time_running, values[nr]
+	uint64_t buf[3 + PERF_COUNTER_N];
+	ssize_t n = read(self->leader, buf, sizeof(buf));
+	if (n < (ssize_t)(3 * sizeof(uint64_t)) || buf[2] == 0)
+		return;
+	double scale = (double)buf[1] / (double)buf[2];
+	for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+		if (self->index[i] < 0 || (uint64_t)self->index[i] >= buf[0])
+			continue;
+		sum->values[i] +=
+			(uint64_t)((double)buf[3 + self->index[i]] * scale);
+		sum->valid[i] = true;
+	}
+}
+
+/// Frames that are allocated and freed in one measured interval
+#define PERF_BATCH 32
+
+/// Measured scenarios, each isolating a different part of the allocator
+static const struct perf_scenario {
+	const char *name;
+	uint8_t order;
+	/// Use the local reservations
+	bool local;
+	/// All threads use the same local slot
+	bool shared;
+	/// Allocate and free with llfree_get_batch and llfree_put_batch
+	bool batch;
+} SCENARIOS[] = {
+	// Bitfield scan (field_set_next) of the reserved tree
+	{ "local", 0, true, false, false },
+	{ "local", 3, true, false, false },
+	// Child array of the reserved tree
+	{ "local", LLFREE_HUGE_ORDER, true, false, false },
+	// Tree array scan (trees_search_best) without reservations
+	{ "global", 0, false, false, false },
+	// Coherence traffic on a single entry_t
+	{ "shared", 0, true, true, false },
+	// Same as the local scenarios, but with a single call per interval
+	{ "batch", 0, true, false, true },
+	{ "batch", 3, true, false, true },
+};
+
+struct perf_bench {
+	llfree_t *llfree;
+	const struct perf_scenario *scenario;
+	size_t cores;
+	uint64_t duration_ns;
+	/// Accumulated over all threads
+	_Atomic(uint64_t) gets;
+	_Atomic(uint64_t) puts;
+	pthread_mutex_t lock;
+	perf_values_t get_values;
+	perf_values_t put_values;
+};
+
+static void perf_bench_run(size_t tid, void *ctx)
+{
+	struct perf_bench *b = ctx;
+	const struct perf_scenario *s = b->scenario;
+	llfree_request_t req =
+		llfree_simple_request(b->cores, s->order, s->shared ? 0 : tid);
+	if (!s->local)
+		req.local = ll_none();
+
+	// Separate groups for gets and puts, toggled around each batch
+	perf_t get_perf, put_perf;
+	// Without counters, the values are simply not accumulated
+	perf_open(&get_perf);
+	perf_open(&put_perf);
+	frame_id_t frames[PERF_BATCH];
+	uint64_t gets = 0;
+	uint64_t puts = 0;
+
+	uint64_t start = bench_now_ns();
+	while (bench_now_ns() - start < b->duration_ns) {
+		size_t n = 0;
+		perf_enable(&get_perf);
+		if (s->batch)
+			n = llfree_get_batch(b->llfree, req, frames, PERF_BATCH);
+		for (; !s->batch && n < PERF_BATCH; n++) {
+			llfree_result_t res =
+				llfree_get(b->llfree, frame_id_none(), req);
+			if (!llfree_is_ok(res))
+				break;
+			frames[n] = res.frame;
+		}
+		perf_disable(&get_perf);
+
+		perf_enable(&put_perf);
+		if (s->batch) {
+			size_t ll_unused freed =
+				llfree_put_batch(b->llfree, req, frames, n);
+			assert(freed == n);
+		}
+		for (size_t i = 0; !s->batch && i < n; i++) {
+			llfree_result_t ll_unused res =
+				llfree_put(b->llfree, frames[i], req);
+			assert(llfree_is_ok(res));
+		}
+		perf_disable(&put_perf);
+		gets += n;
+		puts += n;
+	}
+
+	atomic_fetch_add(&b->gets, gets);
+	atomic_fetch_add(&b->puts, puts);
+	pthread_mutex_lock(&b->lock);
+	perf_read(&get_perf, &b->get_values);
+	perf_read(&put_perf, &b->put_values);
+	pthread_mutex_unlock(&b->lock);
+	perf_close(&get_perf);
+	perf_close(&put_perf);
+}
+
+static void perf_bench_print(const struct perf_scenario *s, size_t threads,
+			     const char *op, const perf_values_t *v,
+			     uint64_t ops)
+{
+	printf("%-7s %5u %7zu %-4s %12" PRIu64, s->name, s->order, threads, op,
+	       ops);
+	for (size_t c = 0; c < PERF_COUNTER_N; c++) {
+		if (v->valid[c] && ops > 0)
+			printf(" %10.2f", (double)v->values[c] / (double)ops);
+		else
+			printf(" %10s", "-");
+	}
+	printf("\n");
+}
+
+/// Hardware counters per llfree_get and llfree_put in scenarios that
+/// stress the bitfield scan, the tree search, and the local slots.
+/// Set BENCH_PERF_C2C to a raw event to count cross-core transfers.
+declare_bench(perf)
+{
+	printf("%-7s %5s %7s %-4s %12s", "path", "order", "threads", "op",
+	       "ops");
+	for (size_t c = 0; c < PERF_COUNTER_N; c++)
+		printf(" %10s", perf_counter_name(c));
+	printf("\n");
+
+	for (size_t i = 0; i < sizeof(SCENARIOS) / sizeof(*SCENARIOS); i++) {
+		const struct perf_scenario *s = &SCENARIOS[i];
+		llfree_classing_t classing =
+			llfree_classing_simple(args->threads);
+		struct perf_bench b = {
+			.llfree = bench_llfree_new(&classing, args->frames,
+						   LLFREE_INIT_FREE),
+			.scenario = s,
+			.cores = args->threads,
+			.duration_ns = args->duration_ms * 1000000ull,
+		};
+		pthread_mutex_init(&b.lock, NULL);
+		bench_parallel(args->threads, perf_bench_run, &b);
+		pthread_mutex_destroy(&b.lock);
+
+		perf_bench_print(s, args->threads, "get", &b.get_values,
+				 atomic_load(&b.gets));
+		perf_bench_print(s, args->threads, "put", &b.put_values,
+				 atomic_load(&b.puts));
+		bench_llfree_drop(b.llfree);
+	}
+}
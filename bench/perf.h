@@ -0,0 +1,57 @@
+#pragma once
+
+#include "llfree.h"
+
+/// Hardware counters that are measured with perf_event_open
+typedef enum perf_counter {
+	PERF_CYCLES = 0,
+	PERF_INSTRUCTIONS = 1,
+	/// L1 data cache read misses
+	PERF_L1D_MISSES = 2,
+	/// Last-level cache misses
+	PERF_LLC_MISSES = 3,
+	/// Loads served from a modified line in another core's cache.
+	/// There is no generic event for this, so it has to be given as raw
+	/// event with BENCH_PERF_C2C (e.g. 0x04d2 for the
+	/// MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM event of Intel Skylake).
+	PERF_C2C = 4,
+	PERF_COUNTER_N = 5,
+} perf_counter_t;
+
+static inline ll_unused const char *perf_counter_name(perf_counter_t counter)
+{
+	static const char *const NAMES[] = { "cycles", "instr", "l1d_miss",
+					     "llc_miss", "c2c" };
+	return counter < PERF_COUNTER_N ? NAMES[counter] : "invalid";
+}
+
+/// Accumulated counter values
+typedef struct perf_values {
+	uint64_t values[PERF_COUNTER_N];
+	/// The counter is supported and was scheduled
+	bool valid[PERF_COUNTER_N];
+} perf_values_t;
+
+/// Counter group of the calling thread, counting only user space
+typedef struct perf {
+	/// Group leader (cycles) or -1 if unavailable
+	int leader;
+	int fds[PERF_COUNTER_N];
+	/// Position of the counters in the group read, -1 if unsupported
+	int index[PERF_COUNTER_N];
+	size_t len;
+} perf_t;
+
+/// Open the counters for the calling thread (disabled).
+/// Returns false and prints the reason once if perf events are unavailable,
+/// e.g. due to /proc/sys/kernel/perf_event_paranoid.
+bool perf_open(perf_t *self);
+void perf_close(perf_t *self);
+
+/// Start or stop counting, the counters accumulate over multiple intervals
+void perf_enable(perf_t *self);
+void perf_disable(perf_t *self);
+
+/// Add the current counter values to `sum`, scaled if the group was
+/// multiplexed with other events
+void perf_read(perf_t *self, perf_values_t *sum);
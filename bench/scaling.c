@@ -0,0 +1,126 @@
+#include "bench.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/// Maximum number of frames a thread holds before freeing them again
+#define SCALING_BATCH 32
+
+struct scaling {
+	llfree_t *llfree;
+	bench_classing_t classing;
+	size_t cores;
+	uint8_t order;
+	size_t batch;
+	uint64_t duration_ns;
+	/// Per-thread results
+	uint64_t *ops;
+	uint64_t *elapsed_ns;
+};
+
+static void scaling_run(size_t tid, void *ctx)
+{
+	struct scaling *s = ctx;
+	llfree_request_t req =
+		bench_request(s->classing, s->cores, s->order, tid);
+	frame_id_t frames[SCALING_BATCH];
+
+	uint64_t ops = 0;
+	uint64_t start = bench_now_ns();
+	uint64_t now = start;
+	while (now - start < s->duration_ns) {
+		size_t n = 0;
+		for (; n < s->batch; n++) {
+			llfree_result_t res =
+				llfree_get(s->llfree, frame_id_none(), req);
+			if (!llfree_is_ok(res))
+				break;
+			frames[n] = res.frame;
+		}
+		for (size_t i = 0; i < n; i++) {
+			llfree_result_t ll_unused res =
+				llfree_put(s->llfree, frames[i], req);
+			assert(llfree_is_ok(res));
+		}
+		ops += 2 * n;
+		now = bench_now_ns();
+	}
+	s->ops[tid] = ops;
+	s->elapsed_ns[tid] = now - start;
+}
+
+/// Allocate and free batches of frames on 1..N threads and report the
+/// throughput, fairness between the threads, and the scaling efficiency
+/// relative to a single thread.
+declare_bench(scaling)
+{
+	static const uint8_t ORDERS[] = { 0, 3, LLFREE_HUGE_ORDER,
+					  LLFREE_TREE_ORDER };
+
+	uint64_t *ops = malloc(sizeof(uint64_t) * args->threads);
+	uint64_t *elapsed = malloc(sizeof(uint64_t) * args->threads);
+	assert(ops != NULL && elapsed != NULL);
+
+	printf("%-8s %5s %7s %14s %8s %8s %10s\n", "classing", "order",
+	       "threads", "ops/s", "jain", "min/max", "efficiency");
+
+	for (size_t c = 0; c < BENCH_CLASSING_N; c++) {
+		for (size_t o = 0; o < sizeof(ORDERS) / sizeof(*ORDERS); o++) {
+			uint8_t order = ORDERS[o];
+			if ((1ul << order) > args->frames)
+				continue;
+
+			double single = 0;
+			for (size_t t = 1; t != 0;
+			     t = bench_next_threads(t, args->threads)) {
+				llfree_classing_t classing =
+					bench_classing((bench_classing_t)c, t);
+				llfree_t *llfree = bench_llfree_new(
+					&classing, args->frames,
+					LLFREE_INIT_FREE);
+
+				size_t batch = args->frames /
+					       (t * (1ul << order) * 2);
+				struct scaling s = {
+					.llfree = llfree,
+					.classing = (bench_classing_t)c,
+					.cores = t,
+					.order = order,
+					.batch = LL_MAX(LL_MIN(batch,
+							       SCALING_BATCH),
+							1),
+					.duration_ns = args->duration_ms *
+						       1000000ull,
+					.ops = ops,
+					.elapsed_ns = elapsed,
+				};
+				bench_parallel(t, scaling_run, &s);
+
+				uint64_t total = 0, min = UINT64_MAX, max = 0,
+					 time = 0;
+				for (size_t i = 0; i < t; i++) {
+					total += ops[i];
+					min = LL_MIN(min, ops[i]);
+					max = LL_MAX(max, ops[i]);
+					time = LL_MAX(time, elapsed[i]);
+				}
+				double throughput =
+					(double)total * 1e9 / (double)time;
+				if (t == 1)
+					single = throughput;
+
+				printf("%-8s %5u %7zu %14.0f %8.3f %8.3f %10.3f\n",
+				       bench_classing_name((bench_classing_t)c),
+				       order, t, throughput,
+				       bench_fairness(ops, t),
+				       max ? (double)min / (double)max : 0,
+				       throughput / ((double)t * single));
+
+				bench_llfree_drop(llfree);
+			}
+		}
+	}
+
+	free(elapsed);
+	free(ops);
+}
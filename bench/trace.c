@@ -0,0 +1,487 @@
+#include "trace.h"
+#include "bench.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Records buffered per thread before they are written
+#define TRACE_BUFFER 4096
+/// Frames held per thread by the recorded workload
+#define TRACE_HELD 256
+
+/// Per-thread record buffer
+struct trace_buffer {
+	struct trace_buffer *next;
+	uint16_t thread;
+	size_t len;
+	trace_record_t records[TRACE_BUFFER];
+};
+
+struct trace_recorder {
+	llfree_t *llfree;
+	FILE *file;
+	/// Unique id, to detect stale thread-local buffers
+	uint64_t id;
+	uint64_t start;
+	_Atomic(uint64_t) seq;
+
+	/// Protects the fields below and the file
+	pthread_mutex_t lock;
+	struct trace_buffer *buffers;
+	uint16_t threads;
+	uint64_t records;
+};
+
+static _Atomic(uint64_t) recorder_ids = 1;
+static _Thread_local struct {
+	uint64_t recorder;
+	struct trace_buffer *buffer;
+} local;
+
+static void trace_flush(trace_recorder_t *self, struct trace_buffer *buffer)
+{
+	pthread_mutex_lock(&self->lock);
+	size_t ll_unused n = fwrite(buffer->records, sizeof(trace_record_t),
+				    buffer->len, self->file);
+	assert(n == buffer->len);
+	self->records += buffer->len;
+	buffer->len = 0;
+	pthread_mutex_unlock(&self->lock);
+}
+
+/// Returns the buffer of the current thread, registering it if needed
+static struct trace_buffer *trace_buffer(trace_recorder_t *self)
+{
+	if (local.recorder == self->id)
+		return local.buffer;
+
+	struct trace_buffer *buffer = malloc(sizeof(struct trace_buffer));
+	assert(buffer != NULL);
+	pthread_mutex_lock(&self->lock);
+	buffer->next = self->buffers;
+	buffer->thread = self->threads++;
+	buffer->len = 0;
+	self->buffers = buffer;
+	pthread_mutex_unlock(&self->lock);
+
+	local.recorder = self->id;
+	local.buffer = buffer;
+	return buffer;
+}
+
+static void trace_sink(const llfree_trace_event_t *event, void *ctx)
+{
+	trace_recorder_t *self = ctx;
+	struct trace_buffer *buffer = trace_buffer(self);
+
+	bool get = event->op == LLFREE_TRACE_GET ||
+		   event->op == LLFREE_TRACE_GET_RUN ||
+		   event->op == LLFREE_TRACE_GET_CONTIG;
+	uint64_t frame = 0;
+	if (get && llfree_is_ok(event->result))
+		frame = event->result.frame.value;
+	else if (event->frame.present)
+		frame = event->frame.value.value;
+
+	buffer->records[buffer->len++] = (trace_record_t){
+		.seq = atomic_fetch_add_explicit(&self->seq, 1,
+						 memory_order_relaxed),
+		.time_ns = bench_now_ns() - self->start,
+		.frame = frame,
+		.local = (uint32_t)event->request.local.value,
+		.thread = buffer->thread,
+		.op = (uint8_t)event->op,
+		.flags = (uint8_t)((event->request.local.present ?
+					    TRACE_LOCAL :
+					    0) |
+				   (event->frame.present ? TRACE_AT : 0)),
+		.order = event->align != 0 ? (uint8_t)log2(event->align) :
+					     event->request.order,
+		.class = event->request.class,
+		.result_class = event->result.class,
+		.error = event->result.error,
+		.len = (uint32_t)event->len,
+	};
+	if (buffer->len == TRACE_BUFFER)
+		trace_flush(self, buffer);
+}
+
+trace_recorder_t *trace_record_start(llfree_t *llfree,
+				     const llfree_classing_t *classing,
+				     FILE *file)
+{
+	if (!LLFREE_ENABLE_TRACE) {
+		llfree_warn("tracing is disabled, build with LLFREE_ENABLE_TRACE");
+		return NULL;
+	}
+
+	trace_header_t header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.num_classes = (uint32_t)classing->num_classes,
+		.frames = llfree_frames(llfree),
+		.default_class = classing->default_class,
+	};
+	for (size_t c = 0; c < classing->num_classes; c++) {
+		header.classes[c] = classing->classes[c].class;
+		header.counts[c] = classing->classes[c].count;
+	}
+	if (fwrite(&header, sizeof(header), 1, file) != 1)
+		return NULL;
+
+	trace_recorder_t *self = malloc(sizeof(trace_recorder_t));
+	assert(self != NULL);
+	*self = (trace_recorder_t){
+		.llfree = llfree,
+		.file = file,
+		.id = atomic_fetch_add(&recorder_ids, 1),
+		.start = bench_now_ns(),
+	};
+	pthread_mutex_init(&self->lock, NULL);
+	llfree_set_trace(llfree, trace_sink, self);
+	return self;
+}
+
+uint64_t trace_record_stop(trace_recorder_t *self)
+{
+	llfree_set_trace(self->llfree, NULL, NULL);
+
+	struct trace_buffer *buffer = self->buffers;
+	while (buffer != NULL) {
+		struct trace_buffer *next = buffer->next;
+		trace_flush(self, buffer);
+		free(buffer);
+		buffer = next;
+	}
+	fflush(self->file);
+
+	uint64_t records = self->records;
+	pthread_mutex_destroy(&self->lock);
+	free(self);
+	return records;
+}
+
+static int trace_cmp(const void *a, const void *b)
+{
+	const trace_record_t *ra = a;
+	const trace_record_t *rb = b;
+	return (ra->seq > rb->seq) - (ra->seq < rb->seq);
+}
+
+bool trace_load(trace_t *self, FILE *file)
+{
+	*self = (trace_t){ 0 };
+	if (fread(&self->header, sizeof(trace_header_t), 1, file) != 1 ||
+	    self->header.magic != TRACE_MAGIC ||
+	    self->header.version != TRACE_VERSION ||
+	    self->header.num_classes == 0 ||
+	    self->header.num_classes > LLFREE_MAX_CLASSES) {
+		llfree_warn("invalid trace header");
+		return false;
+	}
+
+	size_t capacity = 0;
+	for (;;) {
+		if (self->len == capacity) {
+			capacity = LL_MAX(2 * capacity, (size_t)TRACE_BUFFER);
+			self->records = realloc(
+				self->records, capacity * sizeof(trace_record_t));
+			assert(self->records != NULL);
+		}
+		size_t n = fread(&self->records[self->len],
+				 sizeof(trace_record_t), capacity - self->len,
+				 file);
+		self->len += n;
+		if (n == 0)
+			break;
+	}
+
+	qsort(self->records, self->len, sizeof(trace_record_t), trace_cmp);
+	for (size_t i = 0; i < self->len; i++) {
+		self->threads =
+			LL_MAX(self->threads, (size_t)self->records[i].thread + 1);
+	}
+	return true;
+}
+
+void trace_free(trace_t *self)
+{
+	free(self->records);
+	*self = (trace_t){ 0 };
+}
+
+/// The recorded frame was not allocated in the trace, use it directly
+#define TRACE_UNMAPPED UINT64_MAX
+/// The recorded allocation failed during the replay
+#define TRACE_LOST (UINT64_MAX - 1)
+
+struct replay {
+	const trace_t *trace;
+	llfree_t *llfree;
+	/// Maps recorded frames to the frames allocated by the replay
+	uint64_t *map;
+	/// Index of the next record to execute (interleaved mode)
+	_Atomic(size_t) next;
+	uint64_t mismatches;
+	uint64_t diverged;
+};
+
+/// Repeat a recorded allocation
+static llfree_result_t replay_get(struct replay *rp, const trace_record_t *r,
+				  llfree_request_t request)
+{
+	switch (r->op) {
+	case LLFREE_TRACE_GET_RUN:
+		return llfree_get_run(rp->llfree, request, r->len,
+				      1ull << r->order);
+	case LLFREE_TRACE_GET_CONTIG:
+		return llfree_get_contig(rp->llfree, r->len, 1ull << r->order,
+					 r->class);
+	default:
+		return llfree_get(rp->llfree,
+				  (r->flags & TRACE_AT) ?
+					  frame_id_some(frame_id(r->frame)) :
+					  frame_id_none(),
+				  request);
+	}
+}
+
+/// Repeat a recorded free of `frame`
+static llfree_result_t replay_put(struct replay *rp, const trace_record_t *r,
+				  llfree_request_t request, frame_id_t frame)
+{
+	switch (r->op) {
+	case LLFREE_TRACE_PUT_RUN:
+		return llfree_put_run(rp->llfree, frame, request, r->len);
+	case LLFREE_TRACE_PUT_CONTIG:
+		return llfree_put_contig(rp->llfree, frame, r->len, r->class);
+	default:
+		return llfree_put(rp->llfree, frame, request);
+	}
+}
+
+/// Execute the record and return whether the outcome matches the recording
+static bool replay_call(struct replay *rp, const trace_record_t *r)
+{
+	// Runs and ranges store their alignment in the order
+	bool sized = r->op != LLFREE_TRACE_GET && r->op != LLFREE_TRACE_PUT;
+	llfree_request_t request =
+		llreq(sized ? 0 : r->order, r->class,
+		      (r->flags & TRACE_LOCAL) ? ll_some(r->local) : ll_none());
+	bool mapped = r->frame < rp->trace->header.frames;
+
+	if (r->op == LLFREE_TRACE_GET || r->op == LLFREE_TRACE_GET_RUN ||
+	    r->op == LLFREE_TRACE_GET_CONTIG) {
+		llfree_result_t res = replay_get(rp, r, request);
+		if (r->error == LLFREE_ERR_OK && mapped) {
+			rp->map[r->frame] = llfree_is_ok(res) ? res.frame.value :
+								TRACE_LOST;
+		}
+		if (res.error != r->error)
+			return false;
+		return !llfree_is_ok(res) || (res.frame.value == r->frame &&
+					      res.class == r->result_class);
+	}
+
+	uint64_t frame = r->frame;
+	if (mapped && rp->map[frame] != TRACE_UNMAPPED) {
+		frame = rp->map[r->frame];
+		rp->map[r->frame] = TRACE_UNMAPPED;
+		if (frame == TRACE_LOST)
+			return false;
+	}
+	llfree_result_t res = replay_put(rp, r, request, frame_id(frame));
+	return res.error == r->error;
+}
+
+/// Execute the i-th record, the calls are serialized by the caller
+static void replay_one(struct replay *rp, size_t i)
+{
+	if (!replay_call(rp, &rp->trace->records[i])) {
+		if (rp->mismatches == 0)
+			rp->diverged = i;
+		rp->mismatches++;
+	}
+}
+
+static void replay_thread(size_t tid, void *ctx)
+{
+	struct replay *rp = ctx;
+	for (size_t i = 0; i < rp->trace->len; i++) {
+		const trace_record_t *r = &rp->trace->records[i];
+		if (r->thread != tid)
+			continue;
+		// Wait until all previous calls are executed
+		while (atomic_load_explicit(&rp->next, memory_order_acquire) !=
+		       i)
+			sched_yield();
+		replay_one(rp, i);
+		atomic_store_explicit(&rp->next, i + 1, memory_order_release);
+	}
+}
+
+trace_replay_result_t trace_replay(const trace_t *self, bool interleaved)
+{
+	const trace_header_t *h = &self->header;
+	llfree_classing_t classing = {
+		.num_classes = h->num_classes,
+		.default_class = h->default_class,
+		// Policies cannot be stored, use the matching example policy
+		.policy = h->num_classes == 2 ? llfree_simple_policy :
+						llfree_movable_policy,
+	};
+	for (size_t c = 0; c < h->num_classes; c++) {
+		classing.classes[c] = (llfree_class_conf_t){
+			.class = h->classes[c], .count = h->counts[c]
+		};
+	}
+
+	struct replay rp = {
+		.trace = self,
+		.llfree = bench_llfree_new(&classing, h->frames,
+					   LLFREE_INIT_FREE),
+		.map = malloc(sizeof(uint64_t) * h->frames),
+		.diverged = self->len,
+	};
+	assert(rp.map != NULL);
+	memset(rp.map, 0xff, sizeof(uint64_t) * h->frames);
+
+	uint64_t start = bench_now_ns();
+	if (interleaved) {
+		bench_parallel(LL_MAX(self->threads, (size_t)1), replay_thread,
+			       &rp);
+	} else {
+		for (size_t i = 0; i < self->len; i++)
+			replay_one(&rp, i);
+	}
+	trace_replay_result_t result = {
+		.ops = self->len,
+		.elapsed_ns = bench_now_ns() - start,
+		.mismatches = rp.mismatches,
+		.diverged = rp.diverged,
+		.stats = llfree_stats(rp.llfree),
+	};
+
+	free(rp.map);
+	bench_llfree_drop(rp.llfree);
+	return result;
+}
+
+struct trace_workload {
+	llfree_t *llfree;
+	size_t cores;
+	uint64_t duration_ns;
+};
+
+/// Mixed-order churn that is recorded by the trace bench
+static void trace_workload(size_t tid, void *ctx)
+{
+	struct trace_workload *w = ctx;
+	struct {
+		frame_id_t frame;
+		uint8_t order;
+	} held[TRACE_HELD];
+	for (size_t i = 0; i < TRACE_HELD; i++)
+		held[i].order = UINT8_MAX;
+	uint64_t rng = 0x9e3779b97f4a7c15ull * (tid + 1);
+
+	uint64_t start = bench_now_ns();
+	for (size_t i = 0; bench_now_ns() - start < w->duration_ns; i++) {
+		size_t slot = i % TRACE_HELD;
+		if (held[slot].order != UINT8_MAX) {
+			llfree_result_t ll_unused res = llfree_put(
+				w->llfree, held[slot].frame,
+				llfree_movable_request(w->cores,
+						       held[slot].order, tid,
+						       slot % 2 == 0));
+			assert(llfree_is_ok(res));
+		}
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		uint8_t order = rng % 64 == 0 ? LLFREE_HUGE_ORDER :
+				rng % 8 == 0  ? 3 :
+						0;
+		llfree_result_t res = llfree_get(
+			w->llfree, frame_id_none(),
+			llfree_movable_request(w->cores, order, tid,
+					       slot % 2 == 0));
+		held[slot].frame = res.frame;
+		held[slot].order = llfree_is_ok(res) ? order : UINT8_MAX;
+	}
+	for (size_t i = 0; i < TRACE_HELD; i++) {
+		if (held[i].order == UINT8_MAX)
+			continue;
+		llfree_result_t ll_unused res = llfree_put(
+			w->llfree, held[i].frame,
+			llfree_movable_request(w->cores, held[i].order, tid,
+					       i % 2 == 0));
+	}
+}
+
+/// Record a trace of a mixed workload or load the trace given with `-i`,
+/// then replay it single-threaded and with the original interleaving.
+declare_bench(trace)
+{
+	FILE *file;
+	if (args->file != NULL) {
+		file = fopen(args->file, "rb");
+		if (file == NULL) {
+			printf("failed to open %s\n", args->file);
+			return;
+		}
+	} else {
+		if (!LLFREE_ENABLE_TRACE) {
+			printf("skipped: build with LLFREE_ENABLE_TRACE=1 or "
+			       "replay a trace with -i\n");
+			return;
+		}
+		file = tmpfile();
+		assert(file != NULL);
+
+		size_t frames = LL_MAX(args->threads * TRACE_HELD * 16,
+				       (size_t)4 * LLFREE_TREE_SIZE);
+		frames = LL_MIN(frames, args->frames);
+		llfree_classing_t classing =
+			llfree_classing_movable(args->threads);
+		struct trace_workload w = {
+			.llfree = bench_llfree_new(&classing, frames,
+						   LLFREE_INIT_FREE),
+			.cores = args->threads,
+			.duration_ns = args->duration_ms * 1000000ull,
+		};
+		trace_recorder_t *rec =
+			trace_record_start(w.llfree, &classing, file);
+		assert(rec != NULL);
+		bench_parallel(args->threads, trace_workload, &w);
+		uint64_t ll_unused records = trace_record_stop(rec);
+		bench_llfree_drop(w.llfree);
+		rewind(file);
+	}
+
+	trace_t trace;
+	bool loaded = trace_load(&trace, file);
+	fclose(file);
+	if (!loaded)
+		return;
+
+	printf("# records=%zu threads=%zu frames=%" PRIu64 " classes=%u\n",
+	       trace.len, trace.threads, trace.header.frames,
+	       trace.header.num_classes);
+	printf("%-12s %12s %14s %12s %12s %10s %10s\n", "mode", "ops",
+	       "ops/s", "mismatches", "diverged", "free", "free_huge");
+	for (size_t m = 0; m < 2; m++) {
+		bool interleaved = m == 1;
+		trace_replay_result_t r = trace_replay(&trace, interleaved);
+		double secs = (double)r.elapsed_ns / 1e9;
+		printf("%-12s %12" PRIu64 " %14.0f %12" PRIu64 " %12" PRIu64
+		       " %10zu %10zu\n",
+		       interleaved ? "interleaved" : "single", r.ops,
+		       secs > 0 ? (double)r.ops / secs : 0.0, r.mismatches,
+		       r.diverged, r.stats.free_frames, r.stats.free_huge);
+	}
+	trace_free(&trace);
+}
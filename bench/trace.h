@@ -0,0 +1,93 @@
+#pragma once
+
+#include "llfree.h"
+
+#include <stdio.h>
+
+/// Trace files start with a header, followed by records in arbitrary order.
+/// All fields are stored in native byte order.
+#define TRACE_MAGIC 0x4543415254464c4cull // "LLFTRACE"
+#define TRACE_VERSION 2u
+
+/// Describes the allocator the trace was recorded on
+typedef struct trace_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t num_classes;
+	uint64_t frames;
+	/// Local slot count per class
+	uint64_t counts[LLFREE_MAX_CLASSES];
+	uint8_t classes[LLFREE_MAX_CLASSES];
+	uint8_t default_class;
+	uint8_t _pad[7];
+} trace_header_t;
+
+/// The request has a local index
+#define TRACE_LOCAL 1u
+/// The get targeted a specific frame
+#define TRACE_AT 2u
+
+/// A single traced call (40 bytes)
+typedef struct trace_record {
+	/// Global order in which the calls returned
+	uint64_t seq;
+	/// Nanoseconds since the start of the recording
+	uint64_t time_ns;
+	/// Freed or requested frame, or the frame returned by a get
+	uint64_t frame;
+	/// Local index of the request
+	uint32_t local;
+	/// Recording thread
+	uint16_t thread;
+	/// llfree_trace_op_t
+	uint8_t op;
+	/// TRACE_LOCAL | TRACE_AT
+	uint8_t flags;
+	/// Order of the request, or log2 of the alignment of runs and ranges
+	uint8_t order;
+	uint8_t class;
+	uint8_t result_class;
+	uint8_t error;
+	/// Number of frames of runs and ranges
+	uint32_t len;
+} trace_record_t;
+
+typedef struct trace_recorder trace_recorder_t;
+
+/// Record all calls on `llfree` into `file` until trace_record_stop.
+/// Requires LLFREE_ENABLE_TRACE, returns NULL otherwise.
+trace_recorder_t *trace_record_start(llfree_t *llfree,
+				     const llfree_classing_t *classing,
+				     FILE *file);
+/// Stop recording and flush all records.
+/// The recording threads must not call into the allocator concurrently.
+/// Returns the number of records.
+uint64_t trace_record_stop(trace_recorder_t *self);
+
+/// A loaded trace, records are sorted by their sequence number
+typedef struct trace {
+	trace_header_t header;
+	trace_record_t *records;
+	size_t len;
+	/// Number of recording threads
+	size_t threads;
+} trace_t;
+
+/// Load a trace from `file`
+bool trace_load(trace_t *self, FILE *file);
+void trace_free(trace_t *self);
+
+typedef struct trace_replay_result {
+	uint64_t ops;
+	uint64_t elapsed_ns;
+	/// Calls whose outcome differed from the recording
+	uint64_t mismatches;
+	/// Index of the first mismatch, where the replay diverged (or ops)
+	uint64_t diverged;
+	/// Stats of the allocator after the replay
+	ll_stats_t stats;
+} trace_replay_result_t;
+
+/// Replay the trace on a fresh allocator, either on a single thread or on
+/// the original threads, executing the calls in the recorded order
+trace_replay_result_t trace_replay(const trace_t *self, bool interleaved);
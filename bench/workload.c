@@ -0,0 +1,503 @@
+#include "workload.h"
+#include "bench.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+/// Number of ranks of the Zipf distribution of the page-cache lifetimes
+#define WORKLOAD_ZIPF_N 1024
+// The lifetimes are given in steps per budget frame, so that the share of
+// memory each pattern occupies does not depend on the memory size.
+/// Lifetime of a page-cache page per Zipf rank
+#define WORKLOAD_ZIPF_SCALE(budget) ((budget) / 128)
+/// Maximum lifetime of anonymous memory
+#define WORKLOAD_ANON_LIFETIME(budget) ((budget) / 128)
+/// Maximum lifetime of slab pages
+#define WORKLOAD_SLAB_LIFETIME(budget) ((budget) / 4)
+/// Maximum number of slab pages allocated in a single burst
+#define WORKLOAD_SLAB_BURST 8
+/// Frames the balloon inflates or deflates by in a single step
+#define WORKLOAD_BALLOON_BATCH 64
+
+const workload_mix_t WORKLOAD_MIXES[] = {
+	{ "pagecache", { 1, 0, 0, 0 } },
+	{ "anon", { 0, 1, 0, 0 } },
+	{ "slab", { 0, 0, 1, 0 } },
+	{ "balloon", { 0, 0, 0, 1 } },
+	// File server: mostly page cache, some processes and kernel objects
+	{ "server", { 60, 25, 14, 1 } },
+	// VM guest that is ballooned by the host
+	{ "guest", { 35, 35, 10, 20 } },
+};
+const size_t WORKLOAD_MIXES_N = sizeof(WORKLOAD_MIXES) /
+				sizeof(*WORKLOAD_MIXES);
+
+/// An allocation that is freed when it expires or is reclaimed
+struct workload_alloc {
+	uint64_t expires;
+	frame_id_t frame;
+	uint8_t order;
+	bool movable;
+};
+
+struct workload {
+	const bench_alloc_t *alloc;
+	const workload_mix_t *mix;
+	uint32_t weight_sum;
+	size_t tid;
+	size_t budget;
+	uint64_t rng;
+	uint64_t tick;
+
+	/// Min-heap of the allocations, ordered by their expiration
+	struct workload_alloc *heap;
+	size_t heap_len;
+
+	/// Frames of the balloon (stack)
+	frame_id_t *balloon;
+	uint8_t *balloon_orders;
+	size_t balloon_len;
+	size_t balloon_frames;
+	size_t balloon_target;
+	bool balloon_inflate;
+
+	/// Cumulative distribution of the Zipf ranks
+	double zipf[WORKLOAD_ZIPF_N];
+
+	workload_stats_t stats;
+};
+
+static uint64_t workload_rand(workload_t *self)
+{
+	self->rng ^= self->rng << 13;
+	self->rng ^= self->rng >> 7;
+	self->rng ^= self->rng << 17;
+	return self->rng;
+}
+
+/// Sample a rank in [1, WORKLOAD_ZIPF_N] with the exponent 1
+static size_t workload_zipf(workload_t *self)
+{
+	double u = (double)(workload_rand(self) >> 11) / (double)(1ull << 53);
+	size_t lo = 0;
+	size_t hi = WORKLOAD_ZIPF_N - 1;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (self->zipf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo + 1;
+}
+
+static void heap_swap(struct workload_alloc *a, struct workload_alloc *b)
+{
+	struct workload_alloc tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void heap_push(workload_t *self, struct workload_alloc alloc)
+{
+	assert(self->heap_len < self->budget);
+	size_t i = self->heap_len++;
+	self->heap[i] = alloc;
+	while (i > 0 && self->heap[(i - 1) / 2].expires > self->heap[i].expires) {
+		heap_swap(&self->heap[(i - 1) / 2], &self->heap[i]);
+		i = (i - 1) / 2;
+	}
+}
+
+static struct workload_alloc heap_pop(workload_t *self)
+{
+	assert(self->heap_len > 0);
+	struct workload_alloc top = self->heap[0];
+	self->heap[0] = self->heap[--self->heap_len];
+	for (size_t i = 0;;) {
+		size_t min = i;
+		size_t l = 2 * i + 1;
+		size_t r = 2 * i + 2;
+		if (l < self->heap_len &&
+		    self->heap[l].expires < self->heap[min].expires)
+			min = l;
+		if (r < self->heap_len &&
+		    self->heap[r].expires < self->heap[min].expires)
+			min = r;
+		if (min == i)
+			break;
+		heap_swap(&self->heap[i], &self->heap[min]);
+		i = min;
+	}
+	return top;
+}
+
+static bool workload_get(workload_t *self, workload_pattern_t pattern,
+			 uint8_t order, bool movable, frame_id_t *frame)
+{
+	llfree_result_t res =
+		bench_alloc_get(self->alloc, self->tid, order, movable);
+	self->stats.gets[pattern]++;
+	if (!llfree_is_ok(res)) {
+		self->stats.failed[pattern]++;
+		return false;
+	}
+	self->stats.held_frames += 1u << order;
+	*frame = res.frame;
+	return true;
+}
+
+static void workload_put(workload_t *self, frame_id_t frame, uint8_t order,
+			 bool movable)
+{
+	llfree_result_t ll_unused res =
+		bench_alloc_put(self->alloc, self->tid, frame, order, movable);
+	assert(llfree_is_ok(res));
+	self->stats.puts++;
+	self->stats.held_frames -= 1u << order;
+}
+
+/// Reclaim the allocations that expire first until `frames` fit into the
+/// budget, returns false if they do not fit anyway
+static bool workload_reclaim(workload_t *self, size_t frames)
+{
+	while (self->stats.held_frames + frames > self->budget) {
+		if (self->heap_len == 0)
+			return false;
+		struct workload_alloc a = heap_pop(self);
+		workload_put(self, a.frame, a.order, a.movable);
+	}
+	return true;
+}
+
+static void workload_alloc(workload_t *self, workload_pattern_t pattern,
+			   uint8_t order, bool movable, uint64_t lifetime)
+{
+	if (!workload_reclaim(self, 1u << order))
+		return;
+	frame_id_t frame;
+	if (workload_get(self, pattern, order, movable, &frame)) {
+		heap_push(self, (struct workload_alloc){
+					.expires = self->tick + lifetime,
+					.frame = frame,
+					.order = order,
+					.movable = movable,
+				});
+	}
+}
+
+static void workload_page_cache(workload_t *self)
+{
+	uint64_t lifetime = workload_zipf(self) *
+			    WORKLOAD_ZIPF_SCALE(self->budget);
+	workload_alloc(self, WORKLOAD_PAGE_CACHE, 0, true, lifetime);
+}
+
+static void workload_anon(workload_t *self)
+{
+	uint64_t r = workload_rand(self);
+	uint64_t lifetime = r % (WORKLOAD_ANON_LIFETIME(self->budget) + 1);
+	// Half of the faults hit THP eligible regions
+	if ((r >> 32) % 2 == 0 &&
+	    workload_reclaim(self, 1u << LLFREE_HUGE_ORDER)) {
+		self->stats.thp_tries++;
+		llfree_result_t res = bench_alloc_get(
+			self->alloc, self->tid, LLFREE_HUGE_ORDER, true);
+		if (llfree_is_ok(res)) {
+			self->stats.thp_hits++;
+			self->stats.held_frames += 1u << LLFREE_HUGE_ORDER;
+			heap_push(self, (struct workload_alloc){
+						.expires = self->tick + lifetime,
+						.frame = res.frame,
+						.order = LLFREE_HUGE_ORDER,
+						.movable = true,
+					});
+			return;
+		}
+	}
+	// Fall back to a single page
+	workload_alloc(self, WORKLOAD_ANON, 0, true, lifetime);
+}
+
+static void workload_slab(workload_t *self)
+{
+	uint64_t r = workload_rand(self);
+	// Most slab caches use order 0, larger objects up to order 3
+	uint8_t order = r % 4 == 0 ? (uint8_t)((r >> 2) % 4) : 0;
+	size_t burst = 1 + (r >> 8) % WORKLOAD_SLAB_BURST;
+	uint64_t lifetime =
+		(r >> 16) % (WORKLOAD_SLAB_LIFETIME(self->budget) + 1);
+	for (size_t i = 0; i < burst; i++)
+		workload_alloc(self, WORKLOAD_SLAB, order, false, lifetime);
+}
+
+static void workload_balloon(workload_t *self)
+{
+	if (self->balloon_inflate) {
+		// Prefer huge frames, like virtio-balloon with huge pages
+		size_t frames = 0;
+		while (frames < WORKLOAD_BALLOON_BATCH &&
+		       self->balloon_frames < self->balloon_target) {
+			size_t left = self->balloon_target -
+				      self->balloon_frames;
+			uint8_t order = left >= (1u << LLFREE_HUGE_ORDER) ?
+						LLFREE_HUGE_ORDER :
+						0;
+			frame_id_t frame;
+			if (!workload_reclaim(self, 1u << order) ||
+			    !workload_get(self, WORKLOAD_BALLOON, order, true,
+					  &frame)) {
+				if (order == 0)
+					break;
+				// Fall back to a single page
+				if (!workload_reclaim(self, 1) ||
+				    !workload_get(self, WORKLOAD_BALLOON, 0,
+						  true, &frame))
+					break;
+				order = 0;
+			}
+			self->balloon[self->balloon_len] = frame;
+			self->balloon_orders[self->balloon_len] = order;
+			self->balloon_len++;
+			self->balloon_frames += 1u << order;
+			frames += 1u << order;
+		}
+		if (self->balloon_frames >= self->balloon_target)
+			self->balloon_inflate = false;
+	} else {
+		size_t frames = 0;
+		while (frames < WORKLOAD_BALLOON_BATCH &&
+		       self->balloon_len > 0) {
+			self->balloon_len--;
+			uint8_t order = self->balloon_orders[self->balloon_len];
+			workload_put(self, self->balloon[self->balloon_len],
+				     order, true);
+			self->balloon_frames -= 1u << order;
+			frames += 1u << order;
+		}
+		if (self->balloon_len == 0)
+			self->balloon_inflate = true;
+	}
+}
+
+workload_t *workload_new(const bench_alloc_t *alloc, const workload_mix_t *mix,
+			 size_t tid, size_t budget)
+{
+	workload_t *self = malloc(sizeof(workload_t));
+	assert(self != NULL);
+	budget = LL_MAX(budget, (size_t)1);
+	*self = (workload_t){
+		.alloc = alloc,
+		.mix = mix,
+		.tid = tid,
+		.budget = budget,
+		.rng = 0x9e3779b97f4a7c15ull * (tid + 1),
+		.heap = malloc(sizeof(struct workload_alloc) * budget),
+		.balloon_target = budget / 4,
+		.balloon_inflate = true,
+	};
+	self->balloon = malloc(sizeof(frame_id_t) * (budget / 4 + 1));
+	self->balloon_orders = malloc(budget / 4 + 1);
+	assert(self->heap != NULL && self->balloon != NULL &&
+	       self->balloon_orders != NULL);
+
+	for (size_t p = 0; p < WORKLOAD_PATTERN_N; p++)
+		self->weight_sum += mix->weights[p];
+	assert(self->weight_sum > 0);
+
+	double sum = 0;
+	for (size_t k = 0; k < WORKLOAD_ZIPF_N; k++) {
+		sum += 1.0 / (double)(k + 1);
+		self->zipf[k] = sum;
+	}
+	for (size_t k = 0; k < WORKLOAD_ZIPF_N; k++)
+		self->zipf[k] /= sum;
+	return self;
+}
+
+void workload_step(workload_t *self)
+{
+	self->tick++;
+
+	// Free everything that expired
+	while (self->heap_len > 0 && self->heap[0].expires <= self->tick) {
+		struct workload_alloc a = heap_pop(self);
+		workload_put(self, a.frame, a.order, a.movable);
+	}
+
+	uint32_t w = (uint32_t)(workload_rand(self) % self->weight_sum);
+	workload_pattern_t pattern = 0;
+	while (w >= self->mix->weights[pattern]) {
+		w -= self->mix->weights[pattern];
+		pattern++;
+	}
+	self->stats.steps[pattern]++;
+
+	switch (pattern) {
+	case WORKLOAD_PAGE_CACHE:
+		workload_page_cache(self);
+		break;
+	case WORKLOAD_ANON:
+		workload_anon(self);
+		break;
+	case WORKLOAD_SLAB:
+		workload_slab(self);
+		break;
+	case WORKLOAD_BALLOON:
+		workload_balloon(self);
+		break;
+	default:
+		assert(false);
+	}
+}
+
+void workload_drain(workload_t *self)
+{
+	while (self->heap_len > 0) {
+		struct workload_alloc a = heap_pop(self);
+		workload_put(self, a.frame, a.order, a.movable);
+	}
+	while (self->balloon_len > 0) {
+		self->balloon_len--;
+		workload_put(self, self->balloon[self->balloon_len],
+			     self->balloon_orders[self->balloon_len], true);
+	}
+	self->balloon_frames = 0;
+	self->balloon_inflate = true;
+	assert(self->stats.held_frames == 0);
+}
+
+const workload_stats_t *workload_stats(const workload_t *self)
+{
+	return &self->stats;
+}
+
+void workload_free(workload_t *self)
+{
+	assert(self->heap_len == 0 && self->balloon_len == 0);
+	free(self->heap);
+	free(self->balloon);
+	free(self->balloon_orders);
+	free(self);
+}
+
+/// Fraction of the memory (in percent) the generators may keep allocated
+#define WORKLOAD_FILL 90
+
+struct workload_bench {
+	workload_t **gens;
+	uint64_t duration_ns;
+	uint64_t *elapsed_ns;
+};
+
+static void workload_run(size_t tid, void *ctx)
+{
+	struct workload_bench *b = ctx;
+	uint64_t start = bench_now_ns();
+	uint64_t now = start;
+	for (uint64_t i = 0;; i++) {
+		if (i % 64 == 0) {
+			now = bench_now_ns();
+			if (now - start >= b->duration_ns)
+				break;
+		}
+		workload_step(b->gens[tid]);
+	}
+	b->elapsed_ns[tid] = now - start;
+}
+
+/// Percentage of `part` in `total`
+static double workload_percent(uint64_t part, uint64_t total)
+{
+	return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+/// Run a mix on the allocator and print a table row
+static void workload_bench_mix(const bench_args_t *args,
+			       const workload_mix_t *mix,
+			       bench_alloc_kind_t kind, workload_t **gens,
+			       uint64_t *elapsed)
+{
+	bench_alloc_t alloc = bench_alloc_new(kind, args->threads, args->frames);
+	size_t budget = args->frames * WORKLOAD_FILL / 100 / args->threads;
+	for (size_t t = 0; t < args->threads; t++)
+		gens[t] = workload_new(&alloc, mix, t, budget);
+
+	struct workload_bench b = {
+		.gens = gens,
+		.duration_ns = args->duration_ms * 1000000ull,
+		.elapsed_ns = elapsed,
+	};
+	bench_parallel(args->threads, workload_run, &b);
+
+	// Measured with all allocations in place
+	ll_stats_t stats = bench_alloc_stats(&alloc);
+	ll_tree_stats_t trees = { 0 };
+	if (kind == BENCH_LLFREE)
+		trees = llfree_tree_stats(alloc.self);
+
+	workload_stats_t total = { 0 };
+	uint64_t time = 0;
+	for (size_t t = 0; t < args->threads; t++) {
+		const workload_stats_t *s = workload_stats(gens[t]);
+		for (size_t p = 0; p < WORKLOAD_PATTERN_N; p++) {
+			total.steps[p] += s->steps[p];
+			total.gets[p] += s->gets[p];
+			total.failed[p] += s->failed[p];
+		}
+		total.puts += s->puts;
+		total.thp_tries += s->thp_tries;
+		total.thp_hits += s->thp_hits;
+		time = LL_MAX(time, elapsed[t]);
+
+		workload_drain(gens[t]);
+		workload_free(gens[t]);
+	}
+
+	uint64_t ops = total.puts + total.thp_tries;
+	for (size_t p = 0; p < WORKLOAD_PATTERN_N; p++)
+		ops += total.gets[p];
+	printf("%-10s %-10s %7zu %12.0f", mix->name, bench_alloc_name(kind),
+	       args->threads, time ? (double)ops * 1e9 / (double)time : 0.0);
+	// Failed allocations of each pattern, without the THP tries
+	for (size_t p = 0; p < WORKLOAD_PATTERN_N; p++) {
+		printf(" %10.2f",
+		       workload_percent(total.failed[p], total.gets[p]));
+	}
+	// The buddy allocators have no classes
+	printf(" %7.2f %7.2f %9zu %9zu %9zu\n",
+	       workload_percent(total.thp_hits, total.thp_tries),
+	       workload_percent(stats.free_huge << LLFREE_HUGE_ORDER,
+				stats.free_frames),
+	       trees.classes[0].alloc_frames, trees.classes[1].alloc_frames,
+	       trees.classes[2].alloc_frames);
+
+	bench_alloc_drop(&alloc);
+}
+
+/// Run the kernel-like allocation patterns on their own and mixed, on
+/// llfree and the buddy baselines, reporting throughput, failures per
+/// pattern, the THP success rate of anonymous faults, and the availability
+/// of huge frames at the end.
+declare_bench(workload)
+{
+	workload_t **gens = malloc(sizeof(workload_t *) * args->threads);
+	uint64_t *elapsed = malloc(sizeof(uint64_t) * args->threads);
+	assert(gens != NULL && elapsed != NULL);
+
+	printf("%-10s %-10s %7s %12s", "mix", "alloc", "threads", "ops/s");
+	for (size_t p = 0; p < WORKLOAD_PATTERN_N; p++)
+		printf(" %9s%%", workload_pattern_name(p));
+	printf(" %7s %7s %9s %9s %9s\n", "thp%", "huge%", "c0_alloc",
+	       "c1_alloc", "c2_alloc");
+
+	for (size_t m = 0; m < WORKLOAD_MIXES_N; m++) {
+		for (size_t a = 0; a < BENCH_ALLOC_N; a++) {
+			workload_bench_mix(args, &WORKLOAD_MIXES[m],
+					   (bench_alloc_kind_t)a, gens,
+					   elapsed);
+		}
+	}
+	free(gens);
+	free(elapsed);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "bench.h"
+
+/// Allocation patterns of the synthetic kernel-like workload
+typedef enum workload_pattern {
+	/// Movable order 0 page-cache pages with Zipf distributed lifetimes
+	WORKLOAD_PAGE_CACHE = 0,
+	/// Movable anonymous faults, trying a THP (huge order) first and
+	/// falling back to order 0
+	WORKLOAD_ANON = 1,
+	/// Bursts of immovable order 0-3 slab pages with a shared lifetime
+	WORKLOAD_SLAB = 2,
+	/// A guest balloon that inflates with huge (or order 0) frames up to a
+	/// quarter of the budget and deflates again
+	WORKLOAD_BALLOON = 3,
+	WORKLOAD_PATTERN_N = 4,
+} workload_pattern_t;
+
+static inline ll_unused const char *
+workload_pattern_name(workload_pattern_t pattern)
+{
+	static const char *const NAMES[] = { "pagecache", "anon", "slab",
+					     "balloon" };
+	return pattern < WORKLOAD_PATTERN_N ? NAMES[pattern] : "invalid";
+}
+
+/// Relative frequencies of the patterns
+typedef struct workload_mix {
+	const char *name;
+	uint16_t weights[WORKLOAD_PATTERN_N];
+} workload_mix_t;
+
+/// Predefined mixes: every pattern on its own, followed by production-like
+/// combinations of them
+extern const workload_mix_t WORKLOAD_MIXES[];
+extern const size_t WORKLOAD_MIXES_N;
+
+/// Counters of a generator
+typedef struct workload_stats {
+	/// Steps of each pattern
+	uint64_t steps[WORKLOAD_PATTERN_N];
+	/// Allocations and failed allocations of each pattern, without the
+	/// huge allocations of anonymous faults
+	uint64_t gets[WORKLOAD_PATTERN_N];
+	uint64_t failed[WORKLOAD_PATTERN_N];
+	uint64_t puts;
+	/// Attempted and successful huge allocations of anonymous faults
+	uint64_t thp_tries;
+	uint64_t thp_hits;
+	/// Frames that are currently allocated
+	size_t held_frames;
+} workload_stats_t;
+
+/// Generator of a single thread, allocations are mapped onto the classes
+/// of llfree_classing_movable with llfree_movable_request
+typedef struct workload workload_t;
+
+/// Create a generator for thread `tid` that keeps at most `budget` frames
+/// allocated, reclaiming the oldest allocations under pressure
+workload_t *workload_new(const bench_alloc_t *alloc, const workload_mix_t *mix,
+			 size_t tid, size_t budget);
+/// Execute a single step of a randomly selected pattern
+void workload_step(workload_t *self);
+/// Free all frames that are still allocated
+void workload_drain(workload_t *self);
+const workload_stats_t *workload_stats(const workload_t *self);
+/// Free the generator, which has to be drained
+void workload_free(workload_t *self);
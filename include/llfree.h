@@ -61,6 +61,8 @@ enum : uint8_t {
 	LLFREE_ERR_ARGUMENT = 2,
 	/// Allocator not initialized or initialization failed
 	LLFREE_ERR_INIT = 3,
+	/// Frame is not allocated (double free), misaligned or out of range
+	LLFREE_ERR_ADDRESS = 4,
 };
 
 /// Result type for llfree_get: includes the class of the allocated frame
@@ -223,15 +225,63 @@ llfree_meta_size_t llfree_metadata_size_of(const llfree_t *self);
 /// If frame is present, allocates that specific frame (get_at behavior);
 /// otherwise allocates any frame near the local slot's preferred location.
 /// Set request.local to ll_none() for global-only allocation.
+/// Gigantic frames (LLFREE_TREE_ORDER < order <= LLFREE_GIGANTIC_ORDER) take
+/// an aligned run of entirely free trees, skipping reserved trees, which can
+/// be released with llfree_drain.
 llfree_result_t llfree_get(llfree_t *self, frame_id_optional_t frame,
 			   llfree_request_t request);
+/// Allocates up to `n` frames of the same request at once and writes them to
+/// `out`, returning their number (0 if the request is invalid).
+/// Frames of order <= 6 are taken from the local reservation with a single
+/// CAS per bitfield row and child and a single update of the local counter,
+/// the remaining ones are allocated like with llfree_get.
+size_t llfree_get_batch(llfree_t *self, llfree_request_t request,
+			frame_id_t *out, size_t n);
 /// Frees a frame
 llfree_result_t llfree_put(llfree_t *self, frame_id_t frame,
 			   llfree_request_t request);
+/// Frees the frames of the same request, returning the number of frames that
+/// were freed before the first invalid one.
+/// Consecutive frames of the same tree, child and bitfield row are freed with
+/// a single update of the respective counter or row, so passing them sorted
+/// reduces the number of atomic operations.
+size_t llfree_put_batch(llfree_t *self, llfree_request_t request,
+			const frame_id_t *frames, size_t n);
+
+/// Allocates `nframes` physically contiguous frames, which do not have to be
+/// a power of two and may span multiple trees, starting at a multiple of
+/// `align` (a power of two). The range is allocated as a sequence of aligned
+/// blocks of up to LLFREE_TREE_ORDER, trees whose counters cannot cover
+/// their part of a range are skipped. The frames of reserved trees are
+/// counted as well and stolen from the local reservations if needed.
+llfree_result_t llfree_get_contig(llfree_t *self, size_t nframes, size_t align,
+				  uint8_t class);
+/// Frees a range allocated with llfree_get_contig.
+/// Fails with LLFREE_ERR_ADDRESS without freeing anything if the range is out
+/// of bounds or not allocated as the same sequence of blocks.
+llfree_result_t llfree_put_contig(llfree_t *self, frame_id_t frame,
+				  size_t nframes, uint8_t class);
+
+/// Allocates a run of `len` <= 64 contiguous order 0 frames within a bitfield
+/// row, which does not have to be a power of two. The run starts at a
+/// multiple of `align` (a power of two <= 64), request.order has to be 0.
+/// Like llfree_get, it uses the local reservation of the request and falls
+/// back to reserving a new tree and stealing from other reservations.
+/// The run is traced as a single LLFREE_TRACE_GET_RUN event.
+llfree_result_t llfree_get_run(llfree_t *self, llfree_request_t request,
+			       size_t len, size_t align);
+/// Frees a run allocated with llfree_get_run
+llfree_result_t llfree_put_run(llfree_t *self, frame_id_t frame,
+			       llfree_request_t request, size_t len);
 
 /// Unreserves all local reservations.
 void llfree_drain(llfree_t *self);
 
+/// Frees the frames that are held back by the local slots, buffered
+/// (LLFREE_DEFERRED_FREE), cached in magazines (LLFREE_MAGAZINE) or in owned
+/// rows (LLFREE_ENABLE_OWNED_ROWS).
+void llfree_flush(llfree_t *self);
+
 /// Match conditions for llfree_change_tree.
 typedef struct llfree_tree_match {
 	/// Match a specific tree index (ll_none() for any tree).
@@ -310,6 +360,189 @@ void llfree_print(const llfree_t *self);
 /// Validate the internal data structures
 void llfree_validate(const llfree_t *self);
 
+// == Hooks ==
+
+/// Allocation events that can be hooked
+typedef enum llfree_event {
+	/// A tree was reserved for a local slot
+	LLFREE_EVENT_RESERVE = 0,
+	/// A reserved tree was returned to the global tree array
+	LLFREE_EVENT_UNRESERVE = 1,
+	/// A huge frame was split to free a part of it
+	LLFREE_EVENT_SPLIT_HUGE = 2,
+	/// A child (huge frame sized region) became entirely free
+	LLFREE_EVENT_CHILD_FREE = 3,
+	/// A tree was demoted to the class of an allocation
+	LLFREE_EVENT_DEMOTE = 4,
+	/// An allocation failed with LLFREE_ERR_MEMORY
+	LLFREE_EVENT_OOM = 5,
+	LLFREE_EVENT_MAX = 6,
+} llfree_event_t;
+
+/// Details of an event
+typedef struct llfree_event_info {
+	llfree_event_t event;
+	/// First frame of the tree (reserve, unreserve, demote),
+	/// the huge frame (split, child free), or the requested frame (OOM)
+	frame_id_t frame;
+	/// Class of the tree or request
+	uint8_t class;
+	/// Former class of a demoted tree
+	uint8_t old_class;
+	/// Order of the failed allocation (OOM)
+	uint8_t order;
+} llfree_event_info_t;
+
+/// Event hook, called synchronously on the thread that caused the event.
+/// Hooks may run in the middle of an operation and must not call into the
+/// allocator.
+typedef void (*llfree_hook_fn)(const llfree_event_info_t *info, void *ctx);
+
+/// Register a hook for the event or remove it with `fn` = NULL.
+/// Only has an effect if compiled with LLFREE_ENABLE_HOOKS (default),
+/// unused hooks cost a single branch.
+/// Must not be called concurrently with other operations on the allocator,
+/// which could otherwise call the old hook with the new context.
+void llfree_set_hook(llfree_t *self, llfree_event_t event, llfree_hook_fn fn,
+		     void *ctx);
+
+// == Metrics ==
+
+/// Path that served a llfree_get or llfree_put
+typedef enum llfree_path {
+	/// Served by the local reservation
+	LLFREE_PATH_LOCAL = 0,
+	/// Reserved a new tree (search_and_reserve)
+	LLFREE_PATH_RESERVE = 1,
+	/// Global tree, without (or bypassing) a local reservation
+	LLFREE_PATH_GLOBAL = 2,
+	/// Stolen from another local reservation (steal_local)
+	LLFREE_PATH_STEAL = 3,
+	/// Demoted another local reservation (demote_local)
+	LLFREE_PATH_DEMOTE = 4,
+	/// The operation failed
+	LLFREE_PATH_FAILED = 5,
+	/// The number of paths
+	LLFREE_PATH_MAX = 6,
+} llfree_path_t;
+
+/// Number of log-buckets, four per power of two nanoseconds (up to ~4s)
+#define LLFREE_HIST_BUCKETS 128u
+
+/// Log-bucketed latency histogram
+typedef struct llfree_hist {
+	uint64_t buckets[LLFREE_HIST_BUCKETS];
+} llfree_hist_t;
+
+/// Latency histograms, broken down by order and by path
+typedef struct llfree_histograms {
+	llfree_hist_t get_path[LLFREE_PATH_MAX];
+	llfree_hist_t get_order[LLFREE_MAX_ORDER + 1];
+	llfree_hist_t put_path[LLFREE_PATH_MAX];
+	llfree_hist_t put_order[LLFREE_MAX_ORDER + 1];
+} llfree_histograms_t;
+
+/// Snapshot the latency histograms of a single core or, if `core` is none,
+/// the sum over all cores.
+/// The core is the cpu reported by the platform (`llfree_cpu`), platforms
+/// without it shard the histograms by thread instead.
+/// The histograms are process-global and shared by all allocator instances.
+/// Only records if compiled with LLFREE_ENABLE_HISTOGRAMS, otherwise all zero.
+void llfree_histograms(llfree_histograms_t *out, ll_optional_t core);
+/// Reset the latency histograms of all cores, for every allocator instance
+void llfree_histograms_reset(void);
+/// Lower bound of a histogram bucket in nanoseconds
+uint64_t llfree_hist_bucket_ns(size_t bucket);
+/// Number of recorded operations in the histogram
+uint64_t llfree_hist_count(const llfree_hist_t *hist);
+/// Latency in nanoseconds below which `permille`/1000 of the operations are
+/// (lower bound of the bucket)
+uint64_t llfree_hist_quantile(const llfree_hist_t *hist, size_t permille);
+
+/// Traced operations
+typedef enum llfree_trace_op {
+	LLFREE_TRACE_GET = 0,
+	LLFREE_TRACE_PUT = 1,
+	/// llfree_get_run and llfree_put_run
+	LLFREE_TRACE_GET_RUN = 2,
+	LLFREE_TRACE_PUT_RUN = 3,
+	/// llfree_get_contig and llfree_put_contig
+	LLFREE_TRACE_GET_CONTIG = 4,
+	LLFREE_TRACE_PUT_CONTIG = 5,
+} llfree_trace_op_t;
+
+/// A single traced call
+typedef struct llfree_trace_event {
+	llfree_trace_op_t op;
+	/// Frame argument of the call (freed or explicitly requested frame)
+	frame_id_optional_t frame;
+	llfree_request_t request;
+	/// Number of frames and alignment of runs and ranges, 0 for other
+	/// operations
+	size_t len;
+	size_t align;
+	llfree_result_t result;
+} llfree_trace_event_t;
+
+/// Trace sink, called on the calling thread after each traced operation
+typedef void (*llfree_trace_fn)(const llfree_trace_event_t *event, void *ctx);
+
+/// Set the trace sink of the allocator or clear it with `fn` = NULL.
+/// Only has an effect if compiled with LLFREE_ENABLE_TRACE.
+/// Must not be called concurrently with other operations on the allocator,
+/// which could otherwise call the old sink with the new context.
+void llfree_set_trace(llfree_t *self, llfree_trace_fn fn, void *ctx);
+
+/// Contention on the metadata of a single tree
+typedef struct llfree_tree_contention {
+	tree_id_t tree;
+	/// Failed CAS attempts on the tree entry
+	uint64_t tree_cas;
+	/// Failed CAS attempts on the children of the tree
+	uint64_t child_cas;
+} llfree_tree_contention_t;
+
+/// Write the up to `len` most contended trees to `out`, sorted by their
+/// failed CAS attempts in descending order. Returns the number of trees.
+/// Only counts if compiled with LLFREE_ENABLE_CONTENTION, otherwise returns 0.
+size_t llfree_contention(const llfree_t *self, llfree_tree_contention_t *out,
+			 size_t len);
+/// Reset the contention counters of all trees
+void llfree_contention_reset(llfree_t *self);
+
+/// Slow-path event counters, summed over all cores
+typedef struct llfree_counters {
+	/// Failed CAS attempts that were retried in atom_update
+	uint64_t cas_retries;
+	/// Trees visited by trees_search_best
+	uint64_t search_visits;
+	/// Successful syncs of a local reservation with its global tree
+	uint64_t sync_global;
+	/// Reservations of a new tree (swap_reserved)
+	uint64_t swap_reserved;
+	/// Allocations served by stealing from other local reservations
+	uint64_t steal_local;
+	/// Allocations served by demoting other local reservations
+	uint64_t demote_local;
+	/// Frees that had to wait for a concurrent split of a huge frame
+	uint64_t split_huge_waits;
+	/// Partially claimed huge frames that had to be rolled back
+	uint64_t huge_rollbacks;
+	/// Partially claimed bitfield rows (order 7 and 8) that had to be
+	/// rolled back
+	uint64_t field_rollbacks;
+} llfree_counters_t;
+
+/// Sum the event counters over all cores, without stopping allocations.
+/// Like the histograms, they are sharded by the cpu of the platform
+/// (`llfree_cpu`), or by thread if it does not provide one.
+/// The counters are process-global and shared by all allocator instances,
+/// as some events are counted in helpers without access to the allocator.
+/// Only counts if compiled with LLFREE_ENABLE_COUNTERS, otherwise all zero.
+llfree_counters_t llfree_counters(void);
+/// Reset the event counters of all cores, for every allocator instance
+void llfree_counters_reset(void);
+
 // == Example Classing ==
 
 /// Simple 2-class policy (small=0, huge=1)
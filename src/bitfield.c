@@ -1,4 +1,5 @@
 #include "bitfield.h"
+#include "metrics.h"
 
 /// Helping struct to store the position of a bit in a bitfield.
 typedef struct pos {
@@ -92,6 +93,131 @@ bool first_zeros_aligned(uint64_t *v, size_t order, size_t *pos)
 	// NOLINTEND(readability-magic-numbers)
 }
 
+/// Set the first `len` <= 64 zero bits that start at a multiple of `align`,
+/// returning the bit offset. Unlike first_zeros_aligned, the length does not
+/// have to be a power of two.
+bool first_zeros_run(uint64_t *v, size_t len, size_t align,
+		     size_t *pos); // used in tests
+bool first_zeros_run(uint64_t *v, size_t len, size_t align, size_t *pos)
+{
+	assert(len > 0 && len <= LLFREE_ATOMIC_SIZE);
+	assert(align > 0 && align <= LLFREE_ATOMIC_SIZE &&
+	       (align & (align - 1)) == 0);
+
+	// Reduce each run of `len` zero bits to its lowest bit
+	uint64_t starts = ~*v;
+	for (size_t run = 1; run < len;) {
+		size_t shift = LL_MIN(run, len - run);
+		starts &= starts >> shift;
+		run += shift;
+	}
+	// Every `align`th bit
+	starts &= UINT64_MAX / (UINT64_MAX >> (LLFREE_ATOMIC_SIZE - align));
+
+	size_t p = trailing_zeros(starts);
+	if (p >= LLFREE_ATOMIC_SIZE)
+		return false;
+	*v |= (UINT64_MAX >> (LLFREE_ATOMIC_SIZE - len)) << p;
+	*pos = p;
+	return true;
+}
+
+#if LLFREE_ENABLE_SIMD
+/// All rows of a bitfield, the operations are translated into AVX-512,
+/// AVX2 or NEON instructions by the compiler
+typedef uint64_t rows_v __attribute__((vector_size(sizeof(uint64_t) *
+						     FIELD_N)));
+
+/// Bits at the aligned start positions of the given order in a row
+static const uint64_t ALIGNED_STARTS[LLFREE_ATOMIC_ORDER + 1] = {
+	0xffffffffffffffffllu, 0x5555555555555555llu, 0x1111111111111111llu,
+	0x0101010101010101llu, 0x0001000100010001llu, 0x0000000100000001llu,
+	0x0000000000000001llu,
+};
+
+/// Returns a bitmask of the rows that contain aligned free bits of the given
+/// order, or are entirely free for orders larger than a row.
+///
+/// This is only a hint: the rows are read all at once and not atomically,
+/// each candidate is afterwards updated with a CAS.
+static uint32_t field_candidates(bitfield_t *field, size_t order)
+{
+	rows_v rows;
+	__builtin_memcpy(&rows, (const void *)field->rows, sizeof(rows));
+
+	rows_v free = ~rows;
+	if (order <= LLFREE_ATOMIC_ORDER) {
+		// Reduce each run of 2^order free bits to its lowest bit
+		for (size_t i = 0; i < order; i++)
+			free &= free >> (1u << i);
+		free &= ALIGNED_STARTS[order];
+	} else {
+		free = (rows_v)(rows == 0);
+	}
+
+	uint32_t mask = 0;
+	for (size_t i = 0; i < FIELD_N; i++)
+		mask |= (uint32_t)(free[i] != 0) << i;
+	return mask;
+}
+#else
+static uint32_t field_candidates(bitfield_t *field, size_t order)
+{
+	(void)field;
+	(void)order;
+	return (1u << FIELD_N) - 1;
+}
+#endif
+
+#if LLFREE_ENABLE_WIDE_CAS
+/// Rows that are updated with a single CAS
+#define SWAP_ROWS 2u
+_Static_assert(sizeof(bitfield_t) % (SWAP_ROWS * sizeof(uint64_t)) == 0,
+	       "wide cas alignment");
+
+static bool rows_cmp_exchange(bitfield_t *field, size_t row, uint64_t from,
+			      uint64_t to)
+{
+	// Both values are either 0 or UINT64_MAX, so the order of the
+	// halves does not matter
+	unsigned __int128 expected = ((unsigned __int128)from << 64) | from;
+	unsigned __int128 desired = ((unsigned __int128)to << 64) | to;
+	return atom_cmp_exchange_wide(&field->rows[row], expected, desired);
+}
+#else
+#define SWAP_ROWS 1u
+
+static bool rows_cmp_exchange(bitfield_t *field, size_t row, uint64_t from,
+			      uint64_t to)
+{
+	return atom_cmp_exchange(&field->rows[row], &from, to);
+}
+#endif
+
+/// Change `entries` consecutive rows from `from` to `to`, which are either
+/// 0 or UINT64_MAX. Partial updates are undone on failure.
+static bool rows_swap(bitfield_t *field, size_t row, size_t entries,
+		      uint64_t from, uint64_t to)
+{
+	assert(entries % SWAP_ROWS == 0 && row % SWAP_ROWS == 0);
+	for (size_t i = 0; i < entries; i += SWAP_ROWS) {
+		if (rows_cmp_exchange(field, row + i, from, to))
+			continue;
+
+		// Undo changes
+		if (i > 0)
+			metrics_count(METRICS_FIELD_ROLLBACK, 1);
+		for (size_t j = 0; j < i; j += SWAP_ROWS) {
+			if (!rows_cmp_exchange(field, row + j, to, from)) {
+				llfree_warn("Undo failed!");
+				assert(false);
+			}
+		}
+		return false;
+	}
+	return true;
+}
+
 llfree_result_t field_set_next(bitfield_t *field, frame_id_t start_frame,
 			       size_t order)
 {
@@ -99,9 +225,15 @@ llfree_result_t field_set_next(bitfield_t *field, frame_id_t start_frame,
 	assert(num_frames < LLFREE_CHILD_SIZE);
 
 	uint64_t row = row_from_frame(start_frame).value % FIELD_N;
+	// Skip the rows that cannot satisfy the request
+	uint32_t candidates = field_candidates(field, order);
+	if (candidates == 0)
+		return llfree_err(LLFREE_ERR_MEMORY);
 
 	if (num_frames <= LLFREE_ATOMIC_SIZE) {
 		for_offsetted(row, FIELD_N, current_i) {
+			if ((candidates & (1u << current_i)) == 0)
+				continue;
 			size_t pos = 0;
 			uint64_t old;
 			if (atom_update(&field->rows[current_i], old,
@@ -116,31 +248,12 @@ llfree_result_t field_set_next(bitfield_t *field, frame_id_t start_frame,
 	}
 
 	size_t entries = num_frames / LLFREE_ATOMIC_SIZE;
+	uint32_t group = (1u << entries) - 1;
 	for_offsetted(row / entries, FIELD_N / entries, current_i) {
-		bool failed = false;
-		for (size_t i = 0; i < entries; i++) {
-			size_t idx = (current_i * entries) + i;
-			uint64_t old = 0;
-			if (atom_cmp_exchange(&field->rows[idx], &old,
-					      UINT64_MAX)) {
-				continue;
-			}
-
-			// Undo changes
-			for (size_t j = 0; j < i; j++) {
-				size_t idx = (current_i * entries) + j;
-				uint64_t old = UINT64_MAX;
-				if (!atom_cmp_exchange(&field->rows[idx], &old,
-						       0)) {
-					llfree_warn("Undo failed!");
-					assert(false);
-				}
-			}
-			failed = true;
-			break; // check next slot
-		}
-		if (!failed) {
-			// Success, we have updated all rows
+		if (((candidates >> (current_i * entries)) & group) != group)
+			continue;
+		if (rows_swap(field, current_i * entries, entries, 0,
+			      UINT64_MAX)) {
 			return llfree_ok(frame_id(current_i * entries *
 						  LLFREE_ATOMIC_SIZE),
 					 0);
@@ -150,6 +263,92 @@ llfree_result_t field_set_next(bitfield_t *field, frame_id_t start_frame,
 	return llfree_err(LLFREE_ERR_MEMORY);
 }
 
+llfree_result_t field_set_next_run(bitfield_t *field, frame_id_t start_frame,
+				   size_t len, size_t align)
+{
+	uint64_t row = row_from_frame(start_frame).value % FIELD_N;
+	for_offsetted(row, FIELD_N, current_i) {
+		size_t pos = 0;
+		uint64_t old;
+		if (atom_update(&field->rows[current_i], old, first_zeros_run,
+				len, align, &pos)) {
+			return llfree_ok(
+				frame_id(current_i * LLFREE_ATOMIC_SIZE + pos),
+				0);
+		}
+	}
+	return llfree_err(LLFREE_ERR_MEMORY);
+}
+
+/// Set up to `max` aligned 2^`order` zero bits, `set` are the changed bits
+static bool row_set_n(uint64_t *row, size_t order, size_t max, uint64_t *set)
+{
+	uint64_t old = *row;
+	size_t pos;
+	for (size_t i = 0; i < max; i++) {
+		if (!first_zeros_aligned(row, order, &pos))
+			break;
+	}
+	*set = *row ^ old;
+	return *set != 0;
+}
+
+size_t field_set_next_n(bitfield_t *field, frame_id_t start_frame,
+			size_t order, frame_id_t *out, size_t n)
+{
+	assert(order <= LLFREE_ATOMIC_ORDER);
+
+	uint64_t row = row_from_frame(start_frame).value % FIELD_N;
+	uint32_t candidates = field_candidates(field, order);
+
+	size_t count = 0;
+	for_offsetted(row, FIELD_N, current_i) {
+		if (count == n)
+			break;
+		if ((candidates & (1u << current_i)) == 0)
+			continue;
+		uint64_t old;
+		uint64_t set = 0;
+		if (!atom_update(&field->rows[current_i], old, row_set_n, order,
+				 n - count, &set))
+			continue;
+		// The lowest bit of every set block is its frame
+		for (; set != 0; set &= set - 1) {
+			size_t bit = trailing_zeros(set);
+			if (bit % (1u << order) == 0)
+				out[count++] = frame_id(
+					(current_i * LLFREE_ATOMIC_SIZE) + bit);
+		}
+	}
+	return count;
+}
+
+/// Set up to `max` of the lowest zero bits, `set` are the changed bits
+static bool row_claim(uint64_t *row, size_t max, uint64_t *set)
+{
+	uint64_t free = ~*row;
+	while (count_ones(free) > max)
+		free &= ~(1ull << (63 - leading_zeros(free)));
+	*row |= free;
+	*set = free;
+	return free != 0;
+}
+
+uint64_t field_claim_row(bitfield_t *field, size_t start_row, size_t max,
+			 size_t *row)
+{
+	for_offsetted(start_row % FIELD_N, FIELD_N, current_i) {
+		uint64_t old;
+		uint64_t set = 0;
+		if (atom_update(&field->rows[current_i], old, row_claim, max,
+				&set)) {
+			*row = current_i;
+			return set;
+		}
+	}
+	return 0;
+}
+
 static bool row_toggle(uint64_t *row, uint64_t mask, bool expected)
 {
 	if (expected) {
@@ -175,25 +374,11 @@ llfree_result_t field_toggle(bitfield_t *field, size_t index, size_t order,
 	size_t num_frames = 1 << order;
 
 	if (num_frames > LLFREE_ATOMIC_SIZE) {
-		size_t num_entries = (1 << order) / LLFREE_ATOMIC_SIZE;
-		for (size_t i = 0; i < num_entries; i++) {
-			uint64_t mask = expected ? UINT64_MAX : 0;
-			uint64_t old = mask;
-			if (atom_cmp_exchange(&field->rows[pos.row + i], &old,
-					      ~mask)) {
-				continue;
-			}
-
-			// undo
-			for (size_t j = 0; j < i; j++) {
-				bool success = atom_cmp_exchange(
-					&field->rows[pos.row + i - j - 1],
-					&mask, ~mask);
-				assert(success);
-			}
-			return llfree_err(LLFREE_ERR_MEMORY);
-		}
-		return llfree_err(LLFREE_ERR_OK);
+		size_t entries = num_frames / LLFREE_ATOMIC_SIZE;
+		uint64_t from = expected ? UINT64_MAX : 0;
+		if (rows_swap(field, pos.row, entries, from, ~from))
+			return llfree_err(LLFREE_ERR_OK);
+		return llfree_err(LLFREE_ERR_MEMORY);
 	}
 
 	uint64_t mask =
@@ -206,6 +391,14 @@ llfree_result_t field_toggle(bitfield_t *field, size_t index, size_t order,
 	return llfree_err(LLFREE_ERR_MEMORY);
 }
 
+bool field_toggle_row(bitfield_t *field, size_t row, uint64_t mask,
+		      bool expected)
+{
+	assert(row < FIELD_N);
+	uint64_t old;
+	return atom_update(&field->rows[row], old, row_toggle, mask, expected);
+}
+
 size_t field_count_ones(bitfield_t *field)
 {
 	size_t counter = 0;
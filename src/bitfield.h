@@ -19,10 +19,30 @@ void field_init(bitfield_t *self);
 llfree_result_t field_set_next(bitfield_t *field, frame_id_t start_frame,
 			       size_t order);
 
+/// Atomic search for up to `n` free blocks of 2^`order` <= 64 frames,
+/// with a single CAS per row. The indices of the blocks are written to `out`
+/// and their number is returned.
+size_t field_set_next_n(bitfield_t *field, frame_id_t start_frame,
+			size_t order, frame_id_t *out, size_t n);
+
+/// Atomic search for `len` <= 64 consecutive zero bits within a row, starting
+/// at a multiple of `align`, which are set to 1.
+llfree_result_t field_set_next_run(bitfield_t *field, frame_id_t start_frame,
+				   size_t len, size_t align);
+
 /// Atomically resets the bit at index position
 llfree_result_t field_toggle(bitfield_t *field, size_t index, size_t order,
 			     bool expected);
 
+/// Atomically sets up to `max` zero bits of the first row at or after
+/// `start_row` that has any, returning the set bits and their `row`
+uint64_t field_claim_row(bitfield_t *field, size_t start_row, size_t max,
+			 size_t *row);
+
+/// Atomically toggles all bits of `mask` in a row if they are `expected`
+bool field_toggle_row(bitfield_t *field, size_t row, uint64_t mask,
+		      bool expected);
+
 /// Count the number of bits
 size_t field_count_ones(bitfield_t *field);
 
@@ -11,6 +11,33 @@ bool child_inc(child_t *self, size_t order)
 	return true;
 }
 
+bool child_inc_at(child_t *self, size_t order, size_t frame)
+{
+	if (!child_inc(self, order))
+		return false;
+#if LLFREE_ENABLE_ROW_SUMMARY
+	self->full &= ~child_rows(order, frame);
+#else
+	(void)frame;
+#endif
+	return true;
+}
+
+bool child_inc_n(child_t *self, size_t order, size_t n, uint32_t rows)
+{
+	size_t num_pages = n << order;
+	if (self->huge || self->free + num_pages > LLFREE_CHILD_SIZE)
+		return false;
+
+	self->free = (child_bits_t)(self->free + num_pages);
+#if LLFREE_ENABLE_ROW_SUMMARY
+	self->full &= ~rows;
+#else
+	(void)rows;
+#endif
+	return true;
+}
+
 bool child_dec(child_t *self, size_t order)
 {
 	uint16_t num_pages = (uint16_t)(1u << order);
@@ -20,3 +47,40 @@ bool child_dec(child_t *self, size_t order)
 	}
 	return false;
 }
+
+bool child_dec_n(child_t *self, size_t order, size_t n)
+{
+	size_t num_pages = n << order;
+	if (self->huge || self->free < num_pages)
+		return false;
+	self->free = (child_bits_t)(self->free - num_pages);
+	return true;
+}
+
+#if LLFREE_ENABLE_ROW_SUMMARY
+bool child_set_full(child_t *self, uint32_t rows)
+{
+	if (self->huge || (self->full & rows) == rows)
+		return false;
+	self->full |= rows;
+	return true;
+}
+
+bool child_clear_full(child_t *self, uint32_t rows)
+{
+	if ((self->full & rows) == 0)
+		return false;
+	self->full &= ~rows;
+	return true;
+}
+#endif
+
+bool child_dec_up_to(child_t *self, size_t order, size_t max, size_t *taken)
+{
+	size_t blocks = LL_MIN((size_t)self->free >> order, max);
+	if (self->huge || blocks == 0)
+		return false;
+	self->free = (child_bits_t)(self->free - (blocks << order));
+	*taken = blocks;
+	return true;
+}
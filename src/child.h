@@ -2,17 +2,37 @@
 
 #include "utils.h"
 
-#define CHILD_FREE_BITS ((sizeof(uint16_t) * 8) - 1)
+/// Number of bitfield rows of a child
+#define CHILD_ROWS (LLFREE_CHILD_SIZE / LLFREE_ATOMIC_SIZE)
+#define CHILD_ROWS_ALL ((1u << CHILD_ROWS) - 1)
+
+#if LLFREE_ENABLE_ROW_SUMMARY
+/// Raw representation of a child, which is also what the CAS compares
+typedef uint32_t child_bits_t;
+/// The counter uses all remaining bits, there must be no padding bits as
+/// the children are compared with CAS
+#define CHILD_FREE_BITS ((sizeof(child_bits_t) * 8) - 1 - CHILD_ROWS)
+#else
+/// Raw representation of a child, which is also what the CAS compares
+typedef uint16_t child_bits_t;
+#define CHILD_FREE_BITS ((sizeof(child_bits_t) * 8) - 1)
+#endif
 _Static_assert(CHILD_FREE_BITS > LLFREE_CHILD_ORDER, "child counter size");
 
 /// Index entry for every bitfield
 typedef struct child {
 	/// Counter for free base frames in this region
-	uint16_t free : CHILD_FREE_BITS;
+	child_bits_t free : CHILD_FREE_BITS;
 	/// Whether this has been allocated as a single huge page
 	bool huge : 1;
+#if LLFREE_ENABLE_ROW_SUMMARY
+	/// Summary of the bitfield: a bit for every row that was full after the
+	/// last allocation from it, cleared if a frame of the row is freed.
+	/// This is only a search hint, the bitfield is authoritative.
+	uint32_t full : CHILD_ROWS;
+#endif
 } child_t;
-_Static_assert(sizeof(child_t) == sizeof(uint16_t), "child size mismatch");
+_Static_assert(sizeof(child_t) == sizeof(child_bits_t), "child size mismatch");
 
 /// Initializes the child entry with the given parameters
 static inline child_t ll_unused child_new(uint16_t free, bool huge)
@@ -25,5 +45,51 @@ static inline child_t ll_unused child_new(uint16_t free, bool huge)
 /// Increment the free counter if possible
 bool child_inc(child_t *self, size_t order);
 
+/// Increment the free counter for frames freed at `frame` (child relative)
+/// and remove their rows from the full summary
+bool child_inc_at(child_t *self, size_t order, size_t frame);
+
+/// Increment the free counter by `n` blocks of 2^order frames if possible
+/// and remove `rows` from the full summary
+bool child_inc_n(child_t *self, size_t order, size_t n, uint32_t rows);
+
 /// Decrement the free counter if possible
 bool child_dec(child_t *self, size_t order);
+
+/// Decrement the free counter by `n` blocks of 2^order frames if possible
+bool child_dec_n(child_t *self, size_t order, size_t n);
+
+/// Decrement the free counter by up to `max` blocks of 2^order frames,
+/// `taken` is set to their number
+bool child_dec_up_to(child_t *self, size_t order, size_t max, size_t *taken);
+
+#if LLFREE_ENABLE_ROW_SUMMARY
+/// Add the rows to the full summary, fails if they are already contained
+bool child_set_full(child_t *self, uint32_t rows);
+
+/// Remove the rows from the full summary, fails if none of them is contained
+bool child_clear_full(child_t *self, uint32_t rows);
+#endif
+
+/// Rows that are covered by 2^order frames at `frame` (child relative)
+static inline uint32_t ll_unused child_rows(size_t order, size_t frame)
+{
+	size_t rows = LL_MAX((size_t)1, (1u << order) / LLFREE_ATOMIC_SIZE);
+	return (uint32_t)((1u << rows) - 1)
+	       << ((frame % LLFREE_CHILD_SIZE) / LLFREE_ATOMIC_SIZE);
+}
+
+/// Returns the first row at or after `row` (wrapping around) that is not
+/// marked as full, or `row` if all are marked
+static inline size_t ll_unused child_next_row(child_t self, size_t row)
+{
+#if LLFREE_ENABLE_ROW_SUMMARY
+	for_offsetted(row, CHILD_ROWS, current_i) {
+		if ((self.full & (1u << current_i)) == 0)
+			return current_i;
+	}
+#else
+	(void)self;
+#endif
+	return row;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "llfree.h"
+#include "llfree_platform.h"
+
+/// A registered event hook
+typedef struct hook {
+	_Atomic(llfree_hook_fn) fn;
+	void *_Atomic ctx;
+} hook_t;
+
+/// Hooks for all events, stored in the volatile tree metadata
+typedef struct hooks {
+	hook_t events[LLFREE_EVENT_MAX];
+} hooks_t;
+
+#if LLFREE_ENABLE_HOOKS
+
+/// Used by modules that are not part of an allocator (e.g., in tests)
+static const hooks_t HOOKS_NONE = { 0 };
+
+/// Returns whether a hook is registered for the event
+static inline ll_unused bool hooks_active(const hooks_t *self,
+					  llfree_event_t event)
+{
+	return unlikely(atomic_load_explicit(&self->events[event].fn,
+					     memory_order_acquire) != NULL);
+}
+
+/// Call the hook of the event, if one is registered
+static inline ll_unused void hooks_emit(const hooks_t *self,
+					llfree_event_info_t info)
+{
+	assert(info.event < LLFREE_EVENT_MAX);
+	const hook_t *hook = &self->events[info.event];
+	llfree_hook_fn fn = atomic_load_explicit(&hook->fn,
+						 memory_order_acquire);
+	if (unlikely(fn != NULL))
+		fn(&info, atomic_load_explicit(&hook->ctx,
+					       memory_order_relaxed));
+}
+
+/// Register or clear the hook of an event.
+/// The function and context are stored separately, so a concurrent event
+/// might call the old function with the new context.
+/// Hooks thus have to be changed while the allocator is not used.
+static inline ll_unused void hooks_set(hooks_t *self, llfree_event_t event,
+				       llfree_hook_fn fn, void *ctx)
+{
+	assert(event < LLFREE_EVENT_MAX);
+	hook_t *hook = &self->events[event];
+	atomic_store_explicit(&hook->ctx, ctx, memory_order_relaxed);
+	atomic_store_explicit(&hook->fn, fn, memory_order_release);
+}
+
+#endif // LLFREE_ENABLE_HOOKS
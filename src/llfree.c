@@ -7,6 +7,7 @@
 #include "trees.h"
 #include "local.h"
 #include "lower.h"
+#include "metrics.h"
 #include "utils.h"
 
 /// Callback for trees_init: reads child counters from the lower allocator
@@ -98,9 +99,19 @@ llfree_result_t llfree_init(llfree_t *self, size_t frames, uint8_t init,
 
 	self->local = (local_t *)meta.local;
 	ll_local_init(self->local, classing);
+#if LLFREE_ENABLE_CONTENTION
+	self->lower.contention = self->trees.contention;
+#endif
+#if LLFREE_ENABLE_HOOKS
+	self->lower.hooks = self->trees.hooks;
+#endif
 
 	self->policy = classing->policy;
 	self->num_classes = (uint8_t)classing->num_classes;
+#if LLFREE_ENABLE_TRACE
+	atom_store(&self->trace, NULL);
+	atom_store(&self->trace_ctx, NULL);
+#endif
 
 	return llfree_ok(frame_id(0), 0);
 }
@@ -172,6 +183,32 @@ static llfree_policy_t rate_global_tree(uint8_t tree_class, treeF_t free,
 
 // == Core allocation helpers ==
 
+/// A run of `len` order 0 frames within a bitfield row, starting at a
+/// multiple of `align`, see llfree_get_run
+typedef struct run {
+	size_t len;
+	size_t align;
+} run_t;
+
+/// Number of frames of an allocation of the order, or of the run if present
+static treeF_t alloc_frames(uint8_t order, const run_t *run)
+{
+	return run != NULL ? (treeF_t)run->len : (treeF_t)(1u << order);
+}
+
+/// Allocate a frame of the order, or the run if present, from the lower
+/// allocator
+static llfree_result_t alloc_lower(llfree_t *self, frame_id_t start,
+				   uint8_t order, const run_t *run,
+				   frame_id_optional_t frame)
+{
+	if (run != NULL) {
+		assert(!frame.present);
+		return lower_get_run(&self->lower, start, run->len, run->align);
+	}
+	return lower_get(&self->lower, start, order, frame);
+}
+
 /// Args for the reserve_or_steal callback: unified tree access
 /// that reserves (Match/Demote) or steals (Steal).
 typedef struct reserve_or_steal_args {
@@ -179,6 +216,8 @@ typedef struct reserve_or_steal_args {
 	uint8_t order;
 	uint8_t class;
 	size_t local;
+	/// Allocate a run instead of a frame of the order
+	const run_t *run;
 } reserve_or_steal_args_t;
 
 /// Swap out the currently reserved tree for a new one and write back the
@@ -188,6 +227,7 @@ static void swap_reserved(llfree_t *self, uint8_t class, size_t local,
 {
 	llfree_debug("swap class=%u index=%zu idx=%zu free=%" PRIuS, class,
 		     local, new_idx.value, (size_t)new_free);
+	metrics_count(METRICS_SWAP_RESERVED, 1);
 	local_result_t old =
 		ll_local_swap(self->local, class, local, new_idx, new_free);
 	assert(old.success);
@@ -197,6 +237,53 @@ static void swap_reserved(llfree_t *self, uint8_t class, size_t local,
 	}
 }
 
+#if LLFREE_ENABLE_FREE_RESERVE
+/// Reserve a tree that was repeatedly freed to, assuming that following
+/// allocations of this core are served best from there
+static void reserve_on_free(llfree_t *self, uint8_t class, size_t local,
+			    tree_id_t idx)
+{
+	tree_t tree = trees_load(&self->trees, idx);
+	if (tree.reserved ||
+	    self->policy(class, tree.class, tree.free).type !=
+		    LLFREE_POLICY_MATCH)
+		return;
+
+	bool reserved;
+	treeF_t free;
+	uint8_t target_class;
+	if (trees_reserve_or_steal(&self->trees, idx, 0, self->policy, class,
+				   &reserved, &free, &target_class) &&
+	    reserved) {
+		llfree_debug("reserve on free idx=%zu", idx.value);
+		swap_reserved(self, target_class, local, idx, free);
+	}
+}
+#endif
+
+/// Return the freed frames to the counter of their tree
+static llfree_path_t put_tree(llfree_t *self, llfree_request_t request,
+			      tree_id_t tree_idx, treeF_t frames)
+{
+	// Try updating own trees first
+	if (request.local.present &&
+	    ll_local_put(self->local, request.class, request.local.value,
+			 tree_idx, frames))
+		return LLFREE_PATH_LOCAL;
+
+	// Increment globally
+	trees_put(&self->trees, tree_idx, frames, self->policy);
+
+#if LLFREE_ENABLE_FREE_RESERVE
+	if (request.local.present &&
+	    ll_local_free_inc(self->local, request.class, request.local.value,
+			      tree_idx))
+		reserve_on_free(self, request.class, request.local.value,
+				tree_idx);
+#endif
+	return LLFREE_PATH_GLOBAL;
+}
+
 /// Unified tree access: reserves (Match/Demote) or steals (Steal) frames
 /// from the tree at idx, then allocates from the lower allocator.
 /// Matches Rust's `reserve_or_steal`.
@@ -204,7 +291,12 @@ static llfree_result_t reserve_or_steal_cb(tree_id_t idx, void *ctx)
 {
 	reserve_or_steal_args_t *rargs = (reserve_or_steal_args_t *)ctx;
 	llfree_t *self = rargs->self;
-	treeF_t frames = (treeF_t)(1u << rargs->order);
+	treeF_t frames = alloc_frames(rargs->order, rargs->run);
+
+	// Skip trees without free huge children before touching their entry
+	if (rargs->order >= LLFREE_HUGE_ORDER &&
+	    !lower_has_huge(&self->lower, frame_from_tree(idx), rargs->order))
+		return llfree_err(LLFREE_ERR_MEMORY);
 
 	bool reserved;
 	treeF_t old_free;
@@ -227,8 +319,9 @@ static llfree_result_t reserve_or_steal_cb(tree_id_t idx, void *ctx)
 	}
 	size_t local = rargs->local % class_len.value;
 
-	llfree_result_t res = lower_get(&self->lower, frame_from_tree(idx),
-					rargs->order, frame_id_none());
+	llfree_result_t res = alloc_lower(self, frame_from_tree(idx),
+					  rargs->order, rargs->run,
+					  frame_id_none());
 
 	if (llfree_is_ok(res)) {
 		llfree_debug("reserve_or_steal success idx=%zu reserved=%d",
@@ -254,14 +347,19 @@ static llfree_result_t steal_cb(tree_id_t idx, void *ctx)
 {
 	reserve_or_steal_args_t *rargs = (reserve_or_steal_args_t *)ctx;
 	llfree_t *self = rargs->self;
-	treeF_t frames = (treeF_t)(1u << rargs->order);
+	treeF_t frames = alloc_frames(rargs->order, rargs->run);
+
+	if (rargs->order >= LLFREE_HUGE_ORDER &&
+	    !lower_has_huge(&self->lower, frame_from_tree(idx), rargs->order))
+		return llfree_err(LLFREE_ERR_MEMORY);
 
 	uint8_t class = rargs->class;
 	if (!trees_steal(&self->trees, idx, frames, &class, self->policy))
 		return llfree_err(LLFREE_ERR_MEMORY);
 
-	llfree_result_t res = lower_get(&self->lower, frame_from_tree(idx),
-					rargs->order, frame_id_none());
+	llfree_result_t res = alloc_lower(self, frame_from_tree(idx),
+					  rargs->order, rargs->run,
+					  frame_id_none());
 
 	if (llfree_is_ok(res)) {
 		llfree_debug("get_global success idx=%zu", idx.value);
@@ -276,7 +374,7 @@ static llfree_result_t steal_cb(tree_id_t idx, void *ctx)
 /// Reserve and allocate from a new tree, using best-fit search near `start`.
 static llfree_result_t search_and_reserve(llfree_t *self, uint8_t class,
 					  size_t local, uint8_t order,
-					  tree_id_t start)
+					  const run_t *run, tree_id_t start)
 {
 	assert(start.value < self->trees.len);
 
@@ -284,9 +382,11 @@ static llfree_result_t search_and_reserve(llfree_t *self, uint8_t class,
 	size_t near = LL_MAX(self->trees.len / 16, cl_trees / 4);
 	start = tree_id(align_down(start.value, next_pow2(2 * near)));
 
-	reserve_or_steal_args_t args = {
-		.self = self, .order = order, .class = class, .local = local
-	};
+	reserve_or_steal_args_t args = { .self = self,
+					 .order = order,
+					 .class = class,
+					 .local = local,
+					 .run = run };
 
 	llfree_debug("reserve class=%u index=%zu o=%d", class, local, order);
 
@@ -295,7 +395,7 @@ static llfree_result_t search_and_reserve(llfree_t *self, uint8_t class,
 		llfree_debug("search best t=%d l=%zu", class, local);
 		struct rate_args near_rate = {
 			.class = class,
-			.frames = (treeF_t)(1u << order),
+			.frames = alloc_frames(order, run),
 			.policy = self->policy,
 		};
 		llfree_result_t res = trees_search_best(
@@ -309,7 +409,7 @@ static llfree_result_t search_and_reserve(llfree_t *self, uint8_t class,
 	llfree_debug("search any t=%d l=%zu", class, local);
 	struct rate_args any_rate = {
 		.class = class,
-		.frames = (treeF_t)(1u << order),
+		.frames = alloc_frames(order, run),
 		.policy = self->policy,
 	};
 	return trees_search_best(&self->trees, start, 0, self->trees.len,
@@ -342,6 +442,7 @@ static bool sync_with_global(llfree_t *self, uint8_t class, size_t index,
 	}
 	llfree_debug("sync success class=%u index=%zu free=%" PRIuS, class,
 		     index, (size_t)stolen);
+	metrics_count(METRICS_SYNC_GLOBAL, 1);
 	return true;
 }
 
@@ -349,10 +450,11 @@ static bool sync_with_global(llfree_t *self, uint8_t class, size_t index,
 /// On success, returns the allocated frame and class.
 /// On failure, if there was a reservation, sets *start_out to its tree index.
 static llfree_result_t get_local(llfree_t *self, uint8_t class, size_t index,
-				 uint8_t order, treeF_t frames,
+				 uint8_t order, const run_t *run,
 				 frame_id_optional_t frame, bool sync,
 				 tree_id_t *start_out)
 {
+	treeF_t frames = alloc_frames(order, run);
 	local_result_t old;
 	old = ll_local_get(self->local, class, index,
 			   frame.present ?
@@ -360,9 +462,9 @@ static llfree_result_t get_local(llfree_t *self, uint8_t class, size_t index,
 				   tree_id_none(),
 			   frames);
 	if (old.success) {
-		llfree_result_t res = lower_get(&self->lower,
-						frame_from_row(old.start_row),
-						order, frame);
+		llfree_result_t res =
+			alloc_lower(self, frame_from_row(old.start_row), order,
+				    run, frame);
 		if (llfree_is_ok(res)) {
 			row_id_t start_row = row_from_frame(res.frame);
 			if (old.start_row.value != start_row.value) {
@@ -372,8 +474,8 @@ static llfree_result_t get_local(llfree_t *self, uint8_t class, size_t index,
 			return llfree_ok(res.frame, class);
 		}
 
-		trees_put(&self->trees, tree_from_row(old.start_row), frames,
-			  self->policy);
+		put_tree(self, llreq(order, class, ll_some(index)),
+			 tree_from_row(old.start_row), frames);
 		if (start_out != NULL)
 			*start_out = tree_from_row(old.start_row);
 		return res;
@@ -383,8 +485,8 @@ static llfree_result_t get_local(llfree_t *self, uint8_t class, size_t index,
 		     old.present);
 	if (sync && old.present &&
 	    sync_with_global(self, class, index, frames, old)) {
-		return get_local(self, class, index, order, frames, frame,
-				 false, start_out);
+		return get_local(self, class, index, order, run, frame, false,
+				 start_out);
 	}
 
 	if (start_out != NULL && old.present)
@@ -396,9 +498,9 @@ static llfree_result_t get_local(llfree_t *self, uint8_t class, size_t index,
 /// Steal from any local reservation
 static llfree_result_t steal_local(llfree_t *self,
 				   const llfree_request_t *request,
-				   frame_id_optional_t frame)
+				   const run_t *run, frame_id_optional_t frame)
 {
-	treeF_t frames = (treeF_t)(1u << request->order);
+	treeF_t frames = alloc_frames(request->order, run);
 	tree_id_optional_t tree_idx =
 		frame.present ? tree_id_some(tree_from_frame(frame.value)) :
 				tree_id_none();
@@ -408,11 +510,13 @@ static llfree_result_t steal_local(llfree_t *self,
 					    tree_idx, frames, self->policy);
 	if (res.success) {
 		frame_id_optional_t lower_frame = frame;
-		llfree_result_t res2 = lower_get(&self->lower,
-						 frame_from_row(res.start_row),
-						 request->order, lower_frame);
-		if (llfree_is_ok(res2))
+		llfree_result_t res2 =
+			alloc_lower(self, frame_from_row(res.start_row),
+				    request->order, run, lower_frame);
+		if (llfree_is_ok(res2)) {
+			metrics_count(METRICS_STEAL_LOCAL, 1);
 			return llfree_ok(res2.frame, res.class);
+		}
 		trees_put(&self->trees, tree_from_row(res.start_row), frames,
 			  self->policy);
 		if (res2.error != LLFREE_ERR_MEMORY)
@@ -425,9 +529,9 @@ static llfree_result_t steal_local(llfree_t *self,
 /// Demote from a local reservation
 static llfree_result_t demote_local(llfree_t *self,
 				    const llfree_request_t *request,
-				    frame_id_optional_t frame)
+				    const run_t *run, frame_id_optional_t frame)
 {
-	treeF_t frames = (treeF_t)(1u << request->order);
+	treeF_t frames = alloc_frames(request->order, run);
 	tree_id_optional_t tree_idx =
 		frame.present ? tree_id_some(tree_from_frame(frame.value)) :
 				tree_id_none();
@@ -444,12 +548,13 @@ static llfree_result_t demote_local(llfree_t *self,
 		}
 
 		frame_id_optional_t lower_frame = frame;
-		llfree_result_t res = lower_get(&self->lower,
-						frame_from_row(dem.row),
-						request->order, lower_frame);
+		llfree_result_t res =
+			alloc_lower(self, frame_from_row(dem.row),
+				    request->order, run, lower_frame);
 		if (llfree_is_ok(res)) {
 			llfree_info("demote success class=%u index=%zu",
 				    request->class, request->local.value);
+			metrics_count(METRICS_DEMOTE_LOCAL, 1);
 			return llfree_ok(res.frame, request->class);
 		}
 		llfree_warn("demote failed class=%u index=%zu", request->class,
@@ -463,7 +568,8 @@ static llfree_result_t demote_local(llfree_t *self,
 }
 
 static llfree_result_t llfree_get_at(llfree_t *self, frame_id_t frame,
-				     llfree_request_t request)
+				     llfree_request_t request,
+				     llfree_path_t *path)
 {
 	assert(frame.value < self->lower.frames);
 	tree_id_t tree_idx = tree_from_frame(frame);
@@ -471,9 +577,10 @@ static llfree_result_t llfree_get_at(llfree_t *self, frame_id_t frame,
 
 	// Try local reservation first
 	if (request.local.present) {
+		*path = LLFREE_PATH_LOCAL;
 		llfree_result_t res = get_local(
 			self, request.class, request.local.value, request.order,
-			frames, frame_id_some(frame), true, NULL);
+			NULL, frame_id_some(frame), true, NULL);
 		if (res.error != LLFREE_ERR_MEMORY)
 			return res;
 	}
@@ -481,6 +588,7 @@ static llfree_result_t llfree_get_at(llfree_t *self, frame_id_t frame,
 	uint8_t new_class = request.class;
 	if (trees_steal(&self->trees, tree_idx, frames, &new_class,
 			self->policy)) {
+		*path = LLFREE_PATH_GLOBAL;
 		llfree_result_t res = lower_get(&self->lower, frame,
 						request.order,
 						frame_id_some(frame));
@@ -491,20 +599,23 @@ static llfree_result_t llfree_get_at(llfree_t *self, frame_id_t frame,
 	}
 
 	// Steal from local
-	llfree_result_t res = steal_local(self, &request, frame_id_some(frame));
+	*path = LLFREE_PATH_STEAL;
+	llfree_result_t res =
+		steal_local(self, &request, NULL, frame_id_some(frame));
 	if (res.error != LLFREE_ERR_MEMORY)
 		return res;
 
 	// Demote from local
-	return demote_local(self, &request, frame_id_some(frame));
+	*path = LLFREE_PATH_DEMOTE;
+	return demote_local(self, &request, NULL, frame_id_some(frame));
 }
 
 static bool validate_request(llfree_t *self, llfree_request_t request,
 			     frame_id_optional_t frame)
 {
-	if (request.order > LLFREE_TREE_ORDER) {
+	if (request.order > LLFREE_GIGANTIC_ORDER) {
 		llfree_info("Arg: order=%u > max=%u", request.order,
-			    LLFREE_TREE_ORDER);
+			    LLFREE_GIGANTIC_ORDER);
 		return false;
 	}
 
@@ -553,15 +664,505 @@ static bool validate_request(llfree_t *self, llfree_request_t request,
 	return true;
 }
 
-llfree_result_t llfree_get(llfree_t *self, frame_id_optional_t frame,
-			   llfree_request_t request)
+/// Free the frames, returning the number of frames that were freed before the
+/// first invalid one
+static size_t put_frames(llfree_t *self, llfree_request_t request,
+			 const frame_id_t *frames, size_t n)
+{
+	size_t count = 0;
+	while (count < n) {
+		// Collect the following frames of the same tree
+		tree_id_t tree_idx = tree_from_frame(frames[count]);
+		size_t end = count + 1;
+		while (end < n &&
+		       tree_from_frame(frames[end]).value == tree_idx.value)
+			end++;
+
+		size_t freed = lower_put_n(&self->lower, frames + count,
+					   end - count, request.order);
+		if (freed > 0) {
+			put_tree(self, request, tree_idx,
+				 (treeF_t)(freed << request.order));
+		}
+		count += freed;
+		if (count < end) {
+			llfree_info("lower err at %" PRIu64,
+				    frames[count].value);
+			break;
+		}
+	}
+	return count;
+}
+
+/// Allocate a gigantic frame from an aligned run of entirely free trees that
+/// are not reserved, all of their children are marked as huge
+static llfree_result_t get_gigantic(llfree_t *self, frame_id_optional_t frame,
+				    tree_id_t start, llfree_request_t request)
+{
+	size_t n = 1u << (request.order - LLFREE_TREE_ORDER);
+	size_t runs = self->trees.len / n;
+	if (frame.present) {
+		start = tree_from_frame(frame.value);
+		runs = 1;
+	}
+	if (runs == 0)
+		return llfree_err(LLFREE_ERR_MEMORY);
+
+	// The start might be in the incomplete run at the end
+	size_t first = start.value / n;
+	if (!frame.present)
+		first %= runs;
+	for_offsetted(first, runs, run) {
+		tree_id_t idx = tree_id(run * n);
+		uint8_t class = request.class;
+		if (!trees_steal_run(&self->trees, idx, n, &class,
+				     self->policy))
+			continue;
+
+		size_t i = 0;
+		for (; i < n; i++) {
+			frame_id_t tree_frame =
+				frame_from_tree(tree_id(idx.value + i));
+			llfree_result_t res =
+				lower_get(&self->lower, tree_frame,
+					  LLFREE_TREE_ORDER,
+					  frame_id_some(tree_frame));
+			if (!llfree_is_ok(res))
+				break;
+		}
+		if (i == n)
+			return llfree_ok(frame_from_tree(idx), class);
+
+		// The counters were too optimistic, undo the claims
+		llfree_warn("gigantic: children of tree %" PRIuS " not free",
+			    idx.value + i);
+		while (i-- > 0) {
+			frame_id_t tree_frame =
+				frame_from_tree(tree_id(idx.value + i));
+			llfree_result_t ll_unused res = lower_put(
+				&self->lower, tree_frame, LLFREE_TREE_ORDER);
+			assert(llfree_is_ok(res));
+		}
+		for (size_t j = 0; j < n; j++) {
+			trees_put(&self->trees, tree_id(idx.value + j),
+				  LLFREE_TREE_SIZE, self->policy);
+		}
+	}
+	return llfree_err(LLFREE_ERR_MEMORY);
+}
+
+/// Free a gigantic frame, either all of its trees or none of them
+static llfree_result_t put_gigantic(llfree_t *self, frame_id_t frame,
+				    llfree_request_t request,
+				    llfree_path_t *path)
+{
+	size_t n = 1u << (request.order - LLFREE_TREE_ORDER);
+	tree_id_t idx = tree_from_frame(frame);
+	if (frame.value % LLFREE_TREE_SIZE != 0 ||
+	    idx.value + n > self->trees.len)
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+
+	// Free the children first, the trees stay unavailable to other
+	// allocations until their counters are incremented
+	for (size_t i = 0; i < n; i++) {
+		llfree_result_t res =
+			lower_put(&self->lower,
+				  frame_from_tree(tree_id(idx.value + i)),
+				  LLFREE_TREE_ORDER);
+		if (llfree_is_ok(res))
+			continue;
+
+		// Not a gigantic frame, reallocate the freed trees
+		while (i-- > 0) {
+			frame_id_t tree_frame =
+				frame_from_tree(tree_id(idx.value + i));
+			llfree_result_t ll_unused undo =
+				lower_get(&self->lower, tree_frame,
+					  LLFREE_TREE_ORDER,
+					  frame_id_some(tree_frame));
+			assert(llfree_is_ok(undo));
+		}
+		return res;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		*path = put_tree(self, request, tree_id(idx.value + i),
+				 LLFREE_TREE_SIZE);
+	}
+	return llfree_ok(frame_id(0), 0);
+}
+
+/// Allocate up to `n` frames from the local reservation, with a single update
+/// of the local counter
+static size_t get_local_batch(llfree_t *self, uint8_t class, size_t index,
+			      uint8_t order, frame_id_t *out, size_t n)
+{
+	treeF_t frames = (treeF_t)(1u << order);
+	treeF_t max = (treeF_t)LL_MIN(n << order, (size_t)LLFREE_TREE_SIZE);
+	treeF_t taken = 0;
+	local_result_t old = ll_local_get_up_to(self->local, class, index,
+						frames, max, &taken);
+	if (!old.success)
+		return 0;
+
+	size_t blocks = taken >> order;
+	size_t count = lower_get_n(&self->lower, frame_from_row(old.start_row),
+				   order, out, blocks);
+	if (count < blocks) {
+		put_tree(self, llreq(order, class, ll_some(index)),
+			 tree_from_row(old.start_row),
+			 (treeF_t)((blocks - count) << order));
+	}
+	if (count > 0) {
+		row_id_t start_row = row_from_frame(out[count - 1]);
+		if (old.start_row.value != start_row.value)
+			ll_local_set_start(self->local, class, index,
+					   start_row);
+	}
+	return count;
+}
+
+#if LLFREE_DEFERRED_FREE || LLFREE_MAGAZINE
+/// Sort the frames by their address, the buffers are small enough for an
+/// insertion sort
+static void sort_frames(frame_id_t *frames, size_t n)
+{
+	for (size_t i = 1; i < n; i++) {
+		frame_id_t frame = frames[i];
+		size_t j = i;
+		for (; j > 0 && frames[j - 1].value > frame.value; j--)
+			frames[j] = frames[j - 1];
+		frames[j] = frame;
+	}
+}
+
+/// Check that the frame is allocated before it is buffered, as a double free
+/// would otherwise only be found, or even hidden by a reallocation, once the
+/// buffer is freed
+static llfree_result_t check_allocated(llfree_t *self, frame_id_t frame)
+{
+	if (lower_stats_at(&self->lower, frame, 0).free_frames != 0) {
+		llfree_warn("double free %" PRIu64, frame.value);
+		return llfree_err(LLFREE_ERR_ADDRESS);
+	}
+	return llfree_ok(frame_id(0), 0);
+}
+
+/// Sort and free buffered frames, skipping the ones that are not allocated
+static void put_buffered(llfree_t *self, llfree_request_t request,
+			 frame_id_t *frames, size_t n)
+{
+	sort_frames(frames, n);
+	size_t count = 0;
+	while (count < n) {
+		count += put_frames(self, request, frames + count, n - count);
+		if (count < n) {
+			llfree_warn("buffered free failed %" PRIu64,
+				    frames[count].value);
+			count++;
+		}
+	}
+}
+#endif
+
+#if LLFREE_DEFERRED_FREE
+/// Free the deferred frames of a local slot
+static void deferred_flush(llfree_t *self, uint8_t class, size_t index,
+			   deferred_t *deferred)
+{
+	llfree_request_t request = llreq(deferred->order, class, ll_some(index));
+	put_buffered(self, request, deferred->frames, deferred->len);
+	deferred->len = 0;
+}
+
+/// Append the frame to the deferred frees of a local slot
+static llfree_result_t put_deferred(llfree_t *self, frame_id_t frame,
+				    llfree_request_t request,
+				    deferred_t *deferred)
+{
+	for (size_t i = 0; i < deferred->len; i++) {
+		if (deferred->frames[i].value == frame.value) {
+			llfree_warn("double free %" PRIu64, frame.value);
+			return llfree_err(LLFREE_ERR_ADDRESS);
+		}
+	}
+	llfree_result_t res = check_allocated(self, frame);
+	if (!llfree_is_ok(res))
+		return res;
+
+	// All buffered frames have the same order
+	if (deferred->len > 0 && deferred->order != request.order)
+		deferred_flush(self, request.class, request.local.value,
+			       deferred);
+	deferred->order = request.order;
+	deferred->frames[deferred->len++] = frame;
+	if (deferred->len == LLFREE_DEFERRED_FREE)
+		deferred_flush(self, request.class, request.local.value,
+			       deferred);
+	return llfree_ok(frame_id(0), 0);
+}
+#endif
+
+#if LLFREE_MAGAZINE
+/// Pop a frame from the magazine of a local slot, refilling half of it
+/// from the local reservation if it is empty.
+/// With owned rows, new frames are taken from the owned row instead and the
+/// magazine only caches the frames that are freed outside of it.
+static llfree_result_t get_magazine(llfree_t *self, uint8_t class,
+				    size_t index, magazine_t *magazine)
+{
+	size_t len = atom_load(&magazine->len);
+#if !LLFREE_ENABLE_OWNED_ROWS
+	if (len == 0) {
+		len = get_local_batch(self, class, index, 0, magazine->frames,
+				      LL_MAX(LLFREE_MAGAZINE / 2, 1));
+	}
+#else
+	(void)self, (void)class, (void)index;
+#endif
+	if (len == 0)
+		return llfree_err(LLFREE_ERR_MEMORY);
+
+	atom_store(&magazine->len, len - 1);
+	return llfree_ok(magazine->frames[len - 1], class);
+}
+
+/// Push the frame onto the magazine of a local slot, freeing its older half
+/// if it is full
+static llfree_result_t put_magazine(llfree_t *self, frame_id_t frame,
+				    llfree_request_t request,
+				    magazine_t *magazine)
+{
+	size_t len = atom_load(&magazine->len);
+	for (size_t i = 0; i < len; i++) {
+		if (magazine->frames[i].value == frame.value) {
+			llfree_warn("double free %" PRIu64, frame.value);
+			return llfree_err(LLFREE_ERR_ADDRESS);
+		}
+	}
+	llfree_result_t res = check_allocated(self, frame);
+	if (!llfree_is_ok(res))
+		return res;
+
+	if (len == LLFREE_MAGAZINE) {
+		size_t half = LL_MAX(len / 2, 1);
+		put_buffered(self, request, magazine->frames, half);
+		len -= half;
+		for (size_t i = 0; i < len; i++)
+			magazine->frames[i] = magazine->frames[half + i];
+		atom_store(&magazine->len, len);
+	}
+	magazine->frames[len] = frame;
+	atom_store(&magazine->len, len + 1);
+	return llfree_ok(frame_id(0), 0);
+}
+
+/// Free all frames of the magazine
+static bool magazine_flush(llfree_t *self, uint8_t class, size_t index,
+			   magazine_t *magazine)
+{
+	size_t len = atom_load(&magazine->len);
+	if (len == 0)
+		return false;
+	put_buffered(self, llreq(0, class, ll_some(index)), magazine->frames,
+		     len);
+	atom_store(&magazine->len, 0);
+	return true;
+}
+#endif
+
+#if LLFREE_ENABLE_OWNED_ROWS
+/// Take a row of the reserved tree, with its free frames
+static bool owned_claim(llfree_t *self, uint8_t class, size_t index,
+			owned_row_t *owned)
+{
+	treeF_t taken = 0;
+	local_result_t old = ll_local_get_up_to(self->local, class, index, 1,
+						LLFREE_ATOMIC_SIZE, &taken);
+	if (!old.success)
+		return false;
+
+	row_id_t row = row_id(0);
+	uint64_t free = lower_claim_row(
+		&self->lower, frame_from_row(old.start_row), taken, &row);
+	size_t got = count_ones(free);
+	if (got < taken) {
+		put_tree(self, llreq(0, class, ll_some(index)),
+			 tree_from_row(old.start_row), (treeF_t)(taken - got));
+	}
+	if (got == 0)
+		return false;
+
+	if (old.start_row.value != row.value)
+		ll_local_set_start(self->local, class, index, row);
+	owned->row = row;
+	atom_store(&owned->free, free);
+	return true;
+}
+
+/// Return the free frames of the owned row
+static bool owned_release(llfree_t *self, uint8_t class, size_t index,
+			  owned_row_t *owned)
+{
+	uint64_t free = atom_load(&owned->free);
+	if (free == 0)
+		return false;
+	lower_release_row(&self->lower, owned->row, free);
+	atom_store(&owned->free, 0);
+	put_tree(self, llreq(0, class, ll_some(index)),
+		 tree_from_row(owned->row), (treeF_t)count_ones(free));
+	return true;
+}
+
+/// Allocate the first free frame of the owned row
+static llfree_result_t get_owned(uint8_t class, owned_row_t *owned)
+{
+	uint64_t free = atom_load(&owned->free);
+	if (free == 0)
+		return llfree_err(LLFREE_ERR_MEMORY);
+	atom_store(&owned->free, free & (free - 1));
+	frame_id_t frame = frame_from_row(owned->row);
+	return llfree_ok(frame_id(frame.value + trailing_zeros(free)), class);
+}
+
+/// Return a frame of the owned row, fails if it is not part of it
+static bool put_owned(frame_id_t frame, owned_row_t *owned,
+		      llfree_result_t *res)
+{
+	uint64_t free = atom_load(&owned->free);
+	if (free == 0 || row_from_frame(frame).value != owned->row.value)
+		return false;
+
+	uint64_t bit = 1ull << (frame.value % LLFREE_ATOMIC_SIZE);
+	if (free & bit) {
+		llfree_warn("double free %" PRIu64, frame.value);
+		*res = llfree_err(LLFREE_ERR_MEMORY);
+	} else {
+		atom_store(&owned->free, free | bit);
+		*res = llfree_ok(frame_id(0), 0);
+	}
+	return true;
+}
+#endif
+
+#if LLFREE_MAGAZINE || LLFREE_ENABLE_OWNED_ROWS
+/// Allocate an order 0 frame from the cache of the local slot
+static llfree_result_t get_cached(llfree_t *self, uint8_t class, size_t index)
+{
+	local_cache_t *cache = ll_local_cache_acquire(self->local, class, index);
+	if (cache == NULL)
+		return llfree_err(LLFREE_ERR_MEMORY);
+
+	llfree_result_t res = llfree_err(LLFREE_ERR_MEMORY);
+#if LLFREE_ENABLE_OWNED_ROWS
+	res = get_owned(class, &cache->owned);
+#endif
+#if LLFREE_MAGAZINE
+	if (!llfree_is_ok(res))
+		res = get_magazine(self, class, index, &cache->magazine);
+#endif
+#if LLFREE_ENABLE_OWNED_ROWS
+	if (!llfree_is_ok(res) && owned_claim(self, class, index, &cache->owned))
+		res = get_owned(class, &cache->owned);
+#endif
+
+	ll_local_cache_release(self->local, class, index);
+	return res;
+}
+#endif
+
+#if LLFREE_LOCAL_CACHE
+/// Free a frame to the cache of the local slot.
+/// Returns false if the frame has to be freed directly.
+static bool put_cached(llfree_t *self, frame_id_t frame,
+		       llfree_request_t request, llfree_result_t *res)
+{
+	size_t index = request.local.value;
+	local_cache_t *cache =
+		ll_local_cache_acquire(self->local, request.class, index);
+	if (cache == NULL)
+		return false;
+
+	bool cached = false;
+#if LLFREE_ENABLE_OWNED_ROWS
+	if (request.order == 0)
+		cached = put_owned(frame, &cache->owned, res);
+#endif
+#if LLFREE_MAGAZINE
+	if (!cached && request.order == 0) {
+		*res = put_magazine(self, frame, request, &cache->magazine);
+		cached = true;
+	}
+#endif
+#if LLFREE_DEFERRED_FREE
+	if (!cached && request.order <= LLFREE_ATOMIC_ORDER) {
+		*res = put_deferred(self, frame, request, &cache->deferred);
+		cached = true;
+	}
+#endif
+
+	ll_local_cache_release(self->local, request.class, index);
+	return cached;
+}
+
+/// Free the held back frames of all local slots that are not used by other
+/// threads, returns whether any frames were freed
+static bool flush_all(llfree_t *self)
+{
+	bool flushed = false;
+	for (uint8_t t = 0; t < LLFREE_MAX_CLASSES; t++) {
+		ll_optional_t locals = ll_local_class_locals(self->local, t);
+		if (!locals.present)
+			continue;
+		for (size_t i = 0; i < locals.value; i++) {
+			local_cache_t *cache =
+				ll_local_cache_acquire(self->local, t, i);
+			if (cache == NULL)
+				continue;
+#if LLFREE_DEFERRED_FREE
+			if (cache->deferred.len > 0) {
+				deferred_flush(self, t, i, &cache->deferred);
+				flushed = true;
+			}
+#endif
+#if LLFREE_MAGAZINE
+			flushed |= magazine_flush(self, t, i, &cache->magazine);
+#endif
+#if LLFREE_ENABLE_OWNED_ROWS
+			flushed |= owned_release(self, t, i, &cache->owned);
+#endif
+			ll_local_cache_release(self->local, t, i);
+		}
+	}
+	return flushed;
+}
+#endif
+
+/// Allocate a frame, or the run of order 0 frames if present, `path` is set
+/// to the path that served the request
+static llfree_result_t get(llfree_t *self, frame_id_optional_t frame,
+			   llfree_request_t request, const run_t *run,
+			   llfree_path_t *path)
 {
 	assert(self != NULL);
+	assert(run == NULL || (request.order == 0 && !frame.present));
 	if (!validate_request(self, request, frame))
 		return llfree_err(LLFREE_ERR_ARGUMENT);
 
+	if (request.order > LLFREE_TREE_ORDER) {
+		*path = LLFREE_PATH_GLOBAL;
+		tree_id_t start = tree_id(0);
+		ll_optional_t locals =
+			ll_local_class_locals(self->local, request.class);
+		if (request.local.present && locals.value != 0) {
+			start = tree_id(self->trees.len / locals.value *
+					request.local.value);
+		}
+		return get_gigantic(self, frame, start, request);
+	}
+
 	if (frame.present) {
-		return llfree_get_at(self, frame.value, request);
+		return llfree_get_at(self, frame.value, request, path);
 	}
 
 	ll_optional_t class_count =
@@ -575,30 +1176,42 @@ llfree_result_t llfree_get(llfree_t *self, frame_id_optional_t frame,
 		start = tree_id(0);
 	}
 
-	treeF_t frames = (treeF_t)(1u << request.order);
+	treeF_t frames = alloc_frames(request.order, run);
 
 	// Use local reservation if possible
 	if (request.local.present && class_count.present &&
 	    class_count.value != 0 && class_count.value < self->trees.len) {
+		*path = LLFREE_PATH_LOCAL;
+#if LLFREE_MAGAZINE || LLFREE_ENABLE_OWNED_ROWS
+		if (request.order == 0 && run == NULL) {
+			llfree_result_t res = get_cached(self, request.class,
+							 request.local.value);
+			if (llfree_is_ok(res))
+				return res;
+		}
+#endif
 		llfree_result_t res = get_local(self, request.class,
 						request.local.value,
-						request.order, frames,
+						request.order, run,
 						frame_id_none(), true, &start);
 		if (res.error != LLFREE_ERR_MEMORY)
 			return res;
 
 		// Try reserving new tree
+		*path = LLFREE_PATH_RESERVE;
 		res = search_and_reserve(self, request.class,
 					 request.local.value, request.order,
-					 start);
+					 run, start);
 		if (res.error != LLFREE_ERR_MEMORY)
 			return res;
 	} else {
 		// Global search: reserves or steals from the best matching tree
+		*path = LLFREE_PATH_GLOBAL;
 		reserve_or_steal_args_t args = { .self = self,
 						 .order = request.order,
 						 .class = request.class,
-						 .local = 0 };
+						 .local = 0,
+						 .run = run };
 		struct rate_args rate_a = {
 			.class = request.class,
 			.frames = frames,
@@ -615,42 +1228,532 @@ llfree_result_t llfree_get(llfree_t *self, frame_id_optional_t frame,
 	llfree_debug("OOM");
 
 	// Try stealing from other local reservations
-	llfree_result_t res = steal_local(self, &request, frame_id_none());
+	*path = LLFREE_PATH_STEAL;
+	llfree_result_t res = steal_local(self, &request, run, frame_id_none());
 	if (res.error != LLFREE_ERR_MEMORY)
 		return res;
 
 	// Fallback to demoting local reservations
-	return demote_local(self, &request, frame_id_none());
+	*path = LLFREE_PATH_DEMOTE;
+	return demote_local(self, &request, run, frame_id_none());
 }
 
-llfree_result_t llfree_put(llfree_t *self, frame_id_t frame,
+#if LLFREE_ENABLE_TRACE
+static void trace(llfree_t *self, llfree_trace_op_t op,
+		  frame_id_optional_t frame, llfree_request_t request,
+		  llfree_result_t result)
+{
+	llfree_trace_fn fn = atom_load(&self->trace);
+	if (fn != NULL) {
+		llfree_trace_event_t event = { .op = op,
+					       .frame = frame,
+					       .request = request,
+					       .result = result };
+		fn(&event, atom_load(&self->trace_ctx));
+	}
+}
+
+/// Trace a whole run or range of frames as a single event
+static void trace_len(llfree_t *self, llfree_trace_op_t op,
+		      frame_id_optional_t frame, llfree_request_t request,
+		      size_t len, size_t align, llfree_result_t result)
+{
+	llfree_trace_fn fn = atom_load(&self->trace);
+	if (fn != NULL) {
+		llfree_trace_event_t event = { .op = op,
+					       .frame = frame,
+					       .request = request,
+					       .len = len,
+					       .align = align,
+					       .result = result };
+		fn(&event, atom_load(&self->trace_ctx));
+	}
+}
+#endif
+
+void llfree_set_hook(llfree_t *self, llfree_event_t event, llfree_hook_fn fn,
+		     void *ctx)
+{
+	assert(self != NULL && event < LLFREE_EVENT_MAX);
+#if LLFREE_ENABLE_HOOKS
+	hooks_set(self->trees.hooks, event, fn, ctx);
+#else
+	(void)event;
+	(void)fn;
+	(void)ctx;
+	llfree_warn("hooks are disabled, build with LLFREE_ENABLE_HOOKS");
+#endif
+}
+
+void llfree_set_trace(llfree_t *self, llfree_trace_fn fn, void *ctx)
+{
+	assert(self != NULL);
+#if LLFREE_ENABLE_TRACE
+	atom_store(&self->trace_ctx, ctx);
+	atom_store(&self->trace, fn);
+#else
+	(void)fn;
+	(void)ctx;
+	llfree_warn("tracing is disabled, build with LLFREE_ENABLE_TRACE");
+#endif
+}
+
+#if LLFREE_ENABLE_HOOKS
+/// Report a failed allocation to the OOM hook
+static void emit_oom(llfree_t *self, frame_id_optional_t frame,
+		     llfree_request_t request)
+{
+	hooks_emit(self->trees.hooks,
+		   (llfree_event_info_t){
+			   .event = LLFREE_EVENT_OOM,
+			   .frame = frame.present ? frame.value : frame_id(0),
+			   .class = request.class,
+			   .order = request.order });
+}
+#endif
+
+/// Allocate like get, retrying with the frames held back by the local slots,
+/// and record the OOM hook and latency histograms
+static llfree_result_t get_recorded(llfree_t *self, frame_id_optional_t frame,
+				    llfree_request_t request, const run_t *run)
+{
+	llfree_path_t path = LLFREE_PATH_FAILED;
+#if LLFREE_ENABLE_HISTOGRAMS
+	uint64_t start = llfree_timestamp();
+#endif
+	llfree_result_t res = get(self, frame, request, run, &path);
+#if LLFREE_LOCAL_CACHE
+	// Retry with the frames that are held back by the local slots
+	if (res.error == LLFREE_ERR_MEMORY && flush_all(self))
+		res = get(self, frame, request, run, &path);
+#endif
+#if LLFREE_ENABLE_HOOKS
+	if (res.error == LLFREE_ERR_MEMORY)
+		emit_oom(self, frame, request);
+#endif
+#if LLFREE_ENABLE_HISTOGRAMS
+	if (!llfree_is_ok(res))
+		path = LLFREE_PATH_FAILED;
+	// Runs are recorded with the order of the frame that would fit them
+	size_t order = run != NULL ? log2(next_pow2(run->len)) : request.order;
+	metrics_hist_get(LL_MIN(order, LLFREE_MAX_ORDER), path,
+			 llfree_timestamp() - start);
+#endif
+	return res;
+}
+
+llfree_result_t llfree_get(llfree_t *self, frame_id_optional_t frame,
 			   llfree_request_t request)
+{
+	llfree_result_t res = get_recorded(self, frame, request, NULL);
+#if LLFREE_ENABLE_TRACE
+	trace(self, LLFREE_TRACE_GET, frame, request, res);
+#endif
+	return res;
+}
+
+size_t llfree_get_batch(llfree_t *self, llfree_request_t request,
+			frame_id_t *out, size_t n)
+{
+	assert(self != NULL && (out != NULL || n == 0));
+	if (!validate_request(self, request, frame_id_none()))
+		return 0;
+
+	ll_optional_t class_count =
+		ll_local_class_locals(self->local, request.class);
+	bool local = request.order <= LLFREE_ATOMIC_ORDER &&
+		     request.local.present && class_count.present &&
+		     class_count.value != 0 &&
+		     class_count.value < self->trees.len;
+
+	size_t count = 0;
+	while (count < n) {
+		if (local) {
+			size_t got = get_local_batch(self, request.class,
+						     request.local.value,
+						     request.order, out + count,
+						     n - count);
+#if LLFREE_ENABLE_TRACE
+			for (size_t i = count; i < count + got; i++) {
+				trace(self, LLFREE_TRACE_GET, frame_id_none(),
+				      request, llfree_ok(out[i], request.class));
+			}
+#endif
+			count += got;
+			if (count == n)
+				break;
+		}
+
+		// Slow path, which might reserve a new tree for the next batch
+		llfree_result_t res = llfree_get(self, frame_id_none(), request);
+		if (!llfree_is_ok(res))
+			break;
+		out[count++] = res.frame;
+	}
+	return count;
+}
+
+/// Free a frame, `path` is set to the path that served the request
+static llfree_result_t put(llfree_t *self, frame_id_t frame,
+			   llfree_request_t request, llfree_path_t *path)
 {
 	assert(self != NULL);
 	if (!validate_request(self, request, frame_id_some(frame)))
 		return llfree_err(LLFREE_ERR_ARGUMENT);
 
+	if (request.order > LLFREE_TREE_ORDER)
+		return put_gigantic(self, frame, request, path);
+
+#if LLFREE_LOCAL_CACHE
+	llfree_result_t cached;
+	if (request.local.present &&
+	    put_cached(self, frame, request, &cached)) {
+		*path = LLFREE_PATH_LOCAL;
+		return cached;
+	}
+#endif
+
 	llfree_result_t res = lower_put(&self->lower, frame, request.order);
 	if (!llfree_is_ok(res)) {
 		llfree_info("lower err %" PRIu64, (uint64_t)res.error);
 		return res;
 	}
 
-	tree_id_t tree_idx = tree_from_frame(frame);
-	treeF_t alloc_frames = (treeF_t)(1u << request.order);
+	*path = put_tree(self, request, tree_from_frame(frame),
+			 (treeF_t)(1u << request.order));
+	return llfree_ok(frame_id(0), 0);
+}
 
-	// Try updating own trees first
-	if (request.local.present &&
-	    ll_local_put(self->local, request.class, request.local.value,
-			 tree_idx, alloc_frames)) {
-		return llfree_ok(frame_id(0), 0);
+llfree_result_t llfree_put(llfree_t *self, frame_id_t frame,
+			   llfree_request_t request)
+{
+	llfree_path_t path = LLFREE_PATH_FAILED;
+#if LLFREE_ENABLE_HISTOGRAMS
+	uint64_t start = llfree_timestamp();
+#endif
+	llfree_result_t res = put(self, frame, request, &path);
+#if LLFREE_ENABLE_HISTOGRAMS
+	if (!llfree_is_ok(res))
+		path = LLFREE_PATH_FAILED;
+	metrics_hist_put(LL_MIN(request.order, LLFREE_MAX_ORDER), path,
+			 llfree_timestamp() - start);
+#endif
+#if LLFREE_ENABLE_TRACE
+	trace(self, LLFREE_TRACE_PUT, frame_id_some(frame), request, res);
+#endif
+	return res;
+}
+
+size_t llfree_put_batch(llfree_t *self, llfree_request_t request,
+			const frame_id_t *frames, size_t n)
+{
+	assert(self != NULL && (frames != NULL || n == 0));
+	if (!validate_request(self, request, frame_id_none()))
+		return 0;
+
+	size_t count = 0;
+	if (request.order > LLFREE_TREE_ORDER) {
+		llfree_path_t path;
+		while (count < n &&
+		       llfree_is_ok(put(self, frames[count], request, &path)))
+			count++;
+	} else {
+		count = put_frames(self, request, frames, n);
 	}
+#if LLFREE_ENABLE_TRACE
+	for (size_t i = 0; i < count; i++) {
+		trace(self, LLFREE_TRACE_PUT, frame_id_some(frames[i]), request,
+		      llfree_ok(frame_id(0), 0));
+	}
+#endif
+	return count;
+}
 
-	// Increment globally
-	trees_put(&self->trees, tree_idx, alloc_frames, self->policy);
+/// Allocate a run through the regular get path, which searches the rows for
+/// `len` free frames at a multiple of `align` instead of a 2^order block
+llfree_result_t llfree_get_run(llfree_t *self, llfree_request_t request,
+			       size_t len, size_t align)
+{
+	assert(self != NULL);
+	llfree_result_t res;
+	if (len == 0 || len > LLFREE_ATOMIC_SIZE || align == 0 ||
+	    align > LLFREE_ATOMIC_SIZE || (align & (align - 1)) != 0 ||
+	    request.order != 0 ||
+	    !validate_request(self, request, frame_id_none())) {
+		llfree_info("Arg: run len=%" PRIuS " align=%" PRIuS
+			    " order=%u",
+			    len, align, request.order);
+		res = llfree_err(LLFREE_ERR_ARGUMENT);
+	} else {
+		run_t run = { .len = len, .align = align };
+		res = get_recorded(self, frame_id_none(), request, &run);
+	}
+#if LLFREE_ENABLE_TRACE
+	trace_len(self, LLFREE_TRACE_GET_RUN, frame_id_none(), request, len,
+		  align, res);
+#endif
+	return res;
+}
+
+/// Free a run, `path` is set to the path that served the request
+static llfree_result_t put_run(llfree_t *self, frame_id_t frame,
+			       llfree_request_t request, size_t len,
+			       llfree_path_t *path)
+{
+	if (len == 0 || len > LLFREE_ATOMIC_SIZE || request.order != 0 ||
+	    !validate_request(self, request, frame_id_some(frame)))
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+
+	llfree_result_t res = lower_put_run(&self->lower, frame, len);
+	if (!llfree_is_ok(res))
+		return res;
+
+	*path = put_tree(self, request, tree_from_frame(frame), (treeF_t)len);
+	return llfree_ok(frame_id(0), 0);
+}
+
+llfree_result_t llfree_put_run(llfree_t *self, frame_id_t frame,
+			       llfree_request_t request, size_t len)
+{
+	assert(self != NULL);
+	llfree_path_t path = LLFREE_PATH_FAILED;
+#if LLFREE_ENABLE_HISTOGRAMS
+	uint64_t start = llfree_timestamp();
+#endif
+	llfree_result_t res = put_run(self, frame, request, len, &path);
+#if LLFREE_ENABLE_HISTOGRAMS
+	if (!llfree_is_ok(res))
+		path = LLFREE_PATH_FAILED;
+	// Runs are recorded with the order of the frame that would fit them
+	size_t order = log2(next_pow2(LL_MAX(len, (size_t)1)));
+	metrics_hist_put(LL_MIN(order, LLFREE_MAX_ORDER), path,
+			 llfree_timestamp() - start);
+#endif
+#if LLFREE_ENABLE_TRACE
+	trace_len(self, LLFREE_TRACE_PUT_RUN, frame_id_some(frame), request,
+		  len, 1, res);
+#endif
+	return res;
+}
+
+/// Order of the largest aligned block at `frame` with at most `frames` frames.
+/// Contiguous ranges are always split into these blocks in the same way.
+static uint8_t contig_order(frame_id_t frame, size_t frames)
+{
+	size_t order = LL_MIN(trailing_zeros(frame.value), log2(frames));
+	return (uint8_t)LL_MIN(order, (size_t)LLFREE_TREE_ORDER);
+}
+
+/// Check the counters of all trees of the range, otherwise `next` is set to
+/// the first frame a following range could start at.
+/// The frames of reserved trees are counted as well, they are stolen from
+/// the local reservation when the range is claimed.
+static bool contig_check(llfree_t *self, frame_id_t start, size_t nframes,
+			 uint8_t class, size_t *next)
+{
+	size_t end = start.value + nframes;
+	for (size_t t = tree_from_frame(start).value;
+	     t * LLFREE_TREE_SIZE < end; t++) {
+		size_t tree_start = t * LLFREE_TREE_SIZE;
+		size_t tree_end = LL_MIN(tree_start + LLFREE_TREE_SIZE,
+					 self->lower.frames);
+		size_t needed = LL_MIN(end, tree_end) -
+				LL_MAX(start.value, tree_start);
+		tree_t tree = trees_load(&self->trees, tree_id(t));
+		size_t free = tree.free;
+		if (tree.reserved) {
+			local_result_t local =
+				ll_local_stats_at(self->local, tree_id(t));
+			if (local.success)
+				free += local.free;
+		}
+		bool valid = self->policy(class, tree.class, (treeF_t)free)
+				     .type != LLFREE_POLICY_INVALID;
+		if (valid && free >= needed)
+			continue;
+		// Ranges that overlap this tree by more than its free frames
+		// fail as well
+		*next = valid ? tree_end - LL_MIN(free, tree_end - tree_start) :
+				tree_end;
+		return false;
+	}
+	return true;
+}
+
+/// Free the first `nframes` of the range block by block
+static llfree_result_t contig_put(llfree_t *self, frame_id_t start,
+				  size_t nframes, uint8_t class)
+{
+	size_t freed = 0;
+	while (freed < nframes) {
+		frame_id_t frame = frame_id(start.value + freed);
+		uint8_t order = contig_order(frame, nframes - freed);
+		llfree_path_t path;
+		llfree_result_t res =
+			put(self, frame, llreq(order, class, ll_none()), &path);
+		if (!llfree_is_ok(res))
+			return res;
+		freed += 1u << order;
+	}
+	return llfree_ok(frame_id(0), 0);
+}
+
+/// Request used to record a range, with the order of the frame that would
+/// fit it
+static llfree_request_t contig_request(size_t nframes, uint8_t class)
+{
+	size_t order = log2(next_pow2(LL_MAX(nframes, (size_t)1)));
+	return llreq((uint8_t)LL_MIN(order, (size_t)LLFREE_MAX_ORDER), class,
+		     ll_none());
+}
+
+/// Allocate the first fitting range of all trees
+static llfree_result_t get_contig(llfree_t *self, size_t nframes, size_t align,
+				  uint8_t class)
+{
+	// First fit, skipping ranges that are known to fail
+	size_t start = 0;
+	while (start + nframes <= self->lower.frames) {
+		size_t next;
+		if (!contig_check(self, frame_id(start), nframes, class,
+				  &next)) {
+			start = align_up(next, align);
+			continue;
+		}
+
+		// Claim the blocks in order
+		size_t claimed = 0;
+		uint8_t order = 0;
+		uint8_t actual = class;
+		while (claimed < nframes) {
+			frame_id_t frame = frame_id(start + claimed);
+			order = contig_order(frame, nframes - claimed);
+			llfree_path_t path;
+			llfree_result_t res =
+				get(self, frame_id_some(frame),
+				    llreq(order, class, ll_none()), NULL,
+				    &path);
+			if (!llfree_is_ok(res))
+				break;
+			if (claimed == 0)
+				actual = res.class;
+			claimed += 1u << order;
+		}
+		if (claimed == nframes)
+			return llfree_ok(frame_id(start), actual);
+
+		llfree_result_t ll_unused res =
+			contig_put(self, frame_id(start), claimed, class);
+		assert(llfree_is_ok(res));
+
+		// Continue after the last allocated frame of the failed block
+		frame_id_t failed = frame_id(start + claimed);
+		frame_id_optional_t allocated = lower_last_allocated(
+			&self->lower, failed, 1u << order);
+		next = allocated.present ? allocated.value.value + 1 :
+					   failed.value + (1u << order);
+		start = align_up(next, align);
+	}
+	return llfree_err(LLFREE_ERR_MEMORY);
+}
+
+llfree_result_t llfree_get_contig(llfree_t *self, size_t nframes, size_t align,
+				  uint8_t class)
+{
+	assert(self != NULL);
+	llfree_request_t ll_unused request = contig_request(nframes, class);
+#if LLFREE_ENABLE_HISTOGRAMS
+	uint64_t start = llfree_timestamp();
+#endif
+	llfree_result_t res;
+	if (nframes == 0 || nframes > self->lower.frames || align == 0 ||
+	    (align & (align - 1)) != 0 ||
+	    !ll_local_class_locals(self->local, class).present) {
+		llfree_info("Arg: contig frames=%" PRIuS " align=%" PRIuS
+			    " class=%u",
+			    nframes, align, class);
+		res = llfree_err(LLFREE_ERR_ARGUMENT);
+	} else {
+		res = get_contig(self, nframes, align, class);
+#if LLFREE_LOCAL_CACHE
+		// Retry with the frames that are held back by the local slots
+		if (res.error == LLFREE_ERR_MEMORY && flush_all(self))
+			res = get_contig(self, nframes, align, class);
+#endif
+	}
+#if LLFREE_ENABLE_HOOKS
+	if (res.error == LLFREE_ERR_MEMORY)
+		emit_oom(self, frame_id_none(), request);
+#endif
+#if LLFREE_ENABLE_HISTOGRAMS
+	// Ranges bypass the local reservations
+	metrics_hist_get(request.order,
+			 llfree_is_ok(res) ? LLFREE_PATH_GLOBAL :
+					     LLFREE_PATH_FAILED,
+			 llfree_timestamp() - start);
+#endif
+#if LLFREE_ENABLE_TRACE
+	trace_len(self, LLFREE_TRACE_GET_CONTIG, frame_id_none(), request,
+		  nframes, align, res);
+#endif
+	return res;
+}
+
+/// Check that the range is allocated block by block, before freeing any of
+/// them
+static llfree_result_t contig_validate(llfree_t *self, frame_id_t start,
+				       size_t nframes, uint8_t class)
+{
+	if (nframes == 0 ||
+	    !ll_local_class_locals(self->local, class).present) {
+		llfree_info("Arg: contig frames=%" PRIuS " class=%u", nframes,
+			    class);
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+	}
+	if (start.value >= self->lower.frames ||
+	    nframes > self->lower.frames - start.value) {
+		llfree_warn("invalid range %" PRIu64 " frames=%" PRIuS,
+			    start.value, nframes);
+		return llfree_err(LLFREE_ERR_ADDRESS);
+	}
+	for (size_t checked = 0; checked < nframes;) {
+		frame_id_t frame = frame_id(start.value + checked);
+		uint8_t order = contig_order(frame, nframes - checked);
+		if (!lower_is_allocated(&self->lower, frame, order)) {
+			llfree_warn("range %" PRIu64 " not allocated at "
+				    "%" PRIu64 " order=%u",
+				    start.value, frame.value, order);
+			return llfree_err(LLFREE_ERR_ADDRESS);
+		}
+		checked += 1u << order;
+	}
 	return llfree_ok(frame_id(0), 0);
 }
 
+llfree_result_t llfree_put_contig(llfree_t *self, frame_id_t frame,
+				  size_t nframes, uint8_t class)
+{
+	assert(self != NULL);
+	llfree_request_t ll_unused request = contig_request(nframes, class);
+#if LLFREE_ENABLE_HISTOGRAMS
+	uint64_t start = llfree_timestamp();
+#endif
+	llfree_result_t res = contig_validate(self, frame, nframes, class);
+	if (llfree_is_ok(res))
+		res = contig_put(self, frame, nframes, class);
+#if LLFREE_ENABLE_HISTOGRAMS
+	metrics_hist_put(request.order,
+			 llfree_is_ok(res) ? LLFREE_PATH_GLOBAL :
+					     LLFREE_PATH_FAILED,
+			 llfree_timestamp() - start);
+#endif
+#if LLFREE_ENABLE_TRACE
+	trace_len(self, LLFREE_TRACE_PUT_CONTIG, frame_id_some(frame), request,
+		  nframes, 1, res);
+#endif
+	return res;
+}
+
 static treeF_t llfree_change_fetch_free(tree_id_t idx, void *ctx)
 {
 	llfree_t *self = (llfree_t *)ctx;
@@ -669,6 +1772,7 @@ llfree_result_t llfree_change_tree(llfree_t *self, llfree_tree_match_t matcher,
 
 void llfree_drain(llfree_t *self)
 {
+	llfree_flush(self);
 	for (uint8_t t = 0; t < LLFREE_MAX_CLASSES; t++) {
 		ll_optional_t locals = ll_local_class_locals(self->local, t);
 		if (!locals.present)
@@ -684,6 +1788,14 @@ void llfree_drain(llfree_t *self)
 	}
 }
 
+void llfree_flush(llfree_t *self)
+{
+	assert(self != NULL);
+#if LLFREE_LOCAL_CACHE
+	flush_all(self);
+#endif
+}
+
 size_t llfree_frames(const llfree_t *self)
 {
 	assert(self != NULL);
@@ -709,7 +1821,11 @@ ll_tree_stats_t llfree_tree_stats(const llfree_t *self)
 ll_stats_t llfree_stats(const llfree_t *self)
 {
 	assert(self != NULL);
-	return lower_stats(&self->lower);
+	ll_stats_t stats = lower_stats(&self->lower);
+#if LLFREE_LOCAL_CACHE
+	stats.free_frames += ll_local_cache_frames(self->local);
+#endif
+	return stats;
 }
 
 ll_stats_t llfree_stats_at(const llfree_t *self, frame_id_t frame, size_t order)
@@ -718,6 +1834,19 @@ ll_stats_t llfree_stats_at(const llfree_t *self, frame_id_t frame, size_t order)
 	return lower_stats_at(&self->lower, frame, order);
 }
 
+size_t llfree_contention(const llfree_t *self, llfree_tree_contention_t *out,
+			 size_t len)
+{
+	assert(self != NULL && (out != NULL || len == 0));
+	return trees_contention(&self->trees, out, len);
+}
+
+void llfree_contention_reset(llfree_t *self)
+{
+	assert(self != NULL);
+	trees_contention_reset(&self->trees);
+}
+
 void llfree_print_debug(const llfree_t *self,
 			void (*writer)(void *, const char *), void *arg)
 {
@@ -806,7 +1935,7 @@ static void validate_tree(const llfree_t *self, local_result_t res)
 
 void llfree_validate(const llfree_t *self)
 {
-	ll_stats_t stats = lower_stats(&self->lower);
+	ll_stats_t stats = llfree_stats(self);
 	ll_tree_stats_t fast_stats = llfree_tree_stats(self);
 	check_equal(PRIuS, stats.free_frames, fast_stats.free_frames);
 
@@ -19,4 +19,10 @@ typedef struct __attribute__((aligned(LLFREE_CACHE_SIZE))) llfree {
 	llfree_policy_fn policy;
 	/// Number of classes
 	uint8_t num_classes;
+
+#if LLFREE_ENABLE_TRACE
+	/// Optional sink for llfree_get/llfree_put calls
+	_Atomic(llfree_trace_fn) trace;
+	void *_Atomic trace_ctx;
+#endif
 } llfree_t;
@@ -48,6 +48,16 @@ static bool ll_reserved_dec(reserved_t *self, tree_id_optional_t tree_idx,
 	return true;
 }
 
+static bool ll_reserved_dec_up_to(reserved_t *self, treeF_t frames,
+				  treeF_t max, treeF_t *taken)
+{
+	if (!self->present || self->free < frames)
+		return false;
+	*taken = (treeF_t)(LL_MIN(self->free, max) / frames * frames);
+	self->free -= *taken;
+	return true;
+}
+
 static bool ll_reserved_inc(reserved_t *self, tree_id_t tree_idx,
 			    treeF_t frames)
 {
@@ -100,8 +110,17 @@ typedef struct __attribute__((aligned(LLFREE_CACHE_SIZE))) entry {
 	/// Counts recent frees to the same tree (heuristic for reserving)
 	_Atomic(local_history_t) last;
 #endif
+#if LLFREE_LOCAL_CACHE
+	/// Held back frames, on separate cache lines as other cores only
+	/// access them on drain or when out of memory
+	struct __attribute__((aligned(LLFREE_CACHE_SIZE))) {
+		/// Set while a thread uses the cache
+		_Atomic(bool) busy;
+		local_cache_t frames;
+	} cache;
+#endif
 } entry_t;
-_Static_assert(sizeof(entry_t) == LLFREE_CACHE_SIZE,
+_Static_assert(LLFREE_LOCAL_CACHE || sizeof(entry_t) == LLFREE_CACHE_SIZE,
 	       "entry_t exceeds cache line");
 
 /// Slice of entries for one class (stored as offset into metadata buffer)
@@ -159,6 +178,21 @@ void ll_local_init(local_t *self, const llfree_classing_t *classing)
 				   ll_reserved_new(false, 0, row_id(0)));
 #if LLFREE_ENABLE_FREE_RESERVE
 			atom_store(&entry->last, ((local_history_t){ 0, 0 }));
+#endif
+#if LLFREE_LOCAL_CACHE
+			atom_store(&entry->cache.busy, false);
+			local_cache_t *cache = &entry->cache.frames;
+#if LLFREE_DEFERRED_FREE
+			cache->deferred.order = 0;
+			cache->deferred.len = 0;
+#endif
+#if LLFREE_MAGAZINE
+			atom_store(&cache->magazine.len, 0);
+#endif
+#if LLFREE_ENABLE_OWNED_ROWS
+			cache->owned.row = row_id(0);
+			atom_store(&cache->owned.free, 0);
+#endif
 #endif
 		}
 		offset += count;
@@ -213,6 +247,21 @@ local_result_t ll_local_get(local_t *self, uint8_t class, size_t index,
 	return make_result(ok, class, old);
 }
 
+local_result_t ll_local_get_up_to(local_t *self, uint8_t class, size_t index,
+				  treeF_t frames, treeF_t max, treeF_t *taken)
+{
+	assert(class < LLFREE_MAX_CLASSES);
+	assert(self->classes[class].len.present &&
+	       index < self->classes[class].len.value);
+	entry_t *entry =
+		((entry_t *)((uint8_t *)self + self->classes[class].offset)) +
+		index;
+	reserved_t old;
+	bool ok = atom_update(&entry->preferred, old, ll_reserved_dec_up_to,
+			      frames, max, taken);
+	return make_result(ok, class, old);
+}
+
 bool ll_local_put(local_t *self, uint8_t class, size_t index,
 		  tree_id_t tree_idx, treeF_t frames)
 {
@@ -366,9 +415,9 @@ demote_any_result_t ll_local_demote_any(local_t *self, uint8_t class,
 static bool frees_inc(local_history_t *self, tree_id_t tree_idx)
 {
 	if (self->idx != tree_idx.value) {
-		// restart for different tree
+		// restart for different tree, counting this free
 		self->idx = tree_idx.value;
-		self->frees = 0;
+		self->frees = 1;
 		return true;
 	}
 	if (self->frees < LAST_FREES) {
@@ -386,7 +435,8 @@ bool ll_local_free_inc(local_t *self, uint8_t class, size_t index,
 {
 #if LLFREE_ENABLE_FREE_RESERVE
 	assert(class < LLFREE_MAX_CLASSES);
-	assert(index < self->classes[class].len);
+	assert(self->classes[class].len.present &&
+	       index < self->classes[class].len.value);
 	entry_t *entry =
 		((entry_t *)((uint8_t *)self + self->classes[class].offset)) +
 		index;
@@ -403,6 +453,62 @@ bool ll_local_free_inc(local_t *self, uint8_t class, size_t index,
 #endif
 }
 
+#if LLFREE_LOCAL_CACHE
+local_cache_t *ll_local_cache_acquire(local_t *self, uint8_t class,
+				      size_t index)
+{
+	assert(class < LLFREE_MAX_CLASSES);
+	assert(self->classes[class].len.present &&
+	       index < self->classes[class].len.value);
+	entry_t *entry =
+		((entry_t *)((uint8_t *)self + self->classes[class].offset)) +
+		index;
+	if (atom_swap(&entry->cache.busy, true))
+		return NULL;
+	return &entry->cache.frames;
+}
+
+void ll_local_cache_release(local_t *self, uint8_t class, size_t index)
+{
+	assert(class < LLFREE_MAX_CLASSES);
+	assert(self->classes[class].len.present &&
+	       index < self->classes[class].len.value);
+	entry_t *entry =
+		((entry_t *)((uint8_t *)self + self->classes[class].offset)) +
+		index;
+	assert(atom_load(&entry->cache.busy));
+	atom_store(&entry->cache.busy, false);
+}
+
+/// Free frames in the cache, which might be used by another thread
+static size_t cache_frames(const local_cache_t *cache)
+{
+	size_t frames = 0;
+#if LLFREE_MAGAZINE
+	frames += atom_load(&cache->magazine.len);
+#endif
+#if LLFREE_ENABLE_OWNED_ROWS
+	frames += count_ones(atom_load(&cache->owned.free));
+#endif
+	(void)cache;
+	return frames;
+}
+
+size_t ll_local_cache_frames(const local_t *self)
+{
+	size_t frames = 0;
+	for (uint8_t t = 0; t < LLFREE_MAX_CLASSES; t++) {
+		const class_locals_t *tl = &self->classes[t];
+		for (size_t j = 0; tl->len.present && j < tl->len.value; j++) {
+			entry_t *entries =
+				(entry_t *)((uint8_t *)self + tl->offset);
+			frames += cache_frames(&entries[j].cache.frames);
+		}
+	}
+	return frames;
+}
+#endif
+
 local_result_t ll_local_drain(local_t *self, uint8_t class, size_t index)
 {
 	assert(class < LLFREE_MAX_CLASSES);
@@ -432,6 +538,11 @@ ll_tree_stats_t ll_local_stats(const local_t *self)
 						    LLFREE_TREE_SIZE;
 				stats.classes[t].free_frames += res.free;
 			}
+#if LLFREE_LOCAL_CACHE
+			size_t cached = cache_frames(&entries[j].cache.frames);
+			stats.free_frames += cached;
+			stats.classes[t].free_frames += cached;
+#endif
 		}
 	}
 	return stats;
@@ -486,10 +597,10 @@ void ll_local_print(const local_t *self, size_t indent)
 				(uint64_t)res.free,
 				tree_from_row(row_id(res.start_row)).value);
 #if LLFREE_ENABLE_FREE_RESERVE
-			local_history_t last = atom_load(&tl->entries[j].last);
+			local_history_t last = atom_load(&entries[j].last);
 			llfree_info_cont("%s  last: { idx: %" PRIu64
 					 ", frees: %" PRIuS " }\n",
-					 INDENT(indent + 2), last.idx,
+					 INDENT(indent + 2), (uint64_t)last.idx,
 					 (size_t)last.frees);
 #endif
 		}
@@ -58,6 +58,11 @@ static inline ll_unused local_result_t local_fail(uint8_t class, bool present,
 local_result_t ll_local_get(local_t *self, uint8_t class, size_t index,
 			    tree_id_optional_t tree_idx, treeF_t frames);
 
+/// Decrement the number of free frames by up to `max` in multiples of
+/// `frames`, `taken` is set to the decremented number.
+local_result_t ll_local_get_up_to(local_t *self, uint8_t class, size_t index,
+				  treeF_t frames, treeF_t max, treeF_t *taken);
+
 /// Increment the number of free frames for the given (class, index).
 bool ll_local_put(local_t *self, uint8_t class, size_t index,
 		  tree_id_t tree_idx, treeF_t frames);
@@ -106,7 +111,61 @@ bool ll_local_free_inc(local_t *self, uint8_t class, size_t index,
 /// Returns the old reservation for the caller to unreserve the global tree.
 local_result_t ll_local_drain(local_t *self, uint8_t class, size_t index);
 
-/// Return stats summed over all slots
+#if LLFREE_LOCAL_CACHE
+#if LLFREE_DEFERRED_FREE
+/// Frames that were freed with a local slot, but not yet returned
+typedef struct deferred {
+	/// Order of the buffered frames
+	uint8_t order;
+	size_t len;
+	frame_id_t frames[LLFREE_DEFERRED_FREE];
+} deferred_t;
+#endif
+
+#if LLFREE_MAGAZINE
+/// Order 0 frames that are cached by a local slot
+typedef struct magazine {
+	/// Number of cached frames
+	_Atomic(size_t) len;
+	frame_id_t frames[LLFREE_MAGAZINE];
+} magazine_t;
+#endif
+
+#if LLFREE_ENABLE_OWNED_ROWS
+/// Bitfield row that is owned by a local slot
+typedef struct owned_row {
+	/// Owned row, only valid if there are free frames
+	row_id_t row;
+	/// Private copy of the free frames, which are allocated in the bitfield
+	_Atomic(uint64_t) free;
+} owned_row_t;
+#endif
+
+/// Frames that are held back by a local slot.
+/// They are only accessed by the thread that acquired the cache.
+typedef struct local_cache {
+#if LLFREE_DEFERRED_FREE
+	deferred_t deferred;
+#endif
+#if LLFREE_MAGAZINE
+	magazine_t magazine;
+#endif
+#if LLFREE_ENABLE_OWNED_ROWS
+	owned_row_t owned;
+#endif
+} local_cache_t;
+
+/// Take exclusive access to the cache of (class, index).
+/// Returns NULL if it is currently used by another thread.
+local_cache_t *ll_local_cache_acquire(local_t *self, uint8_t class,
+				      size_t index);
+/// Release the cache of (class, index)
+void ll_local_cache_release(local_t *self, uint8_t class, size_t index);
+/// Number of free frames in the caches (magazines and owned rows)
+size_t ll_local_cache_frames(const local_t *self);
+#endif
+
+/// Return stats summed over all slots, including the free frames in the caches
 ll_tree_stats_t ll_local_stats(const local_t *self);
 
 /// Return stats for the slot whose reserved tree matches tree_idx
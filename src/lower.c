@@ -2,6 +2,7 @@
 #include "bitfield.h"
 #include "child.h"
 #include "llfree.h"
+#include "metrics.h"
 
 #define CHILD_N LLFREE_CHILD_SIZE
 
@@ -21,6 +22,142 @@ static _Atomic(child_t) *get_child(const lower_t *self, size_t i)
 			.entries[i % LLFREE_TREE_CHILDREN];
 }
 
+/// Count a failed CAS on the given child for its tree
+static inline void contended(const lower_t *self, size_t child_idx)
+{
+#if LLFREE_ENABLE_CONTENTION
+	if (self->contention != NULL) {
+		atomic_fetch_add_explicit(
+			&self->contention[child_idx / LLFREE_TREE_CHILDREN]
+				 .children,
+			1, memory_order_relaxed);
+	}
+#else
+	(void)self;
+	(void)child_idx;
+#endif
+}
+
+/// Report an event of the given child
+static inline void emit(const lower_t *self, llfree_event_t event,
+			size_t child_idx)
+{
+#if LLFREE_ENABLE_HOOKS
+	hooks_emit(self->hooks,
+		   (llfree_event_info_t){
+			   .event = event,
+			   .frame = frame_from_child(huge_id(child_idx)) });
+#else
+	(void)self;
+	(void)event;
+	(void)child_idx;
+#endif
+}
+
+_Static_assert(CHILD_ROWS == FIELD_N, "child summary size");
+
+#if LLFREE_ENABLE_ROW_SUMMARY
+/// Rows of the bitfield that are entirely allocated
+static uint32_t full_rows(bitfield_t *field)
+{
+	uint32_t rows = 0;
+	for (size_t i = 0; i < FIELD_N; i++) {
+		if (atom_load(&field->rows[i]) == UINT64_MAX)
+			rows |= 1u << i;
+	}
+	return rows;
+}
+
+/// Add the rows of an allocation at `frame` to the full summary of the child
+/// if they are full now
+static void summary_set_full(lower_t *self, size_t child_idx, size_t order,
+			     size_t frame)
+{
+	bitfield_t *field = &self->fields[child_idx];
+	size_t row = frame / LLFREE_ATOMIC_SIZE;
+	// Larger allocations always fill their rows
+	if (order < LLFREE_ATOMIC_ORDER &&
+	    atom_load(&field->rows[row]) != UINT64_MAX)
+		return;
+
+	uint32_t rows = child_rows(order, frame);
+	_Atomic(child_t) *child = get_child(self, child_idx);
+	child_t old;
+	if (!atom_update(child, old, child_set_full, rows))
+		return;
+	// A concurrent put might have cleared the rows before we set them
+	uint32_t freed = rows & ~full_rows(field);
+	if (freed != 0)
+		atom_update(child, old, child_clear_full, freed);
+}
+#else
+static inline void summary_set_full(lower_t *self, size_t child_idx,
+				    size_t order, size_t frame)
+{
+	(void)self, (void)child_idx, (void)order, (void)frame;
+}
+#endif
+
+_Static_assert(LLFREE_TREE_CHILDREN <= 64, "child candidate mask size");
+
+/// Raw representation of a child, which is also what the CAS compares
+static inline child_bits_t child_bits(child_t child)
+{
+	child_bits_t bits;
+	__builtin_memcpy(&bits, &child, sizeof(bits));
+	return bits;
+}
+
+#if LLFREE_ENABLE_SIMD
+/// All children of a tree, compared at once with vector instructions
+typedef child_bits_t children_v __attribute__((
+	vector_size(sizeof(child_bits_t) * LLFREE_TREE_CHILDREN)));
+#endif
+
+/// Returns a bitmask of the children of the tree of `child_idx` that start an
+/// aligned group of 2^`h_order` entirely free children.
+///
+/// This is only a hint: the children are read all at once and not atomically,
+/// each candidate is afterwards updated with a CAS.
+static uint64_t huge_candidates(const lower_t *self, size_t child_idx,
+				size_t h_order)
+{
+	children_t *children =
+		&self->children[child_idx / LLFREE_TREE_CHILDREN];
+	child_bits_t free = child_bits(child_new(CHILD_N, false));
+
+	uint64_t mask = 0;
+#if LLFREE_ENABLE_SIMD
+	children_v entries;
+	__builtin_memcpy(&entries, (const void *)children->entries,
+			 sizeof(entries));
+	children_v equal = (children_v)(entries == free);
+	for (size_t i = 0; i < LLFREE_TREE_CHILDREN; i++)
+		mask |= (uint64_t)(equal[i] != 0) << i;
+#else
+	for (size_t i = 0; i < LLFREE_TREE_CHILDREN; i++) {
+		child_t child = atom_load(&children->entries[i]);
+		mask |= (uint64_t)(child_bits(child) == free) << i;
+	}
+#endif
+
+	// Reduce each group of free children to its first child
+	size_t h_num = 1u << h_order;
+	for (size_t i = 0; i < h_order; i++)
+		mask &= mask >> (1u << i);
+	uint64_t aligned = 0;
+	for (size_t i = 0; i < LLFREE_TREE_CHILDREN; i += h_num)
+		aligned |= 1llu << i;
+	return mask & aligned;
+}
+
+bool lower_has_huge(const lower_t *self, frame_id_t start_frame, size_t order)
+{
+	assert(order >= LLFREE_HUGE_ORDER && order <= LLFREE_TREE_ORDER);
+	return huge_candidates(self, child_from_frame(start_frame).value,
+			       order - LLFREE_HUGE_ORDER) != 0;
+}
+
 size_t lower_metadata_size(size_t frames)
 {
 	size_t children = div_ceil(frames, CHILD_N);
@@ -65,12 +202,17 @@ static void lower_clear(lower_t *self, bool free_all)
 		size_t f = LL_MIN(CHILD_N, self->frames - (i * CHILD_N));
 		size_t free = free_all ? f : 0;
 
-		*get_child(self, i) = child_new((uint16_t)free, free == 0);
+		child_t child = child_new((uint16_t)free, free == 0);
 
-		if (free == 0)
+		if (free == 0) {
 			zero_field(&self->fields[i]);
-		else
+		} else {
 			init_field(&self->fields[i], free);
+#if LLFREE_ENABLE_ROW_SUMMARY
+			child.full = full_rows(&self->fields[i]);
+#endif
+		}
+		*get_child(self, i) = child;
 	}
 	/* Leftover children are initialized to 0 */
 	for (size_t i = child_c; i < align_up(child_c, LLFREE_TREE_CHILDREN);
@@ -90,8 +232,11 @@ static void lower_recover(lower_t *self)
 			uint16_t counter =
 				(uint16_t)(CHILD_N -
 					   field_count_ones(&self->fields[i]));
-			atom_store(get_child(self, i),
-				   child_new(counter, false));
+			child = child_new(counter, false);
+#if LLFREE_ENABLE_ROW_SUMMARY
+			child.full = full_rows(&self->fields[i]);
+#endif
+			atom_store(get_child(self, i), child);
 		}
 	}
 }
@@ -106,6 +251,12 @@ llfree_result_t lower_init(lower_t *self, size_t frames, uint8_t init,
 
 	self->fields = (bitfield_t *)primary;
 	self->children = (children_t *)(primary + bitfield_size);
+#if LLFREE_ENABLE_CONTENTION
+	self->contention = NULL;
+#endif
+#if LLFREE_ENABLE_HOOKS
+	self->hooks = &HOOKS_NONE;
+#endif
 	size_t ll_unused tree_count = div_ceil(child_c, LLFREE_TREE_CHILDREN);
 	size_t ll_unused meta = lower_metadata_size(frames);
 	assert((size_t)(self->children + tree_count) <=
@@ -134,28 +285,70 @@ uint8_t *lower_metadata(const lower_t *self)
 	return (uint8_t *)self->fields;
 }
 
+#if LLFREE_ENABLE_WIDE_CAS
+/// Children that are updated with a single CAS
+#define SWAP_CHILDREN (16u / sizeof(child_t))
+#else
+#define SWAP_CHILDREN (8u / sizeof(child_t))
+#endif
+_Static_assert(sizeof(children_t) % (SWAP_CHILDREN * sizeof(child_t)) == 0,
+	       "wide cas alignment");
+
+/// Change `n` <= SWAP_CHILDREN consecutive children with a single CAS
+static bool children_cmp_exchange(lower_t *self, size_t idx, size_t n,
+				  child_t expected, child_t desired)
+{
+	assert(n <= SWAP_CHILDREN && idx % n == 0);
+	if (n == 1) {
+		child_t old = expected;
+		return atom_cmp_exchange(get_child(self, idx), &old, desired);
+	}
+	// All children have the same value, so their order does not matter
+	const uint64_t fill = UINT64_MAX / (child_bits_t)~(child_bits_t)0;
+	uint64_t from = child_bits(expected) * fill;
+	uint64_t to = child_bits(desired) * fill;
+	if (n * sizeof(child_t) == sizeof(uint32_t)) {
+		return atom_cmp_exchange_32(get_child(self, idx),
+					    (uint32_t)from, (uint32_t)to);
+	}
+#if LLFREE_ENABLE_WIDE_CAS
+	if (n * sizeof(child_t) == 16) {
+		return atom_cmp_exchange_wide(
+			get_child(self, idx),
+			((unsigned __int128)from << 64) | from,
+			((unsigned __int128)to << 64) | to);
+	}
+#endif
+	return atom_cmp_exchange_64(get_child(self, idx), from, to);
+}
+
 /// Try to CAS h_num consecutive children atomically, starting from base_idx.
-/// On failure, undoes any partial changes.
+/// Up to SWAP_CHILDREN children are updated with a single CAS, so only
+/// the largest orders can be partially claimed and have to be undone.
 /// Returns true if all CAS operations succeeded, false otherwise.
-static bool try_update_huge_n(lower_t *self, size_t base_idx, size_t h_num,
-			      child_t expected, child_t desired)
+bool try_update_huge_n(lower_t *self, size_t base_idx, size_t h_num,
+		       child_t expected, child_t desired); // used in benches
+bool try_update_huge_n(lower_t *self, size_t base_idx, size_t h_num,
+		       child_t expected, child_t desired)
 {
-	for (size_t j = 0; j < h_num; j++) {
-		child_t old = expected;
-		if (!atom_cmp_exchange(get_child(self, base_idx + j), &old,
-				       desired)) {
-			// Undo previous CAS operations
-			for (size_t k = 0; k < j; k++) {
-				child_t undo_old = desired;
-				if (!atom_cmp_exchange(
-					    get_child(self, base_idx + (j - k)),
-					    &undo_old, expected)) {
-					llfree_warn("Undo failed!");
-					assert(false);
-				}
+	size_t step = LL_MIN(h_num, (size_t)SWAP_CHILDREN);
+	for (size_t j = 0; j < h_num; j += step) {
+		if (children_cmp_exchange(self, base_idx + j, step, expected,
+					  desired))
+			continue;
+
+		contended(self, base_idx + j);
+		// Undo previous CAS operations
+		if (j > 0)
+			metrics_count(METRICS_HUGE_ROLLBACK, 1);
+		for (size_t k = 0; k < j; k += step) {
+			if (!children_cmp_exchange(self, base_idx + k, step,
+						   desired, expected)) {
+				llfree_warn("Undo failed!");
+				assert(false);
 			}
-			return false;
 		}
+		return false;
 	}
 
 	return true;
@@ -182,13 +375,18 @@ static llfree_result_t lower_get_at(lower_t *self, frame_id_t frame,
 
 	_Atomic(child_t) *child = get_child(self, child_idx);
 	child_t old;
-	if (atom_update(child, old, child_dec, order)) {
+	if (atom_update_with(child, old, contended(self, child_idx), child_dec,
+			     order)) {
 		bitfield_t *field = &self->fields[child_idx];
 		llfree_result_t ret = field_toggle(field, frame.value % CHILD_N,
 						   order, false);
-		if (llfree_is_ok(ret))
+		if (llfree_is_ok(ret)) {
+			summary_set_full(self, child_idx, order,
+					 frame.value % CHILD_N);
 			return llfree_ok(frame, 0);
-		if (!atom_update(child, old, child_inc, order)) {
+		}
+		if (!atom_update_with(child, old, contended(self, child_idx),
+				      child_inc, order)) {
 			llfree_warn("Undo failed!");
 			assert(false);
 		}
@@ -210,11 +408,21 @@ llfree_result_t lower_get(lower_t *self, const frame_id_t start_frame,
 			size_t h_order = order - LLFREE_HUGE_ORDER;
 			size_t h_num = 1u << h_order;
 
+			// Skip straight to the free children, or give up
+			// without any CAS if there are none
+			uint64_t candidates =
+				huge_candidates(self, idx, h_order);
+			if (candidates == 0)
+				return llfree_err(LLFREE_ERR_MEMORY);
+
 			idx = align_down(idx, h_num);
 
 			for_offsetted(idx / h_num, LLFREE_TREE_CHILDREN / h_num,
 				      current_i) {
 				size_t i = current_i * h_num;
+				if ((candidates &
+				     (1llu << (i % LLFREE_TREE_CHILDREN))) == 0)
+					continue;
 				if (try_update_huge_n(
 					    self, i, h_num,
 					    child_new(LLFREE_CHILD_SIZE, false),
@@ -231,11 +439,20 @@ llfree_result_t lower_get(lower_t *self, const frame_id_t start_frame,
 		for_offsetted(idx, LLFREE_TREE_CHILDREN, current_i) {
 			child_t old;
 			_Atomic(child_t) *child = get_child(self, current_i);
-			if (atom_update(child, old, child_dec, order)) {
-				llfree_result_t pos =
-					field_set_next(&self->fields[current_i],
-						       start_frame, order);
+			if (atom_update_with(child, old,
+					     contended(self, current_i),
+					     child_dec, order)) {
+				// Start at the next row that is not full
+				size_t row = child_next_row(
+					old, row_from_frame(start_frame).value %
+						     CHILD_ROWS);
+				llfree_result_t pos = field_set_next(
+					&self->fields[current_i],
+					frame_id(row * LLFREE_ATOMIC_SIZE),
+					order);
 				if (llfree_is_ok(pos)) {
+					summary_set_full(self, current_i, order,
+							 pos.frame.value);
 					frame_id_t offset = frame_from_child(
 						huge_id(current_i));
 					return llfree_ok(
@@ -244,8 +461,10 @@ llfree_result_t lower_get(lower_t *self, const frame_id_t start_frame,
 						0);
 				}
 
-				if (!atom_update(child, old, child_inc,
-						 order)) {
+				if (!atom_update_with(
+					    child, old,
+					    contended(self, current_i),
+					    child_inc, order)) {
 					llfree_warn("Undo failed!");
 					assert(false);
 				}
@@ -256,17 +475,194 @@ llfree_result_t lower_get(lower_t *self, const frame_id_t start_frame,
 	return lower_get_at(self, frame.value, order);
 }
 
-static llfree_result_t split_huge(child_t old, _Atomic(child_t) *child,
+size_t lower_get_n(lower_t *self, frame_id_t start_frame, size_t order,
+		   frame_id_t *out, size_t n)
+{
+	assert(order <= LLFREE_ATOMIC_ORDER);
+	assert(start_frame.value < self->frames);
+
+	size_t idx = child_from_frame(start_frame).value;
+	size_t row = row_from_frame(start_frame).value % CHILD_ROWS;
+	size_t count = 0;
+	for_offsetted(idx, LLFREE_TREE_CHILDREN, current_i) {
+		if (count == n)
+			break;
+
+		_Atomic(child_t) *child = get_child(self, current_i);
+		child_t old;
+		size_t taken = 0;
+		if (!atom_update_with(child, old, contended(self, current_i),
+				      child_dec_up_to, order, n - count,
+				      &taken))
+			continue;
+
+		frame_id_t *found = out + count;
+		size_t got = field_set_next_n(
+			&self->fields[current_i],
+			frame_id(child_next_row(old, row) * LLFREE_ATOMIC_SIZE),
+			order, found, taken);
+
+		frame_id_t offset = frame_from_child(huge_id(current_i));
+		for (size_t i = 0; i < got; i++) {
+			// Once for every changed row
+			size_t row = found[i].value / LLFREE_ATOMIC_SIZE;
+			if (i + 1 == got ||
+			    row != found[i + 1].value / LLFREE_ATOMIC_SIZE)
+				summary_set_full(self, current_i, order,
+						 found[i].value);
+			found[i] = frame_id(offset.value + found[i].value);
+		}
+		count += got;
+
+		if (got < taken &&
+		    !atom_update_with(child, old, contended(self, current_i),
+				      child_inc_n, order, taken - got, 0)) {
+			llfree_warn("Undo failed!");
+			assert(false);
+		}
+	}
+	return count;
+}
+
+uint64_t lower_claim_row(lower_t *self, frame_id_t start_frame, size_t max,
+			 row_id_t *row)
+{
+	assert(start_frame.value < self->frames);
+	assert(max <= LLFREE_ATOMIC_SIZE);
+
+	size_t idx = child_from_frame(start_frame).value;
+	size_t start_row = row_from_frame(start_frame).value % CHILD_ROWS;
+	for_offsetted(idx, LLFREE_TREE_CHILDREN, current_i) {
+		_Atomic(child_t) *child = get_child(self, current_i);
+		child_t old;
+		size_t taken = 0;
+		if (!atom_update_with(child, old, contended(self, current_i),
+				      child_dec_up_to, 0, max, &taken))
+			continue;
+
+		size_t r = 0;
+		uint64_t set = field_claim_row(&self->fields[current_i],
+					       child_next_row(old, start_row),
+					       taken, &r);
+		size_t got = count_ones(set);
+		if (got > 0)
+			summary_set_full(self, current_i, 0,
+					 r * LLFREE_ATOMIC_SIZE);
+		if (got < taken &&
+		    !atom_update_with(child, old, contended(self, current_i),
+				      child_inc_n, 0, taken - got, 0)) {
+			llfree_warn("Undo failed!");
+			assert(false);
+		}
+		if (got > 0) {
+			frame_id_t offset = frame_from_child(huge_id(current_i));
+			*row = row_from_frame(frame_id(
+				offset.value + r * LLFREE_ATOMIC_SIZE));
+			return set;
+		}
+	}
+	return 0;
+}
+
+/// Free the order 0 frames of the mask in a bitfield row, fails if they are
+/// not allocated
+static bool put_row(lower_t *self, row_id_t row, uint64_t mask)
+{
+	frame_id_t frame = frame_from_row(row);
+	assert(frame.value < self->frames);
+	size_t child_idx = child_from_frame(frame).value;
+	size_t r = row.value % CHILD_ROWS;
+
+	if (!field_toggle_row(&self->fields[child_idx], r, mask, true))
+		return false;
+
+	_Atomic(child_t) *child = get_child(self, child_idx);
+	child_t old;
+	if (!atom_update_with(child, old, contended(self, child_idx),
+			      child_inc_n, 0, count_ones(mask), 1u << r)) {
+		llfree_warn("Inc Failed!");
+		assert(false);
+	}
+	if (old.free + count_ones(mask) == LLFREE_CHILD_SIZE)
+		emit(self, LLFREE_EVENT_CHILD_FREE, child_idx);
+	return true;
+}
+
+void lower_release_row(lower_t *self, row_id_t row, uint64_t mask)
+{
+	bool ll_unused success = put_row(self, row, mask);
+	assert(success);
+}
+
+llfree_result_t lower_get_run(lower_t *self, frame_id_t start_frame,
+			      size_t len, size_t align)
+{
+	assert(start_frame.value < self->frames);
+	assert(len > 0 && len <= LLFREE_ATOMIC_SIZE);
+	size_t idx = child_from_frame(start_frame).value;
+
+	for_offsetted(idx, LLFREE_TREE_CHILDREN, current_i) {
+		child_t old;
+		_Atomic(child_t) *child = get_child(self, current_i);
+		if (!atom_update_with(child, old, contended(self, current_i),
+				      child_dec_n, 0, len))
+			continue;
+
+		// Start at the next row that is not full
+		size_t row = child_next_row(
+			old, row_from_frame(start_frame).value % CHILD_ROWS);
+		llfree_result_t pos = field_set_next_run(
+			&self->fields[current_i],
+			frame_id(row * LLFREE_ATOMIC_SIZE), len, align);
+		if (llfree_is_ok(pos)) {
+			summary_set_full(self, current_i, 0, pos.frame.value);
+			frame_id_t offset =
+				frame_from_child(huge_id(current_i));
+			return llfree_ok(
+				frame_id(offset.value + pos.frame.value), 0);
+		}
+
+		if (!atom_update_with(child, old, contended(self, current_i),
+				      child_inc_n, 0, len, 0)) {
+			llfree_warn("Undo failed!");
+			assert(false);
+		}
+	}
+	return llfree_err(LLFREE_ERR_MEMORY);
+}
+
+llfree_result_t lower_put_run(lower_t *self, frame_id_t frame, size_t len)
+{
+	size_t bit = frame.value % LLFREE_ATOMIC_SIZE;
+	if (len == 0 || bit + len > LLFREE_ATOMIC_SIZE ||
+	    frame.value + len > self->frames) {
+		llfree_warn("invalid run %" PRIu64 " len=%" PRIuS, frame.value,
+			    len);
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+	}
+	uint64_t mask = (UINT64_MAX >> (LLFREE_ATOMIC_SIZE - len)) << bit;
+	if (!put_row(self, row_from_frame(frame), mask))
+		return llfree_err(LLFREE_ERR_ARGUMENT);
+	return llfree_ok(frame_id(0), 0);
+}
+
+static llfree_result_t split_huge(lower_t *self, size_t child_idx,
+				  child_t old, _Atomic(child_t) *child,
 				  bitfield_t *field)
 {
 	llfree_result_t res = field_toggle(field, 0, LLFREE_CHILD_ORDER, false);
 	if (llfree_is_ok(res)) {
 		llfree_debug("split huge");
-		bool success =
-			atom_cmp_exchange(child, &old, child_new(0, false));
+		child_t split = child_new(0, false);
+#if LLFREE_ENABLE_ROW_SUMMARY
+		split.full = CHILD_ROWS_ALL;
+#endif
+		bool success = atom_cmp_exchange(child, &old, split);
 		assert(success);
+		emit(self, LLFREE_EVENT_SPLIT_HUGE, child_idx);
 	} else {
 		llfree_debug("split huge: wait");
+		metrics_count(METRICS_SPLIT_HUGE_WAIT, 1);
 		for (size_t i = 0; i < RETRIES; i++) {
 			child_t c = atom_load(child);
 			if (!c.huge)
@@ -302,6 +698,9 @@ llfree_result_t lower_put(lower_t *self, frame_id_t frame, size_t order)
 
 		if (try_update_huge_n(self, base_idx, h_num, child_new(0, true),
 				      child_new(LLFREE_CHILD_SIZE, false))) {
+			for (size_t i = 0; i < h_num; i++)
+				emit(self, LLFREE_EVENT_CHILD_FREE,
+				     base_idx + i);
 			return llfree_err(LLFREE_ERR_OK);
 		}
 		return llfree_err(LLFREE_ERR_ARGUMENT);
@@ -313,7 +712,8 @@ llfree_result_t lower_put(lower_t *self, frame_id_t frame, size_t order)
 
 	child_t old = atom_load(child);
 	if (old.huge) {
-		llfree_result_t res = split_huge(old, child, field);
+		llfree_result_t res =
+			split_huge(self, child_idx, old, child, field);
 		if (!llfree_is_ok(res))
 			return res;
 	}
@@ -323,14 +723,173 @@ llfree_result_t lower_put(lower_t *self, frame_id_t frame, size_t order)
 	if (!llfree_is_ok(ret))
 		return ret;
 
-	if (!atom_update(child, old, child_inc, order)) {
+	if (!atom_update_with(child, old, contended(self, child_idx),
+			      child_inc_at, order, field_index)) {
 		llfree_warn("Inc Failed!");
 		assert(false);
 	}
+	if (old.free + (1u << order) == LLFREE_CHILD_SIZE)
+		emit(self, LLFREE_EVENT_CHILD_FREE, child_idx);
 
 	return llfree_err(LLFREE_ERR_OK);
 }
 
+/// Frees the frames of a single child with one CAS per row and a single
+/// update of the child counter.
+/// Returns the number of frames that were freed before the first failure.
+static size_t put_child_n(lower_t *self, size_t child_idx,
+			  const frame_id_t *frames, size_t n, size_t order)
+{
+	const size_t num_frames = 1u << order;
+	_Atomic(child_t) *child = get_child(self, child_idx);
+	bitfield_t *field = &self->fields[child_idx];
+
+	child_t old = atom_load(child);
+	if (old.huge) {
+		llfree_result_t res =
+			split_huge(self, child_idx, old, child, field);
+		if (!llfree_is_ok(res))
+			return 0;
+	}
+
+	uint32_t rows = 0;
+	size_t count = 0;
+	while (count < n) {
+		// Collect the following frames of the same row
+		size_t row =
+			(frames[count].value % CHILD_N) / LLFREE_ATOMIC_SIZE;
+		uint64_t mask = 0;
+		size_t end = count;
+		for (; end < n; end++) {
+			size_t index = frames[end].value % CHILD_N;
+			uint64_t bits =
+				(UINT64_MAX >> (LLFREE_ATOMIC_SIZE - num_frames))
+				<< (index % LLFREE_ATOMIC_SIZE);
+			if (index / LLFREE_ATOMIC_SIZE != row ||
+			    (mask & bits) != 0)
+				break;
+			mask |= bits;
+		}
+
+		if (field_toggle_row(field, row, mask, true)) {
+			rows |= 1u << row;
+			count = end;
+			continue;
+		}
+
+		// Some are not allocated, free them one by one to find the first
+		for (; count < end; count++) {
+			size_t index = frames[count].value % CHILD_N;
+			llfree_result_t res =
+				field_toggle(field, index, order, true);
+			if (!llfree_is_ok(res))
+				break;
+			rows |= 1u << row;
+		}
+		break;
+	}
+
+	if (count > 0) {
+		if (!atom_update_with(child, old, contended(self, child_idx),
+				      child_inc_n, order, count, rows)) {
+			llfree_warn("Inc Failed!");
+			assert(false);
+		}
+		if (old.free + (count << order) == LLFREE_CHILD_SIZE)
+			emit(self, LLFREE_EVENT_CHILD_FREE, child_idx);
+	}
+	return count;
+}
+
+size_t lower_put_n(lower_t *self, const frame_id_t *frames, size_t n,
+		   size_t order)
+{
+	assert(order <= LLFREE_TREE_ORDER);
+
+	size_t count = 0;
+	if (order > LLFREE_ATOMIC_ORDER) {
+		for (; count < n; count++) {
+			if (!llfree_is_ok(lower_put(self, frames[count], order)))
+				break;
+		}
+		return count;
+	}
+
+	while (count < n) {
+		// Collect the following frames of the same child
+		size_t child_idx = child_from_frame(frames[count]).value;
+		size_t end = count;
+		for (; end < n; end++) {
+			frame_id_t frame = frames[end];
+			if (frame.value + (1u << order) > self->frames ||
+			    frame.value % (1u << order) != 0) {
+				llfree_warn("invalid frame %" PRIu64 "\n",
+					    frame.value);
+				break;
+			}
+			if (child_from_frame(frame).value != child_idx)
+				break;
+		}
+		if (end == count)
+			break;
+
+		size_t freed = put_child_n(self, child_idx, frames + count,
+					   end - count, order);
+		count += freed;
+		if (count < end)
+			break;
+	}
+	return count;
+}
+
+frame_id_optional_t lower_last_allocated(const lower_t *self, frame_id_t frame,
+					 size_t len)
+{
+	assert(frame.value + len <= self->frames);
+	size_t end = frame.value + len;
+	while (end > frame.value) {
+		size_t child_idx = (end - 1) / CHILD_N;
+		size_t start = LL_MAX(frame.value, child_idx * CHILD_N);
+		child_t child = atom_load(get_child(self, child_idx));
+		if (child.huge)
+			return frame_id_some(frame_id(end - 1));
+		if (child.free < CHILD_N) {
+			bitfield_t *field = &self->fields[child_idx];
+			for (size_t f = end; f > start; f--) {
+				size_t bit = (f - 1) % CHILD_N;
+				uint64_t row = atom_load(
+					&field->rows[bit / LLFREE_ATOMIC_SIZE]);
+				if ((row >> (bit % LLFREE_ATOMIC_SIZE)) & 1)
+					return frame_id_some(frame_id(f - 1));
+			}
+		}
+		end = start;
+	}
+	return frame_id_none();
+}
+
+bool lower_is_allocated(const lower_t *self, frame_id_t frame, size_t order)
+{
+	assert(frame.value + (1u << order) <= self->frames);
+	size_t child_idx = child_from_frame(frame).value;
+	if (order >= LLFREE_HUGE_ORDER) {
+		size_t h_num = 1u << (order - LLFREE_HUGE_ORDER);
+		for (size_t i = 0; i < h_num; i++) {
+			if (!atom_load(get_child(self, child_idx + i)).huge)
+				return false;
+		}
+		return true;
+	}
+	// Frames of huge frames can be freed individually
+	if (atom_load(get_child(self, child_idx)).huge)
+		return true;
+	for (size_t f = frame.value; f < frame.value + (1u << order); f++) {
+		if (field_is_free(&self->fields[child_idx], f % CHILD_N))
+			return false;
+	}
+	return true;
+}
+
 ll_stats_t lower_stats(const lower_t *self)
 {
 	assert(self != NULL);
@@ -404,8 +963,15 @@ void lower_print(const lower_t *self)
 			llfree_info_cont("\n");
 
 		child_t ll_unused child = atom_load(get_child(self, i));
+#if LLFREE_ENABLE_ROW_SUMMARY
+		llfree_info_cont("    %" PRIuS ": free=%" PRIuS
+				 ", huge=%d, full=%02x\n",
+				 i, (size_t)child.free, child.huge,
+				 (unsigned)child.full);
+#else
 		llfree_info_cont("    %" PRIuS ": free=%" PRIuS ", huge=%d\n",
 				 i, (size_t)child.free, child.huge);
+#endif
 	}
 	llfree_info_cont("}\n");
 	llfree_info_end();
@@ -2,7 +2,9 @@
 
 #include "bitfield.h"
 #include "child.h"
+#include "hooks.h"
 #include "llfree.h"
+#include "metrics.h"
 
 typedef struct children {
 	_Alignas(LLFREE_CACHE_SIZE) _Atomic(child_t)
@@ -16,6 +18,14 @@ typedef struct lower {
 	bitfield_t *fields;
 	/// index per bitfield
 	children_t *children;
+#if LLFREE_ENABLE_CONTENTION
+	/// Optional per-tree contention counters (owned by the trees)
+	metrics_contention_t *contention;
+#endif
+#if LLFREE_ENABLE_HOOKS
+	/// Event hooks (owned by the trees)
+	const hooks_t *hooks;
+#endif
 } lower_t;
 
 /// Allocate and initialize the data structures of the lower allocator.
@@ -32,9 +42,52 @@ uint8_t *lower_metadata(const lower_t *self);
 llfree_result_t lower_get(lower_t *self, frame_id_t start_frame, size_t order,
 			  frame_id_optional_t frame);
 
+/// Returns whether the tree of start_frame likely has an aligned group of
+/// entirely free children for a 2^`order` >= huge allocation.
+/// This is only a hint that does not modify any children.
+bool lower_has_huge(const lower_t *self, frame_id_t start_frame, size_t order);
+
+/// Allocates up to `n` blocks of 2^`order` <= 64 frames from the tree of
+/// start_frame, updating each child only once.
+/// The frames are written to `out` and their number is returned.
+size_t lower_get_n(lower_t *self, frame_id_t start_frame, size_t order,
+		   frame_id_t *out, size_t n);
+
+/// Allocates up to `max` order 0 frames of a single bitfield row of the tree
+/// of start_frame and returns them as mask of the `row`
+uint64_t lower_claim_row(lower_t *self, frame_id_t start_frame, size_t max,
+			 row_id_t *row);
+
+/// Deallocates the order 0 frames of the mask in the bitfield row
+void lower_release_row(lower_t *self, row_id_t row, uint64_t mask);
+
+/// Allocates `len` <= 64 consecutive order 0 frames within a bitfield row,
+/// starting at a multiple of `align`
+llfree_result_t lower_get_run(lower_t *self, frame_id_t start_frame,
+			      size_t len, size_t align);
+
+/// Deallocates a run of `len` frames within a bitfield row
+llfree_result_t lower_put_run(lower_t *self, frame_id_t frame, size_t len);
+
 /// Deallocates the given frame
 llfree_result_t lower_put(lower_t *self, frame_id_t frame, size_t order);
 
+/// Deallocates the frames, updating each row and child only once for
+/// consecutive frames of the same row or child.
+/// Returns the number of frames that were freed before the first failure.
+size_t lower_put_n(lower_t *self, const frame_id_t *frames, size_t n,
+		   size_t order);
+
+/// Returns the last allocated frame in [frame, frame + len).
+/// This is only a hint, the children and bitfields are not read atomically.
+frame_id_optional_t lower_last_allocated(const lower_t *self, frame_id_t frame,
+					 size_t len);
+
+/// Whether the 2^order frames at `frame` are allocated, as huge frames if
+/// the order is at least LLFREE_HUGE_ORDER.
+/// This is only a hint, the children and bitfields are not read atomically.
+bool lower_is_allocated(const lower_t *self, frame_id_t frame, size_t order);
+
 /// Counts free/huge frames
 ll_stats_t lower_stats(const lower_t *self);
 /// Returns the stats for the frame (order == 0), huge frame (order == LLFREE_HUGE_ORDER),
@@ -0,0 +1,250 @@
+#include "metrics.h"
+#include "llfree.h"
+#include "llfree_platform.h"
+#include "utils.h"
+
+/// Sub-buckets per power of two (HDR-style precision of 25%)
+#define HIST_SUB_BITS 2u
+#define HIST_SUB (1u << HIST_SUB_BITS)
+
+size_t metrics_hist_bucket(uint64_t ns)
+{
+	if (ns < HIST_SUB)
+		return (size_t)ns;
+	size_t msb = log2(ns);
+	size_t sub = (size_t)(ns >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1);
+	size_t bucket = ((msb - HIST_SUB_BITS + 1) * HIST_SUB) + sub;
+	return LL_MIN(bucket, LLFREE_HIST_BUCKETS - 1);
+}
+
+uint64_t llfree_hist_bucket_ns(size_t bucket)
+{
+	assert(bucket < LLFREE_HIST_BUCKETS);
+	if (bucket < HIST_SUB)
+		return bucket;
+	size_t msb = (bucket / HIST_SUB) + HIST_SUB_BITS - 1;
+	uint64_t sub = bucket % HIST_SUB;
+	return (HIST_SUB + sub) << (msb - HIST_SUB_BITS);
+}
+
+uint64_t llfree_hist_count(const llfree_hist_t *hist)
+{
+	uint64_t count = 0;
+	for (size_t i = 0; i < LLFREE_HIST_BUCKETS; i++)
+		count += hist->buckets[i];
+	return count;
+}
+
+uint64_t llfree_hist_quantile(const llfree_hist_t *hist, size_t permille)
+{
+	assert(permille <= 1000);
+	uint64_t count = llfree_hist_count(hist);
+	if (count == 0)
+		return 0;
+	uint64_t target = LL_MAX(((count * permille) + 999) / 1000, 1);
+	uint64_t sum = 0;
+	for (size_t i = 0; i < LLFREE_HIST_BUCKETS; i++) {
+		sum += hist->buckets[i];
+		if (sum >= target)
+			return llfree_hist_bucket_ns(i);
+	}
+	return llfree_hist_bucket_ns(LLFREE_HIST_BUCKETS - 1);
+}
+
+#if LLFREE_ENABLE_HISTOGRAMS || LLFREE_ENABLE_COUNTERS
+
+#ifndef llfree_cpu
+/// Fallback if the platform does not provide the current cpu:
+/// shard the metrics by thread instead
+static size_t llfree_cpu(void)
+{
+	static _Thread_local size_t cpu = SIZE_MAX;
+	static _Atomic(size_t) next = 0;
+	if (unlikely(cpu == SIZE_MAX))
+		cpu = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed);
+	return cpu;
+}
+#endif
+
+/// Per-core slot of the metrics
+static size_t metrics_core(void)
+{
+	return llfree_cpu() % LLFREE_METRICS_CORES;
+}
+
+#endif
+
+#if LLFREE_ENABLE_HISTOGRAMS
+
+/// Histograms of a single core
+typedef struct __attribute__((aligned(LLFREE_CACHE_SIZE))) core_hists {
+	_Atomic(uint64_t) get_path[LLFREE_PATH_MAX][LLFREE_HIST_BUCKETS];
+	_Atomic(uint64_t) get_order[LLFREE_MAX_ORDER + 1][LLFREE_HIST_BUCKETS];
+	_Atomic(uint64_t) put_path[LLFREE_PATH_MAX][LLFREE_HIST_BUCKETS];
+	_Atomic(uint64_t) put_order[LLFREE_MAX_ORDER + 1][LLFREE_HIST_BUCKETS];
+} core_hists_t;
+
+static core_hists_t hists[LLFREE_METRICS_CORES];
+
+static void hist_inc(_Atomic(uint64_t) *buckets, uint64_t ns)
+{
+	atomic_fetch_add_explicit(&buckets[metrics_hist_bucket(ns)], 1,
+				  memory_order_relaxed);
+}
+
+static void hist_load(llfree_hist_t *out, _Atomic(uint64_t) *buckets)
+{
+	for (size_t i = 0; i < LLFREE_HIST_BUCKETS; i++) {
+		out->buckets[i] +=
+			atomic_load_explicit(&buckets[i], memory_order_relaxed);
+	}
+}
+
+static void hist_clear(_Atomic(uint64_t) *buckets)
+{
+	for (size_t i = 0; i < LLFREE_HIST_BUCKETS; i++)
+		atomic_store_explicit(&buckets[i], 0, memory_order_relaxed);
+}
+
+void metrics_hist_get(size_t order, llfree_path_t path, uint64_t ns)
+{
+	assert(order <= LLFREE_MAX_ORDER && path < LLFREE_PATH_MAX);
+	core_hists_t *h = &hists[metrics_core()];
+	hist_inc(h->get_path[path], ns);
+	hist_inc(h->get_order[order], ns);
+}
+
+void metrics_hist_put(size_t order, llfree_path_t path, uint64_t ns)
+{
+	assert(order <= LLFREE_MAX_ORDER && path < LLFREE_PATH_MAX);
+	core_hists_t *h = &hists[metrics_core()];
+	hist_inc(h->put_path[path], ns);
+	hist_inc(h->put_order[order], ns);
+}
+
+void llfree_histograms(llfree_histograms_t *out, ll_optional_t core)
+{
+	*out = (llfree_histograms_t){ 0 };
+	for (size_t c = 0; c < LLFREE_METRICS_CORES; c++) {
+		if (core.present && core.value % LLFREE_METRICS_CORES != c)
+			continue;
+		core_hists_t *h = &hists[c];
+		for (size_t p = 0; p < LLFREE_PATH_MAX; p++) {
+			hist_load(&out->get_path[p], h->get_path[p]);
+			hist_load(&out->put_path[p], h->put_path[p]);
+		}
+		for (size_t o = 0; o <= LLFREE_MAX_ORDER; o++) {
+			hist_load(&out->get_order[o], h->get_order[o]);
+			hist_load(&out->put_order[o], h->put_order[o]);
+		}
+	}
+}
+
+void llfree_histograms_reset(void)
+{
+	for (size_t c = 0; c < LLFREE_METRICS_CORES; c++) {
+		core_hists_t *h = &hists[c];
+		for (size_t p = 0; p < LLFREE_PATH_MAX; p++) {
+			hist_clear(h->get_path[p]);
+			hist_clear(h->put_path[p]);
+		}
+		for (size_t o = 0; o <= LLFREE_MAX_ORDER; o++) {
+			hist_clear(h->get_order[o]);
+			hist_clear(h->put_order[o]);
+		}
+	}
+}
+
+#else // !LLFREE_ENABLE_HISTOGRAMS
+
+void metrics_hist_get(size_t order, llfree_path_t path, uint64_t ns)
+{
+	(void)order;
+	(void)path;
+	(void)ns;
+}
+
+void metrics_hist_put(size_t order, llfree_path_t path, uint64_t ns)
+{
+	(void)order;
+	(void)path;
+	(void)ns;
+}
+
+void llfree_histograms(llfree_histograms_t *out, ll_optional_t core)
+{
+	(void)core;
+	*out = (llfree_histograms_t){ 0 };
+}
+
+void llfree_histograms_reset(void)
+{
+}
+
+#endif // LLFREE_ENABLE_HISTOGRAMS
+
+#if LLFREE_ENABLE_COUNTERS
+
+/// Event counters of a single core
+typedef struct __attribute__((aligned(LLFREE_CACHE_SIZE))) core_counters {
+	_Atomic(uint64_t) events[METRICS_EVENT_MAX];
+} core_counters_t;
+
+static core_counters_t counters[LLFREE_METRICS_CORES];
+
+void metrics_count(metrics_event_t event, uint64_t n)
+{
+	assert(event < METRICS_EVENT_MAX);
+	atomic_fetch_add_explicit(&counters[metrics_core()].events[event], n,
+				  memory_order_relaxed);
+}
+
+void llfree_count_cas_retry(void)
+{
+	metrics_count(METRICS_CAS_RETRY, 1);
+}
+
+llfree_counters_t llfree_counters(void)
+{
+	uint64_t sum[METRICS_EVENT_MAX] = { 0 };
+	for (size_t c = 0; c < LLFREE_METRICS_CORES; c++) {
+		for (size_t e = 0; e < METRICS_EVENT_MAX; e++) {
+			sum[e] += atomic_load_explicit(&counters[c].events[e],
+						       memory_order_relaxed);
+		}
+	}
+	return (llfree_counters_t){
+		.cas_retries = sum[METRICS_CAS_RETRY],
+		.search_visits = sum[METRICS_SEARCH_VISIT],
+		.sync_global = sum[METRICS_SYNC_GLOBAL],
+		.swap_reserved = sum[METRICS_SWAP_RESERVED],
+		.steal_local = sum[METRICS_STEAL_LOCAL],
+		.demote_local = sum[METRICS_DEMOTE_LOCAL],
+		.split_huge_waits = sum[METRICS_SPLIT_HUGE_WAIT],
+		.huge_rollbacks = sum[METRICS_HUGE_ROLLBACK],
+		.field_rollbacks = sum[METRICS_FIELD_ROLLBACK],
+	};
+}
+
+void llfree_counters_reset(void)
+{
+	for (size_t c = 0; c < LLFREE_METRICS_CORES; c++) {
+		for (size_t e = 0; e < METRICS_EVENT_MAX; e++) {
+			atomic_store_explicit(&counters[c].events[e], 0,
+					      memory_order_relaxed);
+		}
+	}
+}
+
+#else // !LLFREE_ENABLE_COUNTERS
+
+llfree_counters_t llfree_counters(void)
+{
+	return (llfree_counters_t){ 0 };
+}
+
+void llfree_counters_reset(void)
+{
+}
+
+#endif // LLFREE_ENABLE_COUNTERS
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "llfree.h"
+#include "utils.h"
+
+/// Returns the histogram bucket of the latency `ns`
+size_t metrics_hist_bucket(uint64_t ns);
+
+/// Failed CAS attempts on the metadata of a tree, see llfree_contention
+typedef struct metrics_contention {
+	/// On the tree entry
+	_Atomic(uint32_t) tree;
+	/// On the children of the tree in the lower allocator
+	_Atomic(uint32_t) children;
+} metrics_contention_t;
+
+/// Slow-path events, see llfree_counters_t
+typedef enum metrics_event {
+	METRICS_CAS_RETRY = 0,
+	METRICS_SEARCH_VISIT = 1,
+	METRICS_SYNC_GLOBAL = 2,
+	METRICS_SWAP_RESERVED = 3,
+	METRICS_STEAL_LOCAL = 4,
+	METRICS_DEMOTE_LOCAL = 5,
+	METRICS_SPLIT_HUGE_WAIT = 6,
+	METRICS_HUGE_ROLLBACK = 7,
+	METRICS_FIELD_ROLLBACK = 8,
+	METRICS_EVENT_MAX = 9,
+} metrics_event_t;
+
+#if LLFREE_ENABLE_COUNTERS
+/// Add `n` to the counter of the event on the current core
+void metrics_count(metrics_event_t event, uint64_t n);
+#else
+static inline ll_unused void metrics_count(metrics_event_t event, uint64_t n)
+{
+	(void)event;
+	(void)n;
+}
+#endif
+
+/// Record the latency of a llfree_get
+void metrics_hist_get(size_t order, llfree_path_t path, uint64_t ns);
+/// Record the latency of a llfree_put
+void metrics_hist_put(size_t order, llfree_path_t path, uint64_t ns);
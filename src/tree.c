@@ -43,6 +43,13 @@ bool tree_steal(tree_t *self, treeF_t frames, uint8_t *class,
 	return true;
 }
 
+bool tree_steal_free(tree_t *self, uint8_t *class, llfree_policy_fn policy)
+{
+	if (self->reserved || self->free != LLFREE_TREE_SIZE)
+		return false;
+	return tree_steal(self, LLFREE_TREE_SIZE, class, policy);
+}
+
 bool tree_reserve_or_steal(tree_t *self, treeF_t frames,
 			   llfree_policy_fn policy, uint8_t class,
 			   bool *out_reserved, uint8_t *out_class)
@@ -43,6 +43,11 @@ bool tree_put(tree_t *self, treeF_t frames, llfree_policy_fn policy,
 bool tree_steal(tree_t *self, treeF_t frames, uint8_t *class,
 		llfree_policy_fn policy);
 
+/// Steal all frames of an entirely free tree that is not reserved.
+/// Returns false if the tree is reserved, not entirely free or its class is
+/// incompatible.
+bool tree_steal_free(tree_t *self, uint8_t *class, llfree_policy_fn policy);
+
 /// Reserve an entire tree (Match/Demote) or decrement its counter (Steal).
 /// On Match or Demote: sets reserved=true, free=0, class=requested class.
 /// On Steal: decrements free counter, keeps existing class.
@@ -1,5 +1,6 @@
 #include "trees.h"
 #include "llfree_platform.h"
+#include "metrics.h"
 #include "tree.h"
 #include "utils.h"
 
@@ -9,6 +10,19 @@ void trees_init(trees_t *self, size_t frames, uint8_t *buffer,
 	self->len = div_ceil(frames, LLFREE_TREE_SIZE);
 	self->entries = (_Atomic(tree_t) *)buffer;
 	self->default_class = default_class;
+	size_t offset = align_up(sizeof(tree_t) * self->len, LLFREE_CACHE_SIZE);
+#if LLFREE_ENABLE_CONTENTION
+	self->contention = (metrics_contention_t *)(buffer + offset);
+	offset += align_up(sizeof(metrics_contention_t) * self->len,
+			   LLFREE_CACHE_SIZE);
+	trees_contention_reset(self);
+#endif
+#if LLFREE_ENABLE_HOOKS
+	self->hooks = (hooks_t *)(buffer + offset);
+	for (size_t e = 0; e < LLFREE_EVENT_MAX; e++)
+		hooks_set(self->hooks, (llfree_event_t)e, NULL, NULL);
+#endif
+	(void)offset;
 
 	if (init_fn != NULL) {
 		for (size_t i = 0; i < self->len; ++i) {
@@ -24,6 +38,64 @@ uint8_t *trees_metadata(const trees_t *self)
 	return (uint8_t *)self->entries;
 }
 
+/// Count a failed CAS on the tree entry
+static inline void contended(const trees_t *self, tree_id_t idx)
+{
+#if LLFREE_ENABLE_CONTENTION
+	atomic_fetch_add_explicit(&self->contention[idx.value].tree, 1,
+				  memory_order_relaxed);
+#else
+	(void)self;
+	(void)idx;
+#endif
+}
+
+/// Returns whether a hook is registered for the event
+static inline bool active(const trees_t *self, llfree_event_t event)
+{
+#if LLFREE_ENABLE_HOOKS
+	return hooks_active(self->hooks, event);
+#else
+	(void)self;
+	(void)event;
+	return false;
+#endif
+}
+
+/// Report a class change of a tree if it is a demotion
+static void emit_demote(const trees_t *self, tree_id_t idx, uint8_t old_class,
+			uint8_t class)
+{
+	if (class == old_class || class == self->default_class)
+		return;
+#if LLFREE_ENABLE_HOOKS
+	hooks_emit(self->hooks,
+		   (llfree_event_info_t){ .event = LLFREE_EVENT_DEMOTE,
+					  .frame = frame_from_tree(idx),
+					  .class = class,
+					  .old_class = old_class });
+#else
+	(void)idx;
+#endif
+}
+
+/// Report an event of a tree
+static void emit(const trees_t *self, llfree_event_t event, tree_id_t idx,
+		 uint8_t class)
+{
+#if LLFREE_ENABLE_HOOKS
+	hooks_emit(self->hooks,
+		   (llfree_event_info_t){ .event = event,
+					  .frame = frame_from_tree(idx),
+					  .class = class });
+#else
+	(void)self;
+	(void)event;
+	(void)idx;
+	(void)class;
+#endif
+}
+
 tree_t trees_load(const trees_t *self, tree_id_t idx)
 {
 	assert(idx.value < self->len);
@@ -35,19 +107,62 @@ bool trees_steal(trees_t *self, tree_id_t idx, treeF_t frames, uint8_t *class,
 {
 	assert(idx.value < self->len);
 	tree_t old;
-	bool ok = atom_update(&self->entries[idx.value], old, tree_steal,
-			      frames, class, policy);
+	bool ok = atom_update_with(&self->entries[idx.value], old,
+				   contended(self, idx), tree_steal, frames,
+				   class, policy);
+	// Stealing keeps the class, otherwise the tree takes the new class
+	if (ok && active(self, LLFREE_EVENT_DEMOTE))
+		emit_demote(self, idx, old.class, *class);
 	return ok;
 }
 
+bool trees_steal_run(trees_t *self, tree_id_t idx, size_t n, uint8_t *class,
+		     llfree_policy_fn policy)
+{
+	assert(idx.value + n <= self->len);
+	// Check all trees first, so that runs that cannot be claimed are
+	// skipped without modifying any of them
+	for (size_t i = 0; i < n; i++) {
+		tree_t tree = atom_load(&self->entries[idx.value + i]);
+		if (tree.reserved || tree.free != LLFREE_TREE_SIZE)
+			return false;
+	}
+
+	uint8_t first = *class;
+	for (size_t i = 0; i < n; i++) {
+		tree_id_t current = tree_id(idx.value + i);
+		uint8_t current_class = *class;
+		tree_t old;
+		if (atom_update_with(&self->entries[current.value], old,
+				     contended(self, current), tree_steal_free,
+				     &current_class, policy)) {
+			if (active(self, LLFREE_EVENT_DEMOTE))
+				emit_demote(self, current, old.class,
+					    current_class);
+			if (i == 0)
+				first = current_class;
+			continue;
+		}
+
+		// Undo previous claims
+		for (size_t j = 0; j < i; j++) {
+			trees_put(self, tree_id(idx.value + j),
+				  LLFREE_TREE_SIZE, policy);
+		}
+		return false;
+	}
+	*class = first;
+	return true;
+}
+
 void trees_put(trees_t *self, tree_id_t idx, treeF_t frames,
 	       llfree_policy_fn policy)
 {
 	assert(idx.value < self->len);
 	(void)policy; // reserved for future use (see Rust tree_put policy check)
 	tree_t old;
-	atom_update(&self->entries[idx.value], old, tree_put, frames, policy,
-		    self->default_class);
+	atom_update_with(&self->entries[idx.value], old, contended(self, idx),
+			 tree_put, frames, policy, self->default_class);
 }
 
 bool trees_reserve_or_steal(trees_t *self, tree_id_t idx, treeF_t frames,
@@ -57,11 +172,17 @@ bool trees_reserve_or_steal(trees_t *self, tree_id_t idx, treeF_t frames,
 {
 	assert(idx.value < self->len);
 	tree_t old;
-	bool ok = atom_update(&self->entries[idx.value], old,
-			      tree_reserve_or_steal, frames, policy, class,
-			      out_reserved, out_class);
+	bool ok = atom_update_with(&self->entries[idx.value], old,
+				   contended(self, idx), tree_reserve_or_steal,
+				   frames, policy, class, out_reserved,
+				   out_class);
 	if (ok && out_free != NULL)
 		*out_free = old.free;
+	if (ok && *out_reserved) {
+		emit(self, LLFREE_EVENT_RESERVE, idx, *out_class);
+		if (active(self, LLFREE_EVENT_DEMOTE))
+			emit_demote(self, idx, old.class, *out_class);
+	}
 	return ok;
 }
 
@@ -70,8 +191,19 @@ void trees_unreserve(trees_t *self, tree_id_t idx, treeF_t free, uint8_t class,
 {
 	assert(idx.value < self->len);
 	tree_t old;
-	atom_update(&self->entries[idx.value], old, tree_unreserve_add, free,
-		    class, policy, self->default_class);
+	bool ok = atom_update_with(&self->entries[idx.value], old,
+				   contended(self, idx), tree_unreserve_add,
+				   free, class, policy, self->default_class);
+	if (ok) {
+		emit(self, LLFREE_EVENT_UNRESERVE, idx, class);
+		if (active(self, LLFREE_EVENT_DEMOTE)) {
+			// Recompute the new class of the tree
+			tree_t new = old;
+			tree_unreserve_add(&new, free, class, policy,
+					   self->default_class);
+			emit_demote(self, idx, old.class, new.class);
+		}
+	}
 }
 
 bool trees_sync_steal(trees_t *self, tree_id_t idx, treeF_t min,
@@ -79,8 +211,8 @@ bool trees_sync_steal(trees_t *self, tree_id_t idx, treeF_t min,
 {
 	assert(idx.value < self->len);
 	tree_t old;
-	bool ok = atom_update(&self->entries[idx.value], old, tree_sync_steal,
-			      min);
+	bool ok = atom_update_with(&self->entries[idx.value], old,
+				   contended(self, idx), tree_sync_steal, min);
 	if (ok && out_stolen != NULL)
 		*out_stolen = old.free;
 	return ok;
@@ -140,8 +272,11 @@ llfree_result_t trees_search_best(const trees_t *self, tree_id_t start,
 		// Perfect match: try immediately
 		if (p.type == LLFREE_POLICY_MATCH && p.priority == UINT8_MAX) {
 			llfree_result_t res = cb(tree_id(idx), ctx);
-			if (res.error != LLFREE_ERR_MEMORY)
+			if (res.error != LLFREE_ERR_MEMORY) {
+				metrics_count(METRICS_SEARCH_VISIT,
+					      (uint64_t)(i - (int64_t)offset + 1));
 				return res;
+			}
 			continue;
 		}
 
@@ -160,6 +295,8 @@ llfree_result_t trees_search_best(const trees_t *self, tree_id_t start,
 			best[pos].idx = idx;
 		}
 	}
+	if (len > offset)
+		metrics_count(METRICS_SEARCH_VISIT, len - offset);
 
 	for (size_t i = 0; i < TREES_SEARCH_BEST; ++i) {
 		if (best[i].prio == 0)
@@ -259,6 +396,59 @@ llfree_result_t trees_change(trees_t *self, llfree_tree_match_t matcher,
 			    &args);
 }
 
+size_t trees_contention(const trees_t *self, llfree_tree_contention_t *out,
+			size_t len)
+{
+#if LLFREE_ENABLE_CONTENTION
+	size_t n = 0;
+	for (size_t i = 0; i < self->len; i++) {
+		llfree_tree_contention_t c = {
+			.tree = tree_id(i),
+			.tree_cas = atomic_load_explicit(
+				&self->contention[i].tree, memory_order_relaxed),
+			.child_cas = atomic_load_explicit(
+				&self->contention[i].children,
+				memory_order_relaxed),
+		};
+		uint64_t total = c.tree_cas + c.child_cas;
+		if (total == 0)
+			continue;
+
+		// Insert into the sorted top list
+		size_t pos = n;
+		while (pos > 0 &&
+		       out[pos - 1].tree_cas + out[pos - 1].child_cas < total)
+			pos--;
+		if (pos >= len)
+			continue;
+		for (size_t j = LL_MIN(n, len - 1); j > pos; j--)
+			out[j] = out[j - 1];
+		out[pos] = c;
+		n = LL_MIN(n + 1, len);
+	}
+	return n;
+#else
+	(void)self;
+	(void)out;
+	(void)len;
+	return 0;
+#endif
+}
+
+void trees_contention_reset(trees_t *self)
+{
+#if LLFREE_ENABLE_CONTENTION
+	for (size_t i = 0; i < self->len; i++) {
+		atomic_store_explicit(&self->contention[i].tree, 0,
+				      memory_order_relaxed);
+		atomic_store_explicit(&self->contention[i].children, 0,
+				      memory_order_relaxed);
+	}
+#else
+	(void)self;
+#endif
+}
+
 void trees_print(const trees_t *self, size_t indent)
 {
 	llfree_info_cont("%strees: %zu (%u) {\n", INDENT(indent), self->len,
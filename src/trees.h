@@ -1,7 +1,9 @@
 #pragma once
 
 #include "tree.h"
+#include "hooks.h"
 #include "llfree.h"
+#include "metrics.h"
 #include "utils.h"
 
 /// Manages the tree array
@@ -10,13 +12,29 @@ typedef struct trees {
 	_Atomic(tree_t) *entries;
 	size_t len;
 	uint8_t default_class;
+#if LLFREE_ENABLE_CONTENTION
+	/// Contention counters per tree, stored after the entries
+	metrics_contention_t *contention;
+#endif
+#if LLFREE_ENABLE_HOOKS
+	/// Event hooks, stored at the end of the buffer
+	hooks_t *hooks;
+#endif
 } trees_t;
 
 /// Size of the metadata buffer needed for the tree array
 static inline ll_unused size_t trees_metadata_size(size_t frames)
 {
 	size_t tree_len = div_ceil(frames, LLFREE_TREE_SIZE);
-	return align_up(sizeof(tree_t) * tree_len, LLFREE_CACHE_SIZE);
+	size_t size = align_up(sizeof(tree_t) * tree_len, LLFREE_CACHE_SIZE);
+#if LLFREE_ENABLE_CONTENTION
+	size += align_up(sizeof(metrics_contention_t) * tree_len,
+			 LLFREE_CACHE_SIZE);
+#endif
+#if LLFREE_ENABLE_HOOKS
+	size += align_up(sizeof(hooks_t), LLFREE_CACHE_SIZE);
+#endif
+	return size;
 }
 
 /// Initialize callback: given tree start frame id, return free frame count
@@ -38,6 +56,12 @@ tree_t trees_load(const trees_t *self, tree_id_t idx);
 bool trees_steal(trees_t *self, tree_id_t idx, treeF_t frames, uint8_t *class,
 		 llfree_policy_fn policy);
 
+/// Steal all frames of the `n` consecutive trees starting at idx, which have
+/// to be entirely free and not reserved. Partial claims are undone on failure.
+/// On success, writes the resulting class of the first tree to *class.
+bool trees_steal_run(trees_t *self, tree_id_t idx, size_t n, uint8_t *class,
+		     llfree_policy_fn policy);
+
 /// Increment free counter; resets class to default when tree becomes fully free.
 void trees_put(trees_t *self, tree_id_t idx, treeF_t frames,
 	       llfree_policy_fn policy);
@@ -103,5 +127,11 @@ llfree_result_t trees_change(trees_t *self, llfree_tree_match_t matcher,
 			     llfree_tree_change_t change,
 			     trees_fetch_free_fn fetch_free, void *fetch_ctx);
 
+/// Write the up to `len` most contended trees to `out`, returns their number
+size_t trees_contention(const trees_t *self, llfree_tree_contention_t *out,
+			size_t len);
+/// Reset the contention counters
+void trees_contention_reset(trees_t *self);
+
 /// Print all tree entries
 void trees_print(const trees_t *self, size_t indent);
@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
 
 #define ll_align(align) __attribute__((aligned(align)))
 #define unlikely(x) __builtin_expect(!!(x), 0)
@@ -30,6 +32,17 @@
 #define llfree_info(str, ...) (void)0
 #endif
 
+/// Monotonic timestamp in nanoseconds for latency measurements
+static inline uint64_t llfree_timestamp(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+/// Current cpu, the metrics are sharded by it
+#define llfree_cpu() ((size_t)sched_getcpu())
+
 #ifdef DEBUG
 #define llfree_debug(str, ...)                                                 \
 	fprintf(stderr, "\x1b[90m%s:%d: " str "\x1b[0m\n", __FILE__, __LINE__, \
@@ -60,6 +73,35 @@ static const int ATOM_STORE_ORDER = memory_order_release;
 						      ATOM_LOAD_ORDER);  \
 	})
 
+/// Checks if the 32-bit value at `obj` (4-byte aligned) contains `expected`
+/// and writes `desired` to it if so, for two adjacent 16-bit atomics.
+#define atom_cmp_exchange_32(obj, expected, desired)                     \
+	({                                                               \
+		llfree_debug("cmpxchg 32");                              \
+		__sync_bool_compare_and_swap((uint32_t *)(obj), (expected), \
+					     (desired));                 \
+	})
+
+/// Checks if the 64-bit value at `obj` (8-byte aligned) contains `expected`
+/// and writes `desired` to it if so, for adjacent smaller atomics.
+#define atom_cmp_exchange_64(obj, expected, desired)                     \
+	({                                                               \
+		llfree_debug("cmpxchg 64");                              \
+		__sync_bool_compare_and_swap((uint64_t *)(obj), (expected), \
+					     (desired));                 \
+	})
+
+#if LLFREE_ENABLE_WIDE_CAS
+/// Checks if the two 64-bit values at `obj` (16-byte aligned) contain
+/// `expected` and writes `desired` to them if so, both are 128-bit integers.
+#define atom_cmp_exchange_wide(obj, expected, desired)                       \
+	({                                                                   \
+		llfree_debug("cmpxchg wide");                                \
+		__sync_bool_compare_and_swap((unsigned __int128 *)(obj),     \
+					     (expected), (desired));         \
+	})
+#endif
+
 #define atom_swap(obj, desired)                                            \
 	({                                                                 \
 		llfree_debug("swap");                                      \
@@ -77,6 +119,14 @@ static const int ATOM_STORE_ORDER = memory_order_release;
 		atomic_store_explicit(obj, val, ATOM_STORE_ORDER); \
 	})
 
+#if LLFREE_ENABLE_COUNTERS
+/// Counts a failed CAS attempt in atom_update (provided by llfree)
+void llfree_count_cas_retry(void);
+#define atom_retry() llfree_count_cas_retry()
+#else
+#define atom_retry() (void)0
+#endif
+
 /// Atomic fetch-modify-update macro.
 ///
 /// This macro loads the value at `atom_ptr`, stores its llfree_result in `old_val`
@@ -105,7 +155,11 @@ static const int ATOM_STORE_ORDER = memory_order_release;
 /// }
 /// printf("old value %u\n", old);
 /// ```
-#define atom_update(atom_ptr, old_val, fn, ...)                              \
+#define atom_update(atom_ptr, old_val, fn, ...) \
+	atom_update_with(atom_ptr, old_val, (void)0, fn, ##__VA_ARGS__)
+
+/// Like atom_update, but evaluates `on_retry` after every failed CAS.
+#define atom_update_with(atom_ptr, old_val, on_retry, fn, ...)               \
 	({                                                                   \
 		/* NOLINTBEGIN */                                            \
 		llfree_debug("update");                                      \
@@ -121,6 +175,8 @@ static const int ATOM_STORE_ORDER = memory_order_release;
 				_ret = true;                                 \
 				break;                                       \
 			}                                                    \
+			on_retry;                                            \
+			atom_retry();                                        \
 		}                                                            \
 		_ret;                                                        \
 		/*NOLINTEND*/                                                \
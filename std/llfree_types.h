@@ -31,14 +31,89 @@
 #define LLFREE_TREE_ORDER (LLFREE_HUGE_ORDER + LLFREE_TREE_CHILDREN_ORDER)
 #define LLFREE_TREE_SIZE (1u << LLFREE_TREE_ORDER)
 
-/// Maximum order that can be allocated
+/// Maximum order that can be allocated from a single tree
 #define LLFREE_MAX_ORDER LLFREE_TREE_ORDER
+/// Maximum order of gigantic frames (1 GiB for 4 KiB frames), which are
+/// allocated from aligned runs of entirely free trees
+#define LLFREE_GIGANTIC_ORDER 18u
 
 /// Enable reserve on free heuristic
+#ifndef LLFREE_ENABLE_FREE_RESERVE // Can be defined by the user
 #define LLFREE_ENABLE_FREE_RESERVE false
+#endif
+/// Number of frames each local slot buffers in llfree_put before they are
+/// freed together, sorted by address (0 frees them immediately)
+#ifndef LLFREE_DEFERRED_FREE // Can be defined by the user
+#define LLFREE_DEFERRED_FREE 0
+#endif
+/// Number of order 0 frames each local slot caches for reuse by llfree_get and
+/// llfree_put, without updating the bitfields (0 disables the magazines)
+#ifndef LLFREE_MAGAZINE // Can be defined by the user
+#define LLFREE_MAGAZINE 0
+#endif
+/// Let the local slots own a bitfield row of their reserved tree and allocate
+/// order 0 frames from a private copy of it
+#ifndef LLFREE_ENABLE_OWNED_ROWS // Can be defined by the user
+#define LLFREE_ENABLE_OWNED_ROWS false
+#endif
+/// Track the full bitfield rows in the children to skip them in the search.
+/// This widens the children to 32 bits, which changes the metadata layout
+/// (LLFREE_INIT_RECOVER needs the same setting) and halves the children
+/// that are updated with a single CAS.
+#ifndef LLFREE_ENABLE_ROW_SUMMARY // Can be defined by the user
+#define LLFREE_ENABLE_ROW_SUMMARY false
+#endif
+/// Local slots hold back frames (deferred frees, magazines or owned rows)
+#define LLFREE_LOCAL_CACHE \
+	(LLFREE_DEFERRED_FREE > 0 || LLFREE_MAGAZINE > 0 || \
+	 LLFREE_ENABLE_OWNED_ROWS)
 /// Allocate first from already install huge frames, before falling back to evicted ones
 #define LLFREE_PREFER_INSTALLED false
 
+/// Search the bitfields with SIMD instructions (AVX2, AVX-512 or NEON),
+/// enabled if the target supports them (not in kernels built without FPU)
+#ifndef LLFREE_ENABLE_SIMD // Can be defined by the user
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__ARM_NEON)
+#define LLFREE_ENABLE_SIMD true
+#else
+#define LLFREE_ENABLE_SIMD false
+#endif
+#endif
+
+/// Allocate two bitfield rows (order 7 and 8) or the children of the largest
+/// huge order with a single 128-bit CAS (cmpxchg16b, CASP), enabled if the
+/// target supports it (e.g. with -mcx16)
+#ifndef LLFREE_ENABLE_WIDE_CAS // Can be defined by the user
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+#define LLFREE_ENABLE_WIDE_CAS true
+#else
+#define LLFREE_ENABLE_WIDE_CAS false
+#endif
+#endif
+
+/// Record per-core latency histograms of llfree_get/llfree_put
+#ifndef LLFREE_ENABLE_HISTOGRAMS // Can be defined by the user
+#define LLFREE_ENABLE_HISTOGRAMS false
+#endif
+/// Support event hooks (see llfree_set_hook), disabling removes the branches
+#ifndef LLFREE_ENABLE_HOOKS // Can be defined by the user
+#define LLFREE_ENABLE_HOOKS true
+#endif
+/// Report each llfree_get/llfree_put to a trace sink (see llfree_set_trace)
+#ifndef LLFREE_ENABLE_TRACE // Can be defined by the user
+#define LLFREE_ENABLE_TRACE false
+#endif
+/// Count failed CAS attempts per tree (see llfree_contention)
+#ifndef LLFREE_ENABLE_CONTENTION // Can be defined by the user
+#define LLFREE_ENABLE_CONTENTION false
+#endif
+/// Count slow-path events per core (see llfree_counters)
+#ifndef LLFREE_ENABLE_COUNTERS // Can be defined by the user
+#define LLFREE_ENABLE_COUNTERS false
+#endif
+/// Number of per-core slots for the metrics, additional cores share slots
+#define LLFREE_METRICS_CORES 64u
+
 /// Minimal alignment the llfree requires for its memory range
 #define LLFREE_ALIGN (1u << LLFREE_TREE_ORDER << LLFREE_FRAME_BITS)
 
@@ -82,6 +82,43 @@ declare_test(bitfield_first_zeros)
 	return success;
 }
 
+bool first_zeros_run(uint64_t *v, size_t len, size_t align, size_t *pos);
+
+#define check_fzr(v, len, align, expected_v, expected_pos)                     \
+	({                                                                     \
+		uint64_t val = (v);                                            \
+		size_t pos;                                                    \
+		bool found = first_zeros_run(&val, (len), (align), &pos);      \
+		check_equal_m(PRIu64, val, (uint64_t)(expected_v), "value");   \
+		check_equal_m("d", found, (expected_pos) < SIZE_MAX, "found"); \
+		if (found)                                                     \
+			check_equal_m("zu", (size_t)pos,                       \
+				      (size_t)(expected_pos), "position");     \
+	})
+
+declare_test(bitfield_first_zeros_run)
+{
+	bool success = true;
+
+	check_fzr(0lu, 3lu, 1lu, 0b111lu, 0ll);
+	check_fzr(0b1lu, 3lu, 1lu, 0b1111lu, 1ll);
+	check_fzr(0b1lu, 3lu, 4lu, 0x71lu, 4ll);
+	check_fzr(0b100100lu, 5lu, 1lu, 0x7e4lu, 6ll);
+	check_fzr(0xf0lu, 12lu, 4lu, 0xffff0lu, 8ll);
+
+	check_fzr(0lu, 48lu, 16lu, 0xfffffffffffflu, 0ll);
+	check_fzr(0x1fflu, 48lu, 16lu, 0xffffffffffff01fflu, 16ll);
+	check_fzr(1lu << 20, 48lu, 16lu, 1lu << 20, SIZE_MAX);
+
+	// Upper bound
+	check_fzr(0x1fffffffffffffflu, 7lu, 1lu, 0xfffffffffffffffflu, 57ll);
+	check_fzr(0x3fffffffffffffflu, 7lu, 1lu, 0x3fffffffffffffflu, SIZE_MAX);
+	check_fzr(0lu, 64lu, 1lu, 0xfffffffffffffffflu, 0ll);
+	check_fzr(1lu, 64lu, 1lu, 1lu, SIZE_MAX);
+
+	return success;
+}
+
 declare_test(bitfield_set_bit)
 {
 	bool success = true;
@@ -131,6 +168,90 @@ declare_test(bitfield_set_bit)
 	return success;
 }
 
+declare_test(bitfield_set_next_orders)
+{
+	bool success = true;
+
+	// Only single frames are free in the first rows
+	const uint64_t ODD = 0xaaaaaaaaaaaaaaaa;
+	bitfield_t initial = bf(ODD, ODD, ODD, ODD, ODD, ODD, UINT64_MAX,
+				0xffffffff0000ffff);
+
+	bitfield_t actual = initial;
+	llfree_result_t ret = field_set_next(&actual, frame_id(0), 0);
+	check_equal(PRIu64, ret.frame.value, (uint64_t)0);
+
+	// Skip the full row
+	actual = initial;
+	ret = field_set_next(&actual, frame_id(6 * 64), 0);
+	check_equal(PRIu64, ret.frame.value, (uint64_t)(7 * 64 + 16));
+
+	for (size_t order = 1; order <= 4; order++) {
+		actual = initial;
+		ret = field_set_next(&actual, frame_id(0), order);
+		check_equal_m(PRIu64, ret.frame.value, (uint64_t)(7 * 64 + 16),
+			      "only the last row has larger runs");
+	}
+
+	actual = initial;
+	for (size_t order = 5; order < LLFREE_CHILD_ORDER; order++) {
+		ret = field_set_next(&actual, frame_id(0), order);
+		check_equal("u", ret.error, LLFREE_ERR_MEMORY);
+	}
+	check_equal_bitfield_m(actual, initial, "no change");
+
+	// Multiple rows
+	initial = bf(UINT64_MAX, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x1);
+	actual = initial;
+	ret = field_set_next(&actual, frame_id(0), 7);
+	check_equal(PRIu64, ret.frame.value, (uint64_t)(4 * 64));
+	ret = field_set_next(&actual, frame_id(0), 7);
+	check_equal("u", ret.error, LLFREE_ERR_MEMORY);
+	actual = initial;
+	ret = field_set_next(&actual, frame_id(0), 8);
+	check_equal("u", ret.error, LLFREE_ERR_MEMORY);
+
+	return success;
+}
+
+declare_test(bitfield_set_next_n)
+{
+	bool success = true;
+
+	bitfield_t actual = bf(0xff, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0);
+	bitfield_t expect = bf(0xffff, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0);
+	frame_id_t out[64];
+	size_t count = field_set_next_n(&actual, frame_id(0), 0, out, 8);
+	check_equal("zu", count, (size_t)8);
+	check_equal_bitfield(actual, expect);
+	for (size_t i = 0; i < count; i++)
+		check_equal(PRIu64, out[i].value, (uint64_t)(8 + i));
+
+	// Continues in the next rows and wraps around
+	actual = bf(0xff, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX,
+		    UINT64_MAX, UINT64_MAX, 0x0f);
+	expect = bf(0xffffffff, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX,
+		    UINT64_MAX, UINT64_MAX, ~0xf0ull);
+	count = field_set_next_n(&actual, frame_id(448), 3, out, 10);
+	check_equal("zu", count, (size_t)10);
+	check_equal_bitfield(actual, expect);
+	check_equal(PRIu64, out[0].value, (uint64_t)(448 + 8));
+	check_equal(PRIu64, out[6].value, (uint64_t)(448 + 56));
+	check_equal(PRIu64, out[7].value, (uint64_t)8);
+	check_equal(PRIu64, out[9].value, (uint64_t)24);
+
+	// Returns less if the field is exhausted
+	count = field_set_next_n(&actual, frame_id(0), 4, out, 64);
+	check_equal("zu", count, (size_t)2);
+	count = field_set_next_n(&actual, frame_id(0), 0, out, 64);
+	check_equal("zu", count, (size_t)4);
+	check_equal(PRIu64, out[0].value, (uint64_t)(448 + 4));
+	count = field_set_next_n(&actual, frame_id(0), 0, out, 64);
+	check_equal("zu", count, (size_t)0);
+
+	return success;
+}
+
 declare_test(bitfield_reset_bit)
 {
 	bool success = true;
@@ -185,6 +306,43 @@ declare_test(bitfield_reset_bit)
 	return success;
 }
 
+declare_test(bitfield_toggle_rows)
+{
+	bool success = true;
+
+	bitfield_t actual = bf(0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0);
+	bitfield_t expect = bf(0x0, 0x0, UINT64_MAX, UINT64_MAX, 0x0, 0x0,
+			       0x0, 0x0);
+	llfree_result_t ret = field_toggle(&actual, 128, 7, false);
+	check(llfree_is_ok(ret));
+	check_equal_bitfield(actual, expect);
+
+	ret = field_toggle(&actual, 128, 7, false);
+	check_equal("u", ret.error, LLFREE_ERR_MEMORY);
+	check_equal_bitfield_m(actual, expect, "no change");
+
+	// The first rows are updated and rolled back
+	actual = bf(0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x10);
+	expect = actual;
+	ret = field_toggle(&actual, 256, 8, false);
+	check_equal("u", ret.error, LLFREE_ERR_MEMORY);
+	check_equal_bitfield_m(actual, expect, "rolled back");
+	ret = field_toggle(&actual, 0, 8, false);
+	check(llfree_is_ok(ret));
+	ret = field_toggle(&actual, 0, 8, true);
+	check(llfree_is_ok(ret));
+	check_equal_bitfield(actual, expect);
+
+	actual = bf(UINT64_MAX, UINT64_MAX, UINT64_MAX, 0x1, 0x0, 0x0, 0x0,
+		    0x0);
+	expect = actual;
+	ret = field_toggle(&actual, 0, 8, true);
+	check_equal("u", ret.error, LLFREE_ERR_MEMORY);
+	check_equal_bitfield_m(actual, expect, "rolled back");
+
+	return success;
+}
+
 declare_test(bitfield_count_bits)
 {
 	bool success = true;
@@ -77,3 +77,40 @@ declare_test(child_counter_dec)
 
 	return success;
 }
+
+#if LLFREE_ENABLE_ROW_SUMMARY
+declare_test(child_summary)
+{
+	bool success = true;
+
+	check_equal("x", child_rows(0, 65), 0x2u);
+	check_equal("x", child_rows(LLFREE_ATOMIC_ORDER, 128), 0x4u);
+	check_equal("x", child_rows(LLFREE_ATOMIC_ORDER + 2, 256), 0xf0u);
+	check_equal("x", child_rows(LLFREE_CHILD_ORDER, 0), CHILD_ROWS_ALL);
+
+	child_t actual = child_new(LLFREE_CHILD_SIZE - 64, false);
+	check(child_set_full(&actual, 0x1));
+	check_m(!child_set_full(&actual, 0x1), "already full");
+	check(child_set_full(&actual, 0x2));
+	check_equal("x", (unsigned)actual.full, 0x3u);
+	check_equal("zu", child_next_row(actual, 0), (size_t)2);
+	check_equal("zu", child_next_row(actual, 5), (size_t)5);
+
+	check(child_inc_at(&actual, 0, 64 + 5));
+	check_equal("u", actual.free, LLFREE_CHILD_SIZE - 63);
+	check_equal("x", (unsigned)actual.full, 0x1u);
+	check_equal("zu", child_next_row(actual, 0), (size_t)1);
+
+	check(child_clear_full(&actual, 0x3));
+	check_m(!child_clear_full(&actual, 0x3), "nothing to clear");
+	check_equal("x", (unsigned)actual.full, 0x0u);
+
+	actual.full = CHILD_ROWS_ALL;
+	check_equal("zu", child_next_row(actual, 3), (size_t)3);
+
+	actual = child_new(0, true);
+	check_m(!child_set_full(&actual, 0x1), "is huge");
+
+	return success;
+}
+#endif
@@ -112,6 +112,8 @@ declare_test(llfree_alloc_s)
 				   llreq(&upper, 0, LLFREE_HUGE_ORDER))));
 	}
 
+	// Frames cached by the local slot are allocated in the bitfields
+	llfree_flush(&upper);
 	check_equal("zu", n + (n << LLFREE_HUGE_ORDER),
 		    llfree_frames(&upper) -
 			    llfree_tree_stats(&upper).free_frames);
@@ -193,6 +195,8 @@ declare_test(llfree_general_function)
 	llfree_validate(&upper);
 	check_m(llfree_is_ok(ret), "successfully free");
 
+	// Deferred frees are only counted once they are flushed
+	llfree_flush(&upper);
 	check_m(llfree_tree_stats(&upper).free_frames == FRAMES,
 		"right number of free frames");
 
@@ -278,12 +282,20 @@ declare_test(llfree_put)
 		check(llfree_is_ok(ret));
 	}
 
-	// core 2 must have now this first tree reserved
-	// if (LLFREE_ENABLE_FREE_RESERVE) {
-	// 	reserved_t res = upper.local[2].reserved[0];
-	// 	check_equal("zu", tree_from_row(res.start_row),
-	// 		    (uint64_t)tree_from_frame(reserved[0]));
-	// }
+#if LLFREE_ENABLE_FREE_RESERVE
+	// core 1 must have now this first tree reserved
+	local_result_t res = ll_local_stats_at(
+		upper.local, tree_from_frame(frame_id(reserved[0])));
+	check(res.success);
+	check_equal("u", res.class, 0);
+
+	// and allocates from it
+	ret = llfree_get(&upper, frame_id_none(), llreq(&upper, 1, 0));
+	check(llfree_is_ok(ret));
+	check_equal("zu", tree_from_frame(ret.frame).value,
+		    tree_from_frame(frame_id(reserved[0])).value);
+	check(llfree_is_ok(llfree_put(&upper, ret.frame, llreq(&upper, 1, 0))));
+#endif
 	if (!success)
 		llfree_print(&upper);
 	llfree_validate(&upper);
@@ -472,6 +484,7 @@ declare_test(llfree_parallel_alloc)
 	}
 
 	// now all threads are terminated
+	llfree_flush(&upper);
 	check_equal("zu",
 		    llfree_frames(&upper) -
 			    llfree_tree_stats(&upper).free_frames,
@@ -626,6 +639,276 @@ declare_test(llfree_get_huge)
 	return success;
 }
 
+declare_test(llfree_gigantic)
+{
+	bool success = true;
+	// Runs of four trees
+	const uint8_t order = LLFREE_TREE_ORDER + 2;
+	const size_t frames = 4ul << order;
+	lldrop llfree_t upper = llfree_new(1, frames, LLFREE_INIT_FREE);
+
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, order));
+	check(llfree_is_ok(res));
+	check_equal(PRIu64, res.frame.value % (1ul << order), (uint64_t)0);
+	check_equal("zu", llfree_stats(&upper).free_frames,
+		    frames - (1ul << order));
+	// The children are allocated as huge frames
+	ll_stats_t stats =
+		llfree_stats_at(&upper, res.frame, LLFREE_TREE_ORDER);
+	check_equal("zu", stats.free_frames, (size_t)0);
+	frame_id_t first = res.frame;
+
+	// Invalid orders and alignments
+	check_equal("u",
+		    llfree_get(&upper, frame_id_none(),
+			       llreq(&upper, 0, LLFREE_GIGANTIC_ORDER + 1))
+			    .error,
+		    LLFREE_ERR_ARGUMENT);
+	frame_id_t misaligned = frame_id(LLFREE_TREE_SIZE);
+	check_equal("u",
+		    llfree_get(&upper, frame_id_some(misaligned),
+			       llreq(&upper, 0, order))
+			    .error,
+		    LLFREE_ERR_ARGUMENT);
+
+	// A reserved tree blocks its run, even if it is entirely free
+	llfree_result_t small =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(small));
+	check(llfree_is_ok(
+		llfree_put(&upper, small.frame, llreq(&upper, 0, 0))));
+
+	frame_id_t gigantic[3] = { first };
+	size_t n = 1;
+	for (; n < 3; n++) {
+		res = llfree_get(&upper, frame_id_none(),
+				 llreq(&upper, 0, order));
+		check(llfree_is_ok(res));
+		gigantic[n] = res.frame;
+	}
+	check_equal("u",
+		    llfree_get(&upper, frame_id_none(), llreq(&upper, 0, order))
+			    .error,
+		    LLFREE_ERR_MEMORY);
+
+	// Available after releasing the reservation
+	llfree_drain(&upper);
+	frame_id_t blocked =
+		frame_id(align_down(small.frame.value, 1ul << order));
+	res = llfree_get(&upper, frame_id_some(blocked),
+			 llreq(&upper, 0, order));
+	check(llfree_is_ok(res));
+	check_equal("zu", llfree_stats(&upper).free_frames, (size_t)0);
+	llfree_validate(&upper);
+
+	check(llfree_is_ok(
+		llfree_put(&upper, res.frame, llreq(&upper, 0, order))));
+	size_t freed = llfree_put_batch(&upper, llreq(&upper, 0, order),
+					gigantic, n);
+	check_equal("zu", freed, n);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	// Double free
+	check(!llfree_is_ok(
+		llfree_put(&upper, first, llreq(&upper, 0, order))));
+	llfree_validate(&upper);
+
+	return success;
+}
+
+declare_test(llfree_gigantic_bounds)
+{
+	bool success = true;
+	const uint8_t order = LLFREE_TREE_ORDER + 2;
+	// Five trees, the last one does not belong to a whole run
+	const size_t frames = 5 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(5, frames, LLFREE_INIT_FREE);
+
+	// The local start is in the incomplete run
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 4, order));
+	check(llfree_is_ok(res));
+	check_equal(PRIu64, res.frame.value, (uint64_t)0);
+	check(llfree_is_ok(
+		llfree_put(&upper, res.frame, llreq(&upper, 4, order))));
+
+	// Gigantic frames out of bounds
+	frame_id_t last = frame_id(4 * LLFREE_TREE_SIZE);
+	check(!llfree_is_ok(llfree_put(&upper, last, llreq(&upper, 0, order))));
+
+	// Frees nothing if only some of the trees are allocated
+	for (size_t i = 0; i < 3; i++) {
+		frame_id_t tree = frame_id(i * LLFREE_TREE_SIZE);
+		check(llfree_is_ok(llfree_get(&upper, frame_id_some(tree),
+					      llreq(&upper, 0,
+						    LLFREE_TREE_ORDER))));
+	}
+	check(!llfree_is_ok(
+		llfree_put(&upper, frame_id(0), llreq(&upper, 0, order))));
+	check_equal("zu", llfree_stats(&upper).free_frames,
+		    frames - 3 * LLFREE_TREE_SIZE);
+	for (size_t i = 0; i < 3; i++) {
+		frame_id_t tree = frame_id(i * LLFREE_TREE_SIZE);
+		check(llfree_is_ok(llfree_put(
+			&upper, tree, llreq(&upper, 0, LLFREE_TREE_ORDER))));
+	}
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	return success;
+}
+
+declare_test(llfree_get_contig)
+{
+	bool success = true;
+	const size_t frames = 4 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(1, frames, LLFREE_INIT_FREE);
+
+	llfree_result_t first = llfree_get_contig(&upper, 1000, 1, 0);
+	check(llfree_is_ok(first));
+	check_equal(PRIu64, first.frame.value, (uint64_t)0);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 1000);
+
+	// Ranges that contain an allocated frame are skipped
+	llfree_request_t req = llreq(&upper, 0, 0);
+	req.local = ll_none();
+	frame_id_t single = frame_id(LLFREE_TREE_SIZE + 7);
+	check(llfree_is_ok(llfree_get(&upper, frame_id_some(single), req)));
+	llfree_result_t second =
+		llfree_get_contig(&upper, LLFREE_TREE_SIZE + 3, 1, 0);
+	check(llfree_is_ok(second));
+	check_equal(PRIu64, second.frame.value, single.value + 1);
+
+	// Aligned first fit
+	llfree_result_t third = llfree_get_contig(&upper, 100, 64, 0);
+	check(llfree_is_ok(third));
+	check_equal(PRIu64, third.frame.value, (uint64_t)1024);
+
+	check_equal("u", llfree_get_contig(&upper, 10, 3, 0).error,
+		    LLFREE_ERR_ARGUMENT);
+	check_equal("u", llfree_get_contig(&upper, 0, 1, 0).error,
+		    LLFREE_ERR_ARGUMENT);
+	check_equal("u",
+		    llfree_get_contig(&upper, 2 * LLFREE_TREE_SIZE, 1, 0).error,
+		    LLFREE_ERR_MEMORY);
+	check_equal("zu", llfree_stats(&upper).free_frames,
+		    frames - 1000 - 1 - (LLFREE_TREE_SIZE + 3) - 100);
+	llfree_validate(&upper);
+
+	// Ranges that are not entirely allocated are rejected as a whole
+	check_equal("u", llfree_put_contig(&upper, first.frame, 1001, 0).error,
+		    LLFREE_ERR_ADDRESS);
+	frame_id_t end = frame_id(frames - 10);
+	check_equal("u", llfree_put_contig(&upper, end, 20, 0).error,
+		    LLFREE_ERR_ADDRESS);
+	check_equal("zu", llfree_stats(&upper).free_frames,
+		    frames - 1000 - 1 - (LLFREE_TREE_SIZE + 3) - 100);
+
+	check(llfree_is_ok(llfree_put_contig(&upper, first.frame, 1000, 0)));
+	check(llfree_is_ok(llfree_put_contig(&upper, second.frame,
+					     LLFREE_TREE_SIZE + 3, 0)));
+	check(llfree_is_ok(llfree_put_contig(&upper, third.frame, 100, 0)));
+	check(llfree_is_ok(llfree_put(&upper, single, req)));
+	check_equal("u", llfree_put_contig(&upper, third.frame, 100, 0).error,
+		    LLFREE_ERR_ADDRESS);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	// Reserved trees are stolen from the local reservation
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	llfree_flush(&upper);
+	check(trees_load(&upper.trees, tree_from_frame(res.frame)).reserved);
+	llfree_result_t all = llfree_get_contig(&upper, frames, 1, 0);
+	check(llfree_is_ok(all));
+	check_equal(PRIu64, all.frame.value, (uint64_t)0);
+	check_equal("zu", llfree_stats(&upper).free_frames, (size_t)0);
+	check(llfree_is_ok(llfree_put_contig(&upper, all.frame, frames, 0)));
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	return success;
+}
+
+declare_test(llfree_get_run)
+{
+	bool success = true;
+	const size_t frames = 2 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(1, frames, LLFREE_INIT_FREE);
+
+	// Exact sizes without rounding up
+	static const size_t LENS[] = { 3, 5, 12, 48 };
+	llfree_result_t runs[4];
+	size_t allocated = 0;
+	for (size_t i = 0; i < 4; i++) {
+		runs[i] = llfree_get_run(&upper, llreq(&upper, 0, 0), LENS[i],
+					 4);
+		check(llfree_is_ok(runs[i]));
+		check_equal(PRIu64, runs[i].frame.value % 4, (uint64_t)0);
+		// Within a single row
+		check_equal(PRIu64, runs[i].frame.value / LLFREE_ATOMIC_SIZE,
+			    (runs[i].frame.value + LENS[i] - 1) /
+				    LLFREE_ATOMIC_SIZE);
+		allocated += LENS[i];
+	}
+	check_equal("zu", llfree_stats(&upper).free_frames,
+		    frames - allocated);
+
+	// The local reservation continues at the last run
+	tree_id_t tree = tree_from_frame(runs[3].frame);
+	local_result_t local = ll_local_stats_at(upper.local, tree);
+	check(local.success);
+	check_equal("zu", local.start_row.value,
+		    row_from_frame(runs[3].frame).value);
+
+	check_equal("u",
+		    llfree_get_run(&upper, llreq(&upper, 0, 0), 65, 1).error,
+		    LLFREE_ERR_ARGUMENT);
+	check_equal("u",
+		    llfree_get_run(&upper, llreq(&upper, 0, 0), 3, 128).error,
+		    LLFREE_ERR_ARGUMENT);
+	check_equal("u",
+		    llfree_get_run(&upper, llreq(&upper, 0, 0), 3, 3).error,
+		    LLFREE_ERR_ARGUMENT);
+	check_equal("u",
+		    llfree_get_run(&upper, llreq(&upper, 0, 2), 3, 4).error,
+		    LLFREE_ERR_ARGUMENT);
+
+	// Freed at the same granularity
+	for (size_t i = 0; i < 4; i++) {
+		check(llfree_is_ok(llfree_put_run(&upper, runs[i].frame,
+						  llreq(&upper, 0, 0),
+						  LENS[i])));
+	}
+	check(!llfree_is_ok(llfree_put_run(&upper, runs[0].frame,
+					   llreq(&upper, 0, 0), LENS[0])));
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	// Without free trees, runs are stolen from the local reservation
+	llfree_request_t global = llreq(&upper, 0, LLFREE_HUGE_ORDER);
+	global.local = ll_none();
+	for (size_t i = 0; i < LLFREE_TREE_SIZE >> LLFREE_HUGE_ORDER; i++) {
+		llfree_result_t res =
+			llfree_get(&upper, frame_id_none(), global);
+		check(llfree_is_ok(res));
+	}
+	global.order = 0;
+	check_equal("zu", llfree_stats(&upper).free_frames,
+		    (size_t)LLFREE_TREE_SIZE);
+	check(trees_load(&upper.trees, tree).reserved);
+	llfree_result_t stolen = llfree_get_run(&upper, global, 12, 1);
+	check(llfree_is_ok(stolen));
+	check_equal("zu", tree_from_frame(stolen.frame).value, tree.value);
+	check(llfree_is_ok(
+		llfree_put_run(&upper, stolen.frame, global, (size_t)12)));
+	llfree_validate(&upper);
+
+	return success;
+}
+
 struct llfree_less_mem {
 	_Atomic(uint64_t) sync0;
 	_Atomic(uint64_t) sync1;
@@ -771,3 +1054,486 @@ declare_test(llfree_alloc_at)
 
 	return success;
 }
+
+declare_test(llfree_get_batch)
+{
+	bool success = true;
+
+	const size_t frames = 4 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(2, frames, LLFREE_INIT_FREE);
+
+	static frame_id_t out[LLFREE_TREE_SIZE];
+	size_t got = llfree_get_batch(&upper, llreq(&upper, 0, 0), out, 64);
+	check_equal("zu", got, (size_t)64);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 64);
+	for (size_t i = 0; i < 64; i++) {
+		for (size_t j = 0; j < i; j++)
+			check(out[i].value != out[j].value);
+	}
+	for (size_t i = 0; i < 64; i++) {
+		check(llfree_is_ok(
+			llfree_put(&upper, out[i], llreq(&upper, 0, 0))));
+	}
+	llfree_flush(&upper);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+
+	// Larger orders are aligned
+	got = llfree_get_batch(&upper, llreq(&upper, 1, 3), out, 20);
+	check_equal("zu", got, (size_t)20);
+	for (size_t i = 0; i < 20; i++) {
+		check_equal(PRIu64, out[i].value % (1 << 3), (uint64_t)0);
+		check(llfree_is_ok(
+			llfree_put(&upper, out[i], llreq(&upper, 1, 3))));
+	}
+	llfree_flush(&upper);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+
+	// Batches span multiple trees and stop when the memory is exhausted
+	size_t total = 0;
+	for (;;) {
+		got = llfree_get_batch(&upper, llreq(&upper, 0, 0), out,
+				       LLFREE_TREE_SIZE);
+		if (got == 0)
+			break;
+		total += got;
+		check(got <= LLFREE_TREE_SIZE);
+	}
+	check_equal("zu", total, frames);
+	check_equal("zu", llfree_stats(&upper).free_frames, (size_t)0);
+	llfree_validate(&upper);
+
+	return success;
+}
+
+declare_test(llfree_put_batch)
+{
+	bool success = true;
+
+	const size_t frames = 4 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(2, frames, LLFREE_INIT_FREE);
+
+	static frame_id_t out[2 * LLFREE_TREE_SIZE];
+	size_t got = llfree_get_batch(&upper, llreq(&upper, 0, 0), out,
+				      2 * LLFREE_TREE_SIZE);
+	check_equal("zu", got, (size_t)(2 * LLFREE_TREE_SIZE));
+	size_t freed = llfree_put_batch(&upper, llreq(&upper, 0, 0), out, got);
+	check_equal("zu", freed, got);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	check_equal("zu", llfree_tree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	// Unordered frames of different trees and orders
+	frame_id_t f[4] = { frame_id(3 * LLFREE_TREE_SIZE + 8), frame_id(16),
+			    frame_id(8), frame_id(LLFREE_CHILD_SIZE) };
+	for (size_t i = 0; i < 4; i++) {
+		check(llfree_is_ok(llfree_get(&upper, frame_id_some(f[i]),
+					      llreq(&upper, 0, 3))));
+	}
+	check_equal("zu", llfree_put_batch(&upper, llreq(&upper, 0, 3), f, 4),
+		    (size_t)4);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+
+	// Stops at the first frame that is not allocated
+	for (size_t i = 0; i < 2; i++) {
+		check(llfree_is_ok(llfree_get(&upper, frame_id_some(f[i]),
+					      llreq(&upper, 0, 3))));
+	}
+	f[2] = f[1];
+	check_equal("zu", llfree_put_batch(&upper, llreq(&upper, 0, 3), f, 4),
+		    (size_t)2);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+
+	// Huge frames
+	for (size_t i = 0; i < 4; i++) {
+		llfree_result_t res =
+			llfree_get(&upper, frame_id_none(),
+				   llreq(&upper, 1, LLFREE_HUGE_ORDER));
+		check(llfree_is_ok(res));
+		f[i] = res.frame;
+	}
+	check_equal("zu",
+		    llfree_put_batch(&upper, llreq(&upper, 1, LLFREE_HUGE_ORDER),
+				     f, 4),
+		    (size_t)4);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	return success;
+}
+
+#if LLFREE_DEFERRED_FREE
+declare_test(llfree_deferred_free)
+{
+	bool success = true;
+
+	const size_t frames = 2 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(1, frames, LLFREE_INIT_FREE);
+
+	// Order 0 frames might be cached by magazines or owned rows instead
+	static frame_id_t out[LLFREE_TREE_SIZE];
+	size_t got = llfree_get_batch(&upper, llreq(&upper, 0, 1), out,
+				      LLFREE_DEFERRED_FREE);
+	check_equal("zu", got, (size_t)LLFREE_DEFERRED_FREE);
+
+	// Buffered until the queue is full
+	for (size_t i = got; i > 1; i--) {
+		check(llfree_is_ok(
+			llfree_put(&upper, out[i - 1], llreq(&upper, 0, 1))));
+	}
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 2 * got);
+	check(llfree_is_ok(llfree_put(&upper, out[0], llreq(&upper, 0, 1))));
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+
+	// A different order flushes the queue
+	check(llfree_is_ok(llfree_get(&upper, frame_id_some(frame_id(0)),
+				      llreq(&upper, 0, 1))));
+	check(llfree_is_ok(llfree_get(&upper, frame_id_some(frame_id(8)),
+				      llreq(&upper, 0, 3))));
+	check(llfree_is_ok(
+		llfree_put(&upper, frame_id(0), llreq(&upper, 0, 1))));
+	check(llfree_is_ok(
+		llfree_put(&upper, frame_id(8), llreq(&upper, 0, 3))));
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 8);
+	llfree_flush(&upper);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	// Double frees are rejected when buffered and after a flush
+	check(llfree_is_ok(llfree_get(&upper, frame_id_some(frame_id(0)),
+				      llreq(&upper, 0, 1))));
+	check(llfree_is_ok(
+		llfree_put(&upper, frame_id(0), llreq(&upper, 0, 1))));
+	llfree_result_t twice =
+		llfree_put(&upper, frame_id(0), llreq(&upper, 0, 1));
+	check_equal("u", twice.error, LLFREE_ERR_ADDRESS);
+	llfree_flush(&upper);
+	twice = llfree_put(&upper, frame_id(0), llreq(&upper, 0, 1));
+	check_equal("u", twice.error, LLFREE_ERR_ADDRESS);
+	twice = llfree_put(&upper, frame_id(8), llreq(&upper, 0, 3));
+	check_equal("u", twice.error, LLFREE_ERR_ADDRESS);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames);
+	llfree_validate(&upper);
+
+	// Allocations retry with the buffered frames when out of memory
+	size_t total = 0;
+	for (;;) {
+		got = llfree_get_batch(&upper, llreq(&upper, 0, 1), out,
+				       LLFREE_TREE_SIZE);
+		if (got == 0)
+			break;
+		total += got;
+	}
+	check_equal("zu", 2 * total, frames);
+	check(llfree_is_ok(llfree_put(&upper, out[0], llreq(&upper, 0, 1))));
+	check_equal("zu", llfree_stats(&upper).free_frames, (size_t)0);
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 1));
+	check(llfree_is_ok(res));
+	check_equal(PRIu64, res.frame.value, out[0].value);
+
+	return success;
+}
+#endif
+
+#if LLFREE_MAGAZINE
+declare_test(llfree_magazine)
+{
+	bool success = true;
+
+	const size_t frames = 2 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(1, frames, LLFREE_INIT_FREE);
+
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	res = llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	check_equal("zu", llfree_tree_stats(&upper).free_frames, frames - 2);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 2);
+	llfree_validate(&upper);
+
+	// Hot frames are reused
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	check_equal("zu", llfree_tree_stats(&upper).free_frames, frames - 1);
+	llfree_result_t again =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(again));
+	check_equal(PRIu64, again.frame.value, res.frame.value);
+
+	// Double frees are detected in the magazine
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	check(!llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+
+	// and after it was flushed
+	res = llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	llfree_flush(&upper);
+	llfree_result_t twice =
+		llfree_put(&upper, res.frame, llreq(&upper, 0, 0));
+	check_equal("u", twice.error, LLFREE_ERR_ADDRESS);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 1);
+
+	// Full magazines are freed to the bitfields
+	static frame_id_t out[2 * LLFREE_MAGAZINE];
+	for (size_t i = 0; i < 2 * LLFREE_MAGAZINE; i++) {
+		res = llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+		check(llfree_is_ok(res));
+		out[i] = res.frame;
+	}
+	for (size_t i = 0; i < 2 * LLFREE_MAGAZINE; i++) {
+		check(llfree_is_ok(
+			llfree_put(&upper, out[i], llreq(&upper, 0, 0))));
+	}
+	check_equal("zu", llfree_tree_stats(&upper).free_frames, frames - 1);
+	check(lower_stats(&upper.lower).free_frames < frames - 1);
+	llfree_validate(&upper);
+
+	// Draining empties the magazines
+	llfree_drain(&upper);
+	check_equal("zu", lower_stats(&upper.lower).free_frames, frames - 1);
+	llfree_validate(&upper);
+
+	return success;
+}
+#endif
+
+#if LLFREE_ENABLE_OWNED_ROWS
+declare_test(llfree_owned_rows)
+{
+	bool success = true;
+
+	const size_t frames = 2 * LLFREE_TREE_SIZE;
+	lldrop llfree_t upper = llfree_new(1, frames, LLFREE_INIT_FREE);
+
+	// The first allocation reserves a tree, the second claims the rest of
+	// the row
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	res = llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	check_equal("zu", lower_stats(&upper.lower).free_frames,
+		    frames - LLFREE_ATOMIC_SIZE);
+	check_equal("zu", llfree_tree_stats(&upper).free_frames, frames - 2);
+	check_equal("zu", llfree_stats(&upper).free_frames, frames - 2);
+	llfree_validate(&upper);
+
+	// The row is handed out in order and frames are returned to it
+	llfree_result_t next =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(next));
+	check_equal(PRIu64, next.frame.value, res.frame.value + 1);
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	check(!llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	next = llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check_equal(PRIu64, next.frame.value, res.frame.value);
+
+	// Exhausting the row claims the next one
+	for (size_t i = 0; i < LLFREE_ATOMIC_SIZE; i++) {
+		res = llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+		check(llfree_is_ok(res));
+	}
+	check_equal("zu", llfree_tree_stats(&upper).free_frames,
+		    frames - LLFREE_ATOMIC_SIZE - 3);
+	check_equal("zu", lower_stats(&upper.lower).free_frames,
+		    frames - 2 * LLFREE_ATOMIC_SIZE);
+
+	// Draining publishes the row
+	llfree_drain(&upper);
+	check_equal("zu", lower_stats(&upper.lower).free_frames,
+		    frames - LLFREE_ATOMIC_SIZE - 3);
+	llfree_validate(&upper);
+
+	return success;
+}
+#endif
+
+#if LLFREE_ENABLE_TRACE
+struct trace_events {
+	size_t len;
+	llfree_trace_event_t events[8];
+};
+
+static void trace_collect(const llfree_trace_event_t *event, void *ctx)
+{
+	struct trace_events *t = ctx;
+	if (t->len < 8)
+		t->events[t->len] = *event;
+	t->len++;
+}
+
+declare_test(llfree_trace)
+{
+	bool success = true;
+
+	lldrop llfree_t upper = llfree_new(1, LLFREE_TREE_SIZE << 4,
+					   LLFREE_INIT_FREE);
+	struct trace_events t = { 0 };
+	llfree_set_trace(&upper, trace_collect, &t);
+
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 3));
+	check(llfree_is_ok(res));
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 3))));
+	// Invalid frames are traced with their error
+	check_equal("u",
+		    llfree_put(&upper, frame_id(1), llreq(&upper, 0, 3)).error,
+		    LLFREE_ERR_ARGUMENT);
+
+	// Runs are traced as a single event
+	llfree_result_t run = llfree_get_run(&upper, llreq(&upper, 0, 0), 3, 4);
+	check(llfree_is_ok(run));
+	check(llfree_is_ok(
+		llfree_put_run(&upper, run.frame, llreq(&upper, 0, 0), 3)));
+	// and so are ranges
+	llfree_result_t range = llfree_get_contig(&upper, 600, 512, 0);
+	check(llfree_is_ok(range));
+	check(llfree_is_ok(llfree_put_contig(&upper, range.frame, 600, 0)));
+
+	llfree_set_trace(&upper, NULL, NULL);
+	check(llfree_is_ok(
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0))));
+
+	check_equal("zu", t.len, (size_t)7);
+	check_equal("u", t.events[0].op, LLFREE_TRACE_GET);
+	check(!t.events[0].frame.present);
+	check_equal("u", t.events[0].request.order, 3);
+	check_equal("zu", t.events[0].result.frame.value, res.frame.value);
+	check_equal("u", t.events[1].op, LLFREE_TRACE_PUT);
+	check_equal("zu", t.events[1].frame.value.value, res.frame.value);
+	check(llfree_is_ok(t.events[1].result));
+	check_equal("u", t.events[2].result.error, LLFREE_ERR_ARGUMENT);
+	check_equal("u", t.events[3].op, LLFREE_TRACE_GET_RUN);
+	check_equal("zu", t.events[3].len, (size_t)3);
+	check_equal("zu", t.events[3].align, (size_t)4);
+	check_equal("zu", t.events[3].result.frame.value, run.frame.value);
+	check_equal("u", t.events[4].op, LLFREE_TRACE_PUT_RUN);
+	check_equal("zu", t.events[4].frame.value.value, run.frame.value);
+	check_equal("zu", t.events[4].len, (size_t)3);
+	check(llfree_is_ok(t.events[4].result));
+	check_equal("u", t.events[5].op, LLFREE_TRACE_GET_CONTIG);
+	check_equal("zu", t.events[5].len, (size_t)600);
+	check_equal("zu", t.events[5].align, (size_t)512);
+	check_equal("zu", t.events[5].result.frame.value, range.frame.value);
+	check_equal("u", t.events[6].op, LLFREE_TRACE_PUT_CONTIG);
+	check_equal("zu", t.events[6].frame.value.value, range.frame.value);
+	check(llfree_is_ok(t.events[6].result));
+
+	return success;
+}
+#endif
+
+#if LLFREE_ENABLE_CONTENTION
+declare_test(llfree_contention)
+{
+	bool success = true;
+
+	lldrop llfree_t upper = llfree_new(1, LLFREE_TREE_SIZE << 4,
+					   LLFREE_INIT_FREE);
+	llfree_tree_contention_t top[3];
+	check_equal("zu", llfree_contention(&upper, top, 3), (size_t)0);
+
+	// Simulate failed CAS attempts
+	upper.trees.contention[3].tree = 5;
+	upper.trees.contention[1].children = 7;
+	upper.trees.contention[9].tree = 1;
+	upper.trees.contention[9].children = 1;
+	upper.trees.contention[12].tree = 1;
+
+	check_equal("zu", llfree_contention(&upper, top, 3), (size_t)3);
+	check_equal("zu", top[0].tree.value, (size_t)1);
+	check_equal("zu", top[0].child_cas, (uint64_t)7);
+	check_equal("zu", top[1].tree.value, (size_t)3);
+	check_equal("zu", top[1].tree_cas, (uint64_t)5);
+	check_equal("zu", top[2].tree.value, (size_t)9);
+
+	llfree_contention_reset(&upper);
+	check_equal("zu", llfree_contention(&upper, top, 3), (size_t)0);
+
+	return success;
+}
+#endif
+
+#if LLFREE_ENABLE_HOOKS
+struct hook_events {
+	size_t counts[LLFREE_EVENT_MAX];
+	llfree_event_info_t last[LLFREE_EVENT_MAX];
+};
+
+static void hook_collect(const llfree_event_info_t *info, void *ctx)
+{
+	struct hook_events *h = ctx;
+	h->counts[info->event]++;
+	h->last[info->event] = *info;
+}
+
+declare_test(llfree_hooks)
+{
+	bool success = true;
+
+	lldrop llfree_t upper = llfree_new(1, LLFREE_TREE_SIZE << 4,
+					   LLFREE_INIT_FREE);
+	struct hook_events h = { 0 };
+	for (size_t e = 0; e < LLFREE_EVENT_MAX; e++)
+		llfree_set_hook(&upper, (llfree_event_t)e, hook_collect, &h);
+
+	// Reserving a free tree demotes it from the default class
+	llfree_result_t res =
+		llfree_get(&upper, frame_id_none(), llreq(&upper, 0, 0));
+	check(llfree_is_ok(res));
+	check_equal("zu", h.counts[LLFREE_EVENT_RESERVE], (size_t)1);
+	check_equal("zu", h.counts[LLFREE_EVENT_DEMOTE], (size_t)1);
+	check_equal("u", h.last[LLFREE_EVENT_DEMOTE].old_class, 2);
+	check_equal("u", h.last[LLFREE_EVENT_DEMOTE].class, 0);
+	size_t tree = tree_from_frame(res.frame).value;
+	check_equal("zu", h.last[LLFREE_EVENT_RESERVE].frame.value,
+		    frame_from_tree(tree_id(tree)).value);
+
+	// The child becomes entirely free again, once the frames that are held
+	// back by the local slot are flushed
+	check(llfree_is_ok(llfree_put(&upper, res.frame, llreq(&upper, 0, 0))));
+	llfree_flush(&upper);
+	check_equal("zu", h.counts[LLFREE_EVENT_CHILD_FREE], (size_t)1);
+	check_equal("zu", h.last[LLFREE_EVENT_CHILD_FREE].frame.value,
+		    res.frame.value & ~(LLFREE_CHILD_SIZE - 1));
+
+	// Freeing a part of a huge frame splits it
+	res = llfree_get(&upper, frame_id_none(),
+			 llreq(&upper, 0, LLFREE_HUGE_ORDER));
+	check(llfree_is_ok(res));
+	check(llfree_is_ok(llfree_put(&upper, frame_id(res.frame.value + 1),
+				      llreq(&upper, 0, 0))));
+	llfree_flush(&upper);
+	check_equal("zu", h.counts[LLFREE_EVENT_SPLIT_HUGE], (size_t)1);
+	check_equal("zu", h.last[LLFREE_EVENT_SPLIT_HUGE].frame.value,
+		    res.frame.value);
+
+	llfree_drain(&upper);
+	check_equal("zu", h.counts[LLFREE_EVENT_UNRESERVE], (size_t)2);
+
+	// Exhaust the memory with huge frames
+	// Removed hooks are no longer called
+	llfree_set_hook(&upper, LLFREE_EVENT_RESERVE, NULL, NULL);
+	size_t huge = 0;
+	for (;; huge++) {
+		res = llfree_get(&upper, frame_id_none(),
+				 llreq(&upper, 0, LLFREE_HUGE_ORDER));
+		if (!llfree_is_ok(res))
+			break;
+	}
+	check_equal("u", res.error, LLFREE_ERR_MEMORY);
+	check_equal("zu", h.counts[LLFREE_EVENT_RESERVE], (size_t)2);
+	check_equal("zu", h.counts[LLFREE_EVENT_OOM], (size_t)1);
+	check_equal("u", h.last[LLFREE_EVENT_OOM].order, LLFREE_HUGE_ORDER);
+	check_equal("u", h.last[LLFREE_EVENT_OOM].class, 2);
+
+	// Ranges report the order of the frame that would fit them
+	check_equal("u", llfree_get_contig(&upper, 3, 1, 0).error,
+		    LLFREE_ERR_MEMORY);
+	check_equal("zu", h.counts[LLFREE_EVENT_OOM], (size_t)2);
+	check_equal("u", h.last[LLFREE_EVENT_OOM].order, 2);
+
+	return success;
+}
+#endif
@@ -3,6 +3,7 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 
 #define bitfield_is_free(actual)                                               \
@@ -286,6 +287,111 @@ declare_test(lower_put)
 	return success;
 }
 
+#if LLFREE_ENABLE_ROW_SUMMARY
+declare_test(lower_summary)
+{
+	bool success = true;
+
+	lower_t actual = lower_new(LLFREE_CHILD_SIZE, LLFREE_INIT_FREE);
+	_Atomic(child_t) *child = &actual.children[0].entries[0];
+	llfree_result_t ret;
+
+	for (size_t i = 0; i < 2 * LLFREE_ATOMIC_SIZE; i++) {
+		ret = lower_get(&actual, frame_id(0), 0, frame_id_none());
+		check(llfree_is_ok(ret));
+	}
+	check_equal("x", (unsigned)atom_load(child).full, 0x3u);
+
+	// Full rows are skipped
+	ret = lower_get(&actual, frame_id(LLFREE_ATOMIC_SIZE), 0,
+			frame_id_none());
+	check(llfree_is_ok(ret));
+	check_equal(PRIu64, ret.frame.value, (uint64_t)128);
+	ret = lower_put(&actual, frame_id(128), 0);
+	check(llfree_is_ok(ret));
+
+	// Freeing a frame clears the row
+	ret = lower_put(&actual, frame_id(3), 0);
+	check(llfree_is_ok(ret));
+	check_equal("x", (unsigned)atom_load(child).full, 0x2u);
+	ret = lower_get(&actual, frame_id(0), 0, frame_id_none());
+	check(llfree_is_ok(ret));
+	check_equal(PRIu64, ret.frame.value, (uint64_t)3);
+	check_equal("x", (unsigned)atom_load(child).full, 0x3u);
+
+	// Rows that are allocated at once
+	ret = lower_get(&actual, frame_id(0), LLFREE_ATOMIC_ORDER + 1,
+			frame_id_none());
+	check(llfree_is_ok(ret));
+	check_equal(PRIu64, ret.frame.value, (uint64_t)128);
+	check_equal("x", (unsigned)atom_load(child).full, 0xfu);
+	ret = lower_put(&actual, frame_id(128), LLFREE_ATOMIC_ORDER + 1);
+	check(llfree_is_ok(ret));
+	check_equal("x", (unsigned)atom_load(child).full, 0x3u);
+
+	for (size_t i = 0; i < 2 * LLFREE_ATOMIC_SIZE; i++) {
+		ret = lower_put(&actual, frame_id(i), 0);
+		check(llfree_is_ok(ret));
+	}
+	check_equal("x", (unsigned)atom_load(child).full, 0x0u);
+
+	// Splitting a huge frame marks all rows as full
+	ret = lower_get(&actual, frame_id(0), LLFREE_HUGE_ORDER,
+			frame_id_none());
+	check(llfree_is_ok(ret));
+	ret = lower_put(&actual, frame_id(LLFREE_ATOMIC_SIZE), 0);
+	check(llfree_is_ok(ret));
+	check_equal("x", (unsigned)atom_load(child).full, 0xfdu);
+
+	lower_drop(&actual);
+	return success;
+}
+#endif
+
+declare_test(lower_claim_row)
+{
+	bool success = true;
+
+	lower_t actual = lower_new(LLFREE_TREE_SIZE, LLFREE_INIT_FREE);
+	_Atomic(child_t) *child = &actual.children[0].entries[0];
+	row_id_t row = row_id(0);
+
+	llfree_result_t ret = lower_get(&actual, frame_id(0), 0,
+					frame_id_none());
+	check(llfree_is_ok(ret));
+
+	// Claims the remaining frames of the row
+	uint64_t free = lower_claim_row(&actual, frame_id(0),
+					LLFREE_ATOMIC_SIZE, &row);
+	check_equal(PRIx64, free, (uint64_t)~1ull);
+	check_equal(PRIu64, row.value, (uint64_t)0);
+	check_equal("u", (unsigned)atom_load(child).free,
+		    (unsigned)(LLFREE_CHILD_SIZE - LLFREE_ATOMIC_SIZE));
+#if LLFREE_ENABLE_ROW_SUMMARY
+	check_equal("x", (unsigned)atom_load(child).full, 0x1u);
+#endif
+
+	// Up to max frames of the next row that is not full
+	uint64_t free2 = lower_claim_row(&actual, frame_id(0), 4, &row);
+	check_equal(PRIx64, free2, (uint64_t)0xf);
+	check_equal(PRIu64, row.value, (uint64_t)1);
+
+	lower_release_row(&actual, row, free2);
+	lower_release_row(&actual, row_id(0), free);
+	ret = lower_put(&actual, frame_id(0), 0);
+	check(llfree_is_ok(ret));
+	check_equal("u", (unsigned)atom_load(child).free,
+		    (unsigned)LLFREE_CHILD_SIZE);
+#if LLFREE_ENABLE_ROW_SUMMARY
+	check_equal("x", (unsigned)atom_load(child).full, 0x0u);
+#endif
+	check_equal("zu", lower_stats(&actual).free_frames,
+		    (size_t)LLFREE_TREE_SIZE);
+
+	lower_drop(&actual);
+	return success;
+}
+
 declare_test(lower_is_free)
 {
 	bool success = true;
@@ -472,6 +578,177 @@ declare_test(lower_max)
 	return success;
 }
 
+declare_test(lower_huge_rollback)
+{
+	bool success = true;
+
+	const size_t FRAMES = LLFREE_TREE_SIZE;
+	lower_t lower = lower_new(FRAMES, LLFREE_INIT_FREE);
+
+	// Occupy the second huge frame of a pair
+	frame_id_t second = frame_id(1u << LLFREE_HUGE_ORDER);
+	check(llfree_is_ok(lower_get(&lower, frame_id(0), LLFREE_HUGE_ORDER,
+				     frame_id_some(second))));
+
+	// Fails on the occupied child without claiming the free one
+	check_equal("u", lower_get(&lower, frame_id(0), LLFREE_HUGE_ORDER + 1,
+				   frame_id_some(frame_id(0)))
+				 .error,
+		    LLFREE_ERR_MEMORY);
+	check_equal("zu", lower_stats(&lower).free_frames,
+		    FRAMES - (1u << LLFREE_HUGE_ORDER));
+
+	// Both children keep their state
+	check_equal("zu",
+		    lower_stats_at(&lower, frame_id(0), LLFREE_HUGE_ORDER)
+			    .free_frames,
+		    (size_t)1u << LLFREE_HUGE_ORDER);
+	check_equal("zu",
+		    lower_stats_at(&lower, second, LLFREE_HUGE_ORDER).free_frames,
+		    (size_t)0);
+	check(llfree_is_ok(lower_put(&lower, second, LLFREE_HUGE_ORDER)));
+
+	// Order 12 may need more than one CAS (without the wide CAS or with the
+	// row summary), so it claims the first children before failing
+	// on the last one and has to roll them back
+	frame_id_t last = frame_id((size_t)7 << LLFREE_HUGE_ORDER);
+	check(llfree_is_ok(lower_get(&lower, frame_id(0), LLFREE_HUGE_ORDER,
+				     frame_id_some(last))));
+	check_equal("u", lower_get(&lower, frame_id(0), LLFREE_HUGE_ORDER + 3,
+				   frame_id_some(frame_id(0)))
+				 .error,
+		    LLFREE_ERR_MEMORY);
+	for (size_t i = 0; i < 7; i++) {
+		frame_id_t frame = frame_id(i << LLFREE_HUGE_ORDER);
+		check_equal_m("zu",
+			      lower_stats_at(&lower, frame, LLFREE_HUGE_ORDER)
+				      .free_frames,
+			      (size_t)1u << LLFREE_HUGE_ORDER, "child %zu", i);
+	}
+	check(llfree_is_ok(lower_put(&lower, last, LLFREE_HUGE_ORDER)));
+	check_equal("zu", lower_stats(&lower).free_frames, FRAMES);
+
+	lower_drop(&lower);
+	return success;
+}
+
+struct rollback_arg {
+	lower_t *lower;
+	bool big;
+	size_t rounds;
+	size_t allocated;
+};
+
+/// Either allocates all eight children at once or only the last one
+static void *rollback_par(void *arg)
+{
+	struct rollback_arg *a = arg;
+	size_t order = a->big ? LLFREE_HUGE_ORDER + 3 : LLFREE_HUGE_ORDER;
+	frame_id_t frame =
+		frame_id(a->big ? 0 : (size_t)7 << LLFREE_HUGE_ORDER);
+
+	for (size_t i = 0; i < a->rounds; i++) {
+		llfree_result_t ret = lower_get(a->lower, frame_id(0), order,
+						frame_id_some(frame));
+		if (llfree_is_ok(ret)) {
+			a->allocated += 1;
+			ret = lower_put(a->lower, frame, order);
+			assert(llfree_is_ok(ret));
+		} else {
+			assert(ret.error == LLFREE_ERR_MEMORY);
+		}
+	}
+	return NULL;
+}
+
+declare_test(lower_huge_rollback_par)
+{
+	bool success = true;
+
+	const size_t FRAMES = LLFREE_TREE_SIZE;
+	lower_t lower = lower_new(FRAMES, LLFREE_INIT_FREE);
+
+	// The order 12 allocations race with the ones on the last child,
+	// which makes them roll back the children they already claimed
+	pthread_t threads[4];
+	struct rollback_arg args[4];
+	for (size_t i = 0; i < 4; i++) {
+		args[i] = (struct rollback_arg){ .lower = &lower,
+						 .big = i % 2 == 0,
+						 .rounds = 100000 };
+		assert(pthread_create(&threads[i], NULL, rollback_par,
+				      &args[i]) == 0);
+	}
+	for (size_t i = 0; i < 4; i++)
+		assert(pthread_join(threads[i], NULL) == 0);
+
+	// Every rollback restored the claimed children
+	check_equal("zu", lower_stats(&lower).free_frames, FRAMES);
+	for (size_t i = 0; i < LLFREE_TREE_CHILDREN; i++) {
+		frame_id_t frame = frame_id(i << LLFREE_HUGE_ORDER);
+		check_equal_m("zu",
+			      lower_stats_at(&lower, frame, LLFREE_HUGE_ORDER)
+				      .free_frames,
+			      (size_t)1u << LLFREE_HUGE_ORDER, "child %zu", i);
+	}
+	// Both kinds of allocations succeeded at some point
+	check(args[0].allocated + args[2].allocated > 0);
+	check(args[1].allocated + args[3].allocated > 0);
+
+	lower_drop(&lower);
+	return success;
+}
+
+declare_test(lower_has_huge)
+{
+	bool success = true;
+
+	const size_t FRAMES = LLFREE_TREE_SIZE;
+	lower_t lower = lower_new(FRAMES, LLFREE_INIT_FREE);
+	check(lower_has_huge(&lower, frame_id(0), LLFREE_TREE_ORDER));
+
+	// Fragment every second child with a single frame
+	for (size_t i = 0; i < LLFREE_TREE_CHILDREN; i += 2) {
+		frame_id_t frame = frame_id(i * LLFREE_CHILD_SIZE + 1);
+		check(llfree_is_ok(
+			lower_get(&lower, frame, 0, frame_id_some(frame))));
+	}
+	check(lower_has_huge(&lower, frame_id(0), LLFREE_HUGE_ORDER));
+	check(!lower_has_huge(&lower, frame_id(0), LLFREE_HUGE_ORDER + 1));
+	check_equal("u",
+		    lower_get(&lower, frame_id(0), LLFREE_HUGE_ORDER + 1,
+			      frame_id_none())
+			    .error,
+		    LLFREE_ERR_MEMORY);
+
+	// Skips the fragmented children
+	llfree_result_t huge = lower_get(&lower, frame_id(0),
+					 LLFREE_HUGE_ORDER, frame_id_none());
+	check(llfree_is_ok(huge));
+	check_equal(PRIu64, huge.frame.value, (uint64_t)LLFREE_CHILD_SIZE);
+
+	// Fragment the remaining children
+	for (size_t i = 3; i < LLFREE_TREE_CHILDREN; i += 2) {
+		frame_id_t frame = frame_id(i * LLFREE_CHILD_SIZE);
+		check(llfree_is_ok(
+			lower_get(&lower, frame, 0, frame_id_some(frame))));
+	}
+	check(!lower_has_huge(&lower, frame_id(0), LLFREE_HUGE_ORDER));
+	check_equal("u",
+		    lower_get(&lower, frame_id(0), LLFREE_HUGE_ORDER,
+			      frame_id_none())
+			    .error,
+		    LLFREE_ERR_MEMORY);
+
+	// A freed huge frame is found again
+	check(llfree_is_ok(
+		lower_put(&lower, huge.frame, LLFREE_HUGE_ORDER)));
+	check(lower_has_huge(&lower, frame_id(0), LLFREE_HUGE_ORDER));
+
+	lower_drop(&lower);
+	return success;
+}
+
 declare_test(lower_free_all)
 {
 	bool success = true;
@@ -0,0 +1,142 @@
+#include "llfree.h"
+#include "llfree_inner.h"
+#include "metrics.h"
+
+#include "test.h"
+
+declare_test(metrics_hist_bucket)
+{
+	bool success = true;
+
+	for (uint64_t ns = 0; ns < 4; ns++)
+		check_equal("zu", metrics_hist_bucket(ns), (size_t)ns);
+
+	// Every bucket starts at its lower bound and is monotonic
+	uint64_t last = 0;
+	for (size_t b = 1; b < LLFREE_HIST_BUCKETS; b++) {
+		uint64_t ns = llfree_hist_bucket_ns(b);
+		check_m(ns > last, "bucket %zu", b);
+		check_equal("zu", metrics_hist_bucket(ns), b);
+		check_equal("zu", metrics_hist_bucket(ns - 1), b - 1);
+		last = ns;
+	}
+	check_equal("zu", metrics_hist_bucket(UINT64_MAX),
+		    (size_t)LLFREE_HIST_BUCKETS - 1);
+
+	llfree_hist_t hist = { 0 };
+	hist.buckets[metrics_hist_bucket(100)] = 90;
+	hist.buckets[metrics_hist_bucket(10000)] = 10;
+	check_equal("zu", llfree_hist_count(&hist), (uint64_t)100);
+	check_equal("zu", llfree_hist_quantile(&hist, 500),
+		    llfree_hist_bucket_ns(metrics_hist_bucket(100)));
+	check_equal("zu", llfree_hist_quantile(&hist, 900),
+		    llfree_hist_bucket_ns(metrics_hist_bucket(100)));
+	check_equal("zu", llfree_hist_quantile(&hist, 990),
+		    llfree_hist_bucket_ns(metrics_hist_bucket(10000)));
+
+	return success;
+}
+
+#if LLFREE_ENABLE_HISTOGRAMS
+declare_test(metrics_hist_record)
+{
+	bool success = true;
+
+	const size_t frames = 8 * LLFREE_TREE_SIZE;
+	llfree_classing_t classing = llfree_classing_simple(1);
+	llfree_meta_size_t m = llfree_metadata_size(&classing, frames);
+	llfree_meta_t meta = {
+		.local = llfree_ext_alloc(LLFREE_CACHE_SIZE, m.local),
+		.trees = llfree_ext_alloc(LLFREE_CACHE_SIZE, m.trees),
+		.lower = llfree_ext_alloc(LLFREE_CACHE_SIZE, m.lower),
+	};
+	llfree_t upper;
+	llfree_result_t ret =
+		llfree_init(&upper, frames, LLFREE_INIT_FREE, meta, &classing);
+	check(llfree_is_ok(ret));
+
+	llfree_histograms_reset();
+
+	llfree_request_t req = llfree_simple_request(1, 0, 0);
+	ret = llfree_get(&upper, frame_id_none(), req);
+	check(llfree_is_ok(ret));
+	// The first allocation reserves a tree, the second uses it
+	llfree_result_t ret2 = llfree_get(&upper, frame_id_none(), req);
+	check(llfree_is_ok(ret2));
+	check(llfree_is_ok(llfree_put(&upper, ret.frame, req)));
+	check(llfree_is_ok(llfree_put(&upper, ret2.frame, req)));
+
+	llfree_histograms_t *h = llfree_ext_alloc(LLFREE_CACHE_SIZE,
+						  sizeof(llfree_histograms_t));
+	llfree_histograms(h, ll_none());
+	check_equal("zu", llfree_hist_count(&h->get_order[0]), (uint64_t)2);
+	check_equal("zu", llfree_hist_count(&h->put_order[0]), (uint64_t)2);
+	check_equal("zu", llfree_hist_count(&h->get_path[LLFREE_PATH_RESERVE]),
+		    (uint64_t)1);
+	check_equal("zu", llfree_hist_count(&h->get_path[LLFREE_PATH_LOCAL]),
+		    (uint64_t)1);
+	check_equal("zu", llfree_hist_count(&h->put_path[LLFREE_PATH_LOCAL]),
+		    (uint64_t)2);
+
+	llfree_histograms_reset();
+	llfree_histograms(h, ll_none());
+	check_equal("zu", llfree_hist_count(&h->get_order[0]), (uint64_t)0);
+
+	llfree_ext_free(LLFREE_CACHE_SIZE, sizeof(llfree_histograms_t), h);
+	llfree_ext_free(LLFREE_CACHE_SIZE, m.local, meta.local);
+	llfree_ext_free(LLFREE_CACHE_SIZE, m.trees, meta.trees);
+	llfree_ext_free(LLFREE_CACHE_SIZE, m.lower, meta.lower);
+	return success;
+}
+#endif
+
+#if LLFREE_ENABLE_COUNTERS
+declare_test(metrics_counters)
+{
+	bool success = true;
+
+	const size_t frames = 8 * LLFREE_TREE_SIZE;
+	llfree_classing_t classing = llfree_classing_simple(1);
+	llfree_meta_size_t m = llfree_metadata_size(&classing, frames);
+	llfree_meta_t meta = {
+		.local = llfree_ext_alloc(LLFREE_CACHE_SIZE, m.local),
+		.trees = llfree_ext_alloc(LLFREE_CACHE_SIZE, m.trees),
+		.lower = llfree_ext_alloc(LLFREE_CACHE_SIZE, m.lower),
+	};
+	llfree_t upper;
+	llfree_result_t ret =
+		llfree_init(&upper, frames, LLFREE_INIT_FREE, meta, &classing);
+	check(llfree_is_ok(ret));
+
+	llfree_counters_reset();
+
+	// The first allocation searches and reserves a tree
+	llfree_request_t req = llfree_simple_request(1, 0, 0);
+	ret = llfree_get(&upper, frame_id_none(), req);
+	check(llfree_is_ok(ret));
+	llfree_counters_t c = llfree_counters();
+	check_equal("zu", c.swap_reserved, (uint64_t)1);
+	check(c.search_visits >= 1);
+	check_equal("zu", c.steal_local, (uint64_t)0);
+	check_equal("zu", c.huge_rollbacks, (uint64_t)0);
+	check_equal("zu", c.field_rollbacks, (uint64_t)0);
+
+	// The second one is served by the reservation
+	llfree_result_t ret2 = llfree_get(&upper, frame_id_none(), req);
+	check(llfree_is_ok(ret2));
+	check_equal("zu", llfree_counters().swap_reserved, (uint64_t)1);
+
+	check(llfree_is_ok(llfree_put(&upper, ret.frame, req)));
+	check(llfree_is_ok(llfree_put(&upper, ret2.frame, req)));
+
+	llfree_counters_reset();
+	c = llfree_counters();
+	check_equal("zu", c.swap_reserved, (uint64_t)0);
+	check_equal("zu", c.search_visits, (uint64_t)0);
+
+	llfree_ext_free(LLFREE_CACHE_SIZE, m.local, meta.local);
+	llfree_ext_free(LLFREE_CACHE_SIZE, m.trees, meta.trees);
+	llfree_ext_free(LLFREE_CACHE_SIZE, m.lower, meta.lower);
+	return success;
+}
+#endif
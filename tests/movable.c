@@ -90,6 +90,7 @@ declare_test(alloc_movable)
 		check_m(llfree_is_ok(ret), "free allocation %zu failed", i);
 	}
 
+	llfree_flush(&llfree);
 	check(llfree_tree_stats(&llfree).free_frames ==
 	      (1 << 30) / LLFREE_FRAME_SIZE);
 